@@ -86,6 +86,44 @@ function platform_defines()
     filter{}
 end
 
+-- Settings shared by every project that links to raylib (the game and the tools)
+function use_raylib()
+        links {"raylib"}
+
+        cdialect "C17"
+        cppdialect "C++17"
+
+        includedirs {raylib_dir .. "/src" }
+        includedirs {raylib_dir .."/src/external" }
+        includedirs { raylib_dir .."/src/external/glfw/include" }
+        flags { "ShadowedVariables"}
+        platform_defines()
+
+        filter "action:vs*"
+            defines{"_WINSOCK_DEPRECATED_NO_WARNINGS", "_CRT_SECURE_NO_WARNINGS"}
+            dependson {"raylib"}
+            links {"raylib.lib"}
+            characterset ("Unicode")
+            buildoptions { "/Zc:__cplusplus" }
+
+        filter "system:windows"
+            defines{"_WIN32"}
+            links {"winmm", "gdi32", "opengl32"}
+            libdirs {"../bin/%{cfg.buildcfg}"}
+
+        -- Worker threads (MSVC builds run the workers' jobs on the calling thread instead)
+        filter {"system:windows", "action:gmake*"}
+            links {"pthread"}
+
+        filter "system:linux"
+            links {"pthread", "m", "dl", "rt", "X11"}
+
+        filter "system:macosx"
+            links {"OpenGL.framework", "Cocoa.framework", "IOKit.framework", "CoreFoundation.framework", "CoreAudio.framework", "CoreVideo.framework", "AudioToolbox.framework"}
+
+        filter{}
+end
+
 -- if you don't want to download raylib, then set this to false, and set the raylib dir to where you want raylib to be pulled from, must be full sources.
 downloadRaylib = true
 raylib_dir = "external/raylib-master"
@@ -165,37 +203,35 @@ if (downloadRaylib) then
         includedirs { "../src" }
         includedirs { "../include" }
 
-        links {"raylib"}
+        use_raylib()
+		
 
-        cdialect "C17"
-        cppdialect "C++17"
+    -- Map compiler (turns .map files into compiled .cmap files)
+    project "mapc"
+        kind "ConsoleApp"
+        location "build_files/"
+        targetdir "../bin/%{cfg.buildcfg}"
 
-        includedirs {raylib_dir .. "/src" }
-        includedirs {raylib_dir .."/src/external" }
-        includedirs { raylib_dir .."/src/external/glfw/include" }
-        flags { "ShadowedVariables"}
-        platform_defines()
+        files {"../tools/mapc.c", "../src/mapdata.c", "../src/mapparser.c", "../src/loaderror.c", "../src/hashmap.c", "../src/linkedlist.c", "../src/strutil.c", "../include/**.h"}
 
-        filter "action:vs*"
-            defines{"_WINSOCK_DEPRECATED_NO_WARNINGS", "_CRT_SECURE_NO_WARNINGS"}
-            dependson {"raylib"}
-            links {"raylib.lib"}
-            characterset ("Unicode")
-            buildoptions { "/Zc:__cplusplus" }
+        includedirs { "../include" }
 
-        filter "system:windows"
-            defines{"_WIN32"}
-            links {"winmm", "gdi32", "opengl32"}
-            libdirs {"../bin/%{cfg.buildcfg}"}
+        use_raylib()
 
-        filter "system:linux"
-            links {"pthread", "m", "dl", "rt", "X11"}
 
-        filter "system:macosx"
-            links {"OpenGL.framework", "Cocoa.framework", "IOKit.framework", "CoreFoundation.framework", "CoreAudio.framework", "CoreVideo.framework", "AudioToolbox.framework"}
+    -- Ray traversal benchmark (runs from the repository root, like the game)
+    project "raybench"
+        kind "ConsoleApp"
+        location "build_files/"
+        targetdir "../bin/%{cfg.buildcfg}"
+
+        files {"../tools/raybench.c", "../src/**.c", "../include/**.h"}
+        removefiles {"../src/main.c"}
+
+        includedirs { "../include" }
+
+        use_raylib()
 
-        filter{}
-		
 
     project "raylib"
         kind "StaticLib"
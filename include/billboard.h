@@ -3,14 +3,17 @@
 #define BILLBOARD_H
 
 #include "raylib.h"
+#include "texturecache.h"
 
 typedef struct billboard* Billboard;
 typedef const struct billboard* CBillboard;
 
-Billboard BillboardCreate(Texture sprite, int posX, int posY, int size);
+// The billboard gets its own handle to sprite
+Billboard BillboardCreate(TextureHandle sprite, int posX, int posY, int size);
 void BillboardDestroy(Billboard* bp);
 
 Texture BillboardGetTexture(CBillboard bb);
+TextureHandle BillboardGetTextureHandle(CBillboard bb);
 
 int BillboardGetX(CBillboard bb);
 int BillboardGetY(CBillboard bb);
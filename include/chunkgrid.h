@@ -0,0 +1,81 @@
+#include <stdbool.h>
+#include "mapdata.h"
+
+#ifndef CHUNKGRID_H
+#define CHUNKGRID_H
+
+// Side (in cells) of a chunk: 1 << CHUNK_SHIFT (the same as MAPDATA_CHUNK_SIZE)
+#define CHUNK_SHIFT 6
+#define CHUNK_SIZE (1 << CHUNK_SHIFT)
+#define CHUNK_MASK (CHUNK_SIZE - 1)
+
+// Each chunk is also split in CHUNK_BLOCKS x CHUNK_BLOCKS blocks of 8x8 cells, whose occupancy is kept as a bitmask
+#define CHUNK_BLOCK_SHIFT 3
+#define CHUNK_BLOCK_SIZE (1 << CHUNK_BLOCK_SHIFT)
+#define CHUNK_BLOCKS (CHUNK_SIZE / CHUNK_BLOCK_SIZE)
+
+// Chunks kept in memory by default, besides the modified ones (8 MiB of tiles)
+#define CHUNKGRID_DEFAULT_BUDGET 1024
+
+// Grid of tile IDs stored as square chunks in a sparse table. Chunks that are entirely GROUND take no memory.
+// A grid can be backed by a compiled map file, whose chunks are then only read when first used; the least recently
+// used ones are dropped when more than the budget are in memory. Modified chunks are never dropped.
+typedef struct chunkgrid* ChunkGrid;
+
+// Creates a grid where every cell is GROUND
+ChunkGrid ChunkGridCreate(int numRows, int numCols);
+
+// Creates a grid backed by a compiled map file, whose header (see MapDataLoadCompiledHeader) is data.
+// The file is kept open until the grid is destroyed.
+ChunkGrid ChunkGridCreateFromFile(MapData data, const char* filename);
+
+// Destroys a ChunkGrid
+void ChunkGridDestroy(ChunkGrid* gridp);
+
+
+// Returns the tile ID at a cell (GROUND outside of the grid)
+int ChunkGridGetTile(ChunkGrid grid, int row, int col);
+
+// Sets the tile ID of a cell (in the grid, at most 0xFFFF)
+void ChunkGridSetTile(ChunkGrid grid, int row, int col, int tile);
+
+// Returns whether a cell is not GROUND (false outside of the grid), from the solidity bitmap kept with the tiles
+bool ChunkGridIsSolid(ChunkGrid grid, int row, int col);
+
+// Returns whether any cell from firstCol to lastCol (inclusive) of a row is not GROUND. Tests a word per chunk.
+bool ChunkGridIsSpanSolid(ChunkGrid grid, int row, int firstCol, int lastCol);
+
+// Returns whether any cell of a rectangle (inclusive; parts outside of the grid are ignored) is not GROUND.
+// Chunks that are entirely GROUND are skipped whole, and the rest are tested a word per row.
+bool ChunkGridIsRectSolid(ChunkGrid grid, int firstRow, int firstCol, int lastRow, int lastCol);
+
+// Returns the tiles of a chunk (CHUNK_SIZE*CHUNK_SIZE, row-major), or NULL if it is entirely GROUND or outside of the grid.
+// The pointer is only valid until another chunk is requested, since that can drop this one.
+const unsigned short* ChunkGridGetChunk(ChunkGrid grid, int chunkRow, int chunkCol);
+
+// Returns the solidity bitmap of a chunk (CHUNK_SIZE words: bit col of word row is set if that cell is not GROUND),
+// or NULL if it is entirely GROUND or outside of the grid. Same lifetime as the pointer of ChunkGridGetChunk.
+const unsigned long long* ChunkGridGetChunkSolidity(ChunkGrid grid, int chunkRow, int chunkCol);
+
+// Returns the occupancy of the blocks of a chunk: bit (blockRow*CHUNK_BLOCKS + blockCol) is set if that block has
+// cells that are not GROUND (0 if the chunk is entirely GROUND)
+unsigned long long ChunkGridGetChunkBlocks(ChunkGrid grid, int chunkRow, int chunkCol);
+
+// Returns a lower bound of the Chebyshev distance (cells) from each cell of a chunk to the nearest cell that is not
+// GROUND (0 for those cells), or NULL if the chunk is entirely GROUND (or outside of the grid). Only the chunk's own
+// cells are looked at, so it is computed (when first needed) and kept up to date for each chunk on its own. Chunks
+// read from a compiled file with distances take them from it; the others, and changed ones, compute it.
+// Same lifetime as the pointer of ChunkGridGetChunk.
+const unsigned char* ChunkGridGetChunkDistances(ChunkGrid grid, int chunkRow, int chunkCol);
+
+// Sets how many unmodified chunks can be kept in memory (at least 1)
+void ChunkGridSetBudget(ChunkGrid grid, int maxChunks);
+
+// Returns the number of chunks in memory
+int ChunkGridGetNumResident(ChunkGrid grid);
+
+// Returns whether the grid is backed by a file. Reading such a grid can load and drop chunks, so it must not be read
+// from several threads at once; other grids can be, while nothing modifies them.
+bool ChunkGridIsFileBacked(ChunkGrid grid);
+
+#endif
@@ -0,0 +1,49 @@
+#include <stdbool.h>
+#include "raylib.h"
+
+#ifndef COLORMAP_H
+#define COLORMAP_H
+
+// Fog levels of a colormap, from none to full
+#define COLORMAP_LEVELS 32
+
+// Light levels. Walls hit on their Y sides are darker, so that the corners between faces can be told apart.
+typedef enum ColormapLight {
+    LIGHT_FULL,
+    LIGHT_SIDE,
+} ColormapLight;
+
+#define COLORMAP_LIGHTS 2
+
+// What each channel of a color becomes at a shade, so that shading a texel is a lookup per channel
+typedef struct colormapShade {
+    unsigned char r[256];
+    unsigned char g[256];
+    unsigned char b[256];
+} colormapShade;
+
+// The shades of every light level at every fog level, computed once (like Doom's COLORMAP).
+typedef struct colormap* Colormap;
+
+// Creates the colormap of a fog: what is seen at a depth of d cells is 1 - exp(-fogDensity*d) fogColor, and the
+// rest its own color (in its light). A density of 0 is no fog.
+Colormap ColormapCreate(Color fogColor, float fogDensity);
+
+// Destroys a Colormap
+void ColormapDestroy(Colormap* cmp);
+
+// The shade of what is at a depth (cells) in a light, or NULL if it is seen as it is (full light and no fog).
+const colormapShade* ColormapGetShade(Colormap cm, double depth, ColormapLight light);
+
+// Depth (cells) from which everything is the fog color (-1 if there is no fog)
+double ColormapGetFogDepth(Colormap cm);
+Color ColormapGetFogColor(Colormap cm);
+
+// A color at a shade (NULL leaves it as it is). The alpha is kept.
+Color ColormapApply(const colormapShade* shade, Color color);
+
+// The color that a texture can be multiplied by to approximate a shade (on the GPU): white at that shade. Exact
+// when the fog is black.
+Color ColormapGetTint(const colormapShade* shade);
+
+#endif
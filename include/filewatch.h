@@ -0,0 +1,21 @@
+#include <stdbool.h>
+
+#ifndef FILEWATCH_H
+#define FILEWATCH_H
+
+// Watches a set of files for changes. Uses inotify on Linux, and checks the files' modification times elsewhere.
+typedef struct filewatch* FileWatch;
+
+// Creates a FileWatch that watches no files
+FileWatch FileWatchCreate(void);
+
+// Destroys a FileWatch
+void FileWatchDestroy(FileWatch* watchp);
+
+// Starts watching a file (it does not need to exist yet)
+void FileWatchAdd(FileWatch watch, const char* path);
+
+// Returns whether or not any of the watched files changed since the last call. Does not block.
+bool FileWatchPoll(FileWatch watch);
+
+#endif
@@ -0,0 +1,36 @@
+#include "raylib.h"
+
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+// A frame rendered on the CPU: its pixels, and the texture they are uploaded to so it can be drawn.
+typedef struct framebuffer* FrameBuffer;
+
+// Rows of pixels start on boundaries of this many bytes (a cache line), and are padded to a multiple of it
+#define FRAMEBUFFER_ALIGN 64
+
+// Creates a FrameBuffer of width x height pixels (all black)
+FrameBuffer FrameBufferCreate(int width, int height);
+
+// Destroys a FrameBuffer
+void FrameBufferDestroy(FrameBuffer* fbp);
+
+// Changes the size of the frame (the pixels are then undefined). Nothing is done if it is the same.
+void FrameBufferResize(FrameBuffer fb, int width, int height);
+
+int FrameBufferGetWidth(FrameBuffer fb);
+int FrameBufferGetHeight(FrameBuffer fb);
+
+int FrameBufferGetStride(FrameBuffer fb);    // Pixels from the start of a row to the next one (at least the width)
+
+// The pixels, row-major (pixel (x, y) at y*stride + x). Different rows can be written from different threads, and so
+// can different columns of a row that start at multiples of FRAMEBUFFER_ALIGN / sizeof(Color) without sharing a line.
+Color* FrameBufferGetPixels(FrameBuffer fb);
+
+// Uploads the pixels to the texture (packing the rows first if they are padded). Must be called from the main thread.
+void FrameBufferUpload(FrameBuffer fb);
+
+// The texture the pixels were last uploaded to
+Texture FrameBufferGetTexture(FrameBuffer fb);
+
+#endif
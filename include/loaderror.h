@@ -0,0 +1,22 @@
+#include <stdio.h>
+#include <setjmp.h>
+
+#ifndef LOADERROR_H
+#define LOADERROR_H
+
+// Errors found while loading a map (parsing, validating or reading a compiled file), once they are printed. They exit
+// the program, unless a handler is set: then they close the files being read and jump to it (longjmp with 1), so that
+// a reload can keep what was loaded before. What the failed load allocated is not freed.
+
+// Sets the handler (NULL to exit on errors again), returning the previous one
+jmp_buf* LoadErrorSetHandler(jmp_buf* handler);
+
+// Ends the load after an error
+_Noreturn void LoadErrorFail(void);
+
+// Files being read by a load (at most LOADERROR_MAX_FILES at once), closed if it fails
+#define LOADERROR_MAX_FILES 4
+void LoadErrorAddFile(FILE* file);
+void LoadErrorRemoveFile(FILE* file);
+
+#endif
@@ -2,6 +2,10 @@
 #include "tile.h"
 #include "billboard.h"
 #include "list.h"
+#include "framebuffer.h"
+#include "workerpool.h"
+#include "renderqueue.h"
+#include "colormap.h"
 
 #ifndef MAP_H
 #define MAP_H
@@ -10,21 +14,90 @@ typedef struct map* Map;
 
 Map MapCreate(int numRows, int numCols, int tileSize);
 Map MapCreateFromFile(const char* filename);
+// Loads the file again, only updating what changed. If it is invalid, the map is kept as it was and false is returned.
+bool MapReload(Map map, const char* filename);
 void MapDestroy(Map* mp);
 
+// Returns a List with the paths (char*, relative to the map file's directory) of the texture files used by the map.
+// The paths belong to the map, but the List must be destroyed.
+List MapGetTextureFiles(Map map);
+
 void MapSetTile(Map map, int row, int col, int tile);
 int MapGetTile(Map map, int row, int col);
 Tile MapGetTileObject(Map map, int tile);
+int MapGetNumTiles(Map map);    // Number of tile types (tile IDs go from 0 to this minus one)
+
+// Solidity queries (whether cells are not GROUND), answered from a bitmap with one bit per cell kept with the tiles.
+// Cells outside of the map are not solid.
+bool MapIsSolid(Map map, int row, int col);
+bool MapIsSolidAt(Map map, int posX, int posY);     // Cell at a position (pixels)
+bool MapIsSpanSolid(Map map, int row, int firstCol, int lastCol);   // Any cell of the span (inclusive)
+bool MapIsRectSolid(Map map, int firstRow, int firstCol, int lastRow, int lastCol);  // Any cell of the rectangle (inclusive)
+
+// The grid is stored in chunks of MAP_CHUNK_SIZE x MAP_CHUNK_SIZE cells (see chunkgrid.h)
+#define MAP_CHUNK_SHIFT 6
+#define MAP_CHUNK_SIZE (1 << MAP_CHUNK_SHIFT)
+#define MAP_CHUNK_MASK (MAP_CHUNK_SIZE - 1)
+
+// Chunks are split in blocks of MAP_BLOCK_SIZE x MAP_BLOCK_SIZE cells
+#define MAP_BLOCK_SHIFT 3
+#define MAP_BLOCK_SIZE (1 << MAP_BLOCK_SHIFT)
+#define MAP_CHUNK_BLOCKS (MAP_CHUNK_SIZE / MAP_BLOCK_SIZE)
+
+// Returns the tiles of a chunk (row-major), or NULL if it is entirely GROUND or outside of the map. For reading many
+// cells of the same chunk quickly; the pointer is only valid until another chunk (or tile) is requested.
+const unsigned short* MapGetChunk(Map map, int chunkRow, int chunkCol);
+
+// Returns the solidity bitmap of a chunk: bit col of word row (relative to the chunk) is set if that cell is not
+// GROUND. NULL if the chunk is entirely GROUND. Same lifetime as the pointer of MapGetChunk.
+const unsigned long long* MapGetChunkSolidity(Map map, int chunkRow, int chunkCol);
+
+// Returns which blocks of a chunk have tiles that are not GROUND: bit (blockRow*MAP_CHUNK_BLOCKS + blockCol), where
+// blockRow and blockCol are relative to the chunk (0 if the chunk is entirely GROUND). Kept up to date by MapSetTile.
+unsigned long long MapGetChunkBlocks(Map map, int chunkRow, int chunkCol);
+
+// Returns a lower bound of the Chebyshev distance (cells) from each cell of a chunk to the nearest tile that is not
+// GROUND, or NULL if the chunk is entirely GROUND (its cells are at least their distance to its border plus one).
+// Only looks inside the chunk, so MapSetTile only has to update the chunk it changes.
+const unsigned char* MapGetChunkDistances(Map map, int chunkRow, int chunkCol);
+
+// Sets how many chunks of a compiled map can be kept in memory, besides the modified ones
+void MapSetChunkBudget(Map map, int maxChunks);
+
+// Returns whether the chunks of the map are read from a compiled map file as needed. Such a map can only be read from
+// one thread at a time; any other map can be read from several threads at once, while nothing modifies it.
+bool MapIsStreamed(Map map);
 
 int MapGetTileSize(Map map);
 int MapGetNumRows(Map map);
 int MapGetNumCols(Map map);
 
 List MapGetBillboardsAt(Map map, int col, int row);
+void MapMoveBillboard(Map map, Billboard bb, int posX, int posY); // Use instead of BillboardSetX/Y for billboards in a map
 
 Texture MapGetTextureAt(Map map, int row, int col);
 
+// Shades of the map's fog (see fogColor in the README), kept until the map is reloaded or destroyed
+Colormap MapGetColormap(Map map);
+
+// Modification counters, so that results computed from the map can be kept until it changes.
+// The version changes with the tiles, colors or textures (MapSetTile, MapReload), the billboard version when billboards
+// move (MapMoveBillboard, MapReload).
+unsigned int MapGetVersion(Map map);
+unsigned int MapGetBillboardVersion(Map map);
+
+// Draws the part of the map seen through the current 2D camera (which may pan and zoom, but not rotate). The tiles
+// are kept in a texture per chunk, only made again for the chunks that MapSetTile changed.
 void MapDraw2D(Map map);
-void MapDraw3D(Map map, int screenWidth, int screenHeight);
+void MapDraw3D(Map map, RenderQueue queue, int screenWidth, int screenHeight);    // The ceiling and ground colors (in the fog), for maps with no flats
+
+// Floors and ceilings (flats, see FlatDefinition in the README). Whether the map defines any.
+bool MapHasFlats(Map map);
+
+// Draws the floor and ceiling seen from a position (pixels) and direction (radians) into a frame whose columns are
+// spread evenly in angle over fov (radians), like the player's rays. Rows are cast in bands by the pool's workers
+// (NULL draws on this thread). Textured flats are sampled from the textures' CPU copies (see
+// TextureCacheSetKeepImages), and drawn with the ground or ceiling color while they have none.
+void MapDrawFlats(Map map, FrameBuffer fb, double posX, double posY, double rotation, double fov, WorkerPool pool);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,17 @@
+#include <stdbool.h>
+#include "mapdata.h"
+
+#ifndef MAPCACHE_H
+#define MAPCACHE_H
+
+// Name of the folder (next to each map file) where the parse cache is kept
+#define MAPCACHE_DIR ".mapcache"
+
+// Returns the data of a text map file. If the cache has an entry for the file's current contents it is loaded from there,
+// otherwise the file is parsed and the result is added to the cache, replacing the entries for its older contents.
+MapData MapCacheLoad(const char* filename);
+
+// Enables or disables the cache (enabled by default). When disabled, MapCacheLoad always parses.
+void MapCacheSetEnabled(bool enabled);
+
+#endif
@@ -0,0 +1,145 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include "raylib.h"
+
+#ifndef MAPDATA_H
+#define MAPDATA_H
+
+// Magic number at the start of a compiled map file (see mapc)
+#define MAPDATA_MAGIC "RCMP"
+#define MAPDATA_VERSION 3
+
+// Side (in cells) of the square chunks a compiled map grid is stored in
+#define MAPDATA_CHUNK_SIZE 64
+
+// A texture file referenced by a map
+typedef struct mapTexture {
+    char* path;                 // File name, relative to the directory of the map file
+    unsigned char* packed;      // File contents, when packed into a compiled map (NULL otherwise)
+    int packedSize;             // Size of packed (bytes)
+} mapTexture;
+
+// A tile type, as defined in TileDefinition
+typedef struct mapTileDef {
+    char* name;
+    bool isTransparent;
+    int texture;                // Index in the textures array, or -1 for a solid color tile
+    Color color;                // Color of the tile when texture is -1
+} mapTileDef;
+
+// A billboard type, as defined in BillboardDefinition
+typedef struct mapBillboardDef {
+    char* name;
+    int texture;                // Index in the textures array
+} mapBillboardDef;
+
+// A billboard, as placed in BillboardPlacing
+typedef struct mapBillboard {
+    int posX;                   // Position (pixels)
+    int posY;                   //
+    int def;                    // Index in the billboardDefs array
+} mapBillboard;
+
+// A floor or ceiling type, as defined in FlatDefinition
+typedef struct mapFlatDef {
+    char* name;
+    int texture;                // Index in the textures array, or -1 for a solid color flat
+    Color color;                // Color of the flat when texture is -1
+} mapFlatDef;
+
+// A floor or ceiling, as placed in FlatPlacing
+typedef struct mapFlat {
+    int row;                    // Cell
+    int col;                    //
+    int def;                    // Index in the flatDefs array
+    bool isCeiling;
+} mapFlat;
+
+// A chunk stored in a compiled map file (chunks that are entirely GROUND are not stored)
+typedef struct mapChunk {
+    int chunkRow;               // Position in chunks (the chunk's first cell is at chunkRow*chunkSize, chunkCol*chunkSize)
+    int chunkCol;               //
+    int solidCount;             // Number of cells that are not GROUND
+    unsigned long long offset;  // Position of its contents in the file
+} mapChunk;
+
+// Validated description of a map, independent of any loaded (GPU) resources.
+// It is what both the text map files and the compiled map files are turned into before a Map is built.
+typedef struct mapdata {
+    int numRows;
+    int numCols;
+    int tileSize;                       // Size of each tile (pixels)
+    Color ceilingColor;
+    Color groundColor;
+    Color fogColor;
+    float fogDensity;                   // Per cell of depth (0 for no fog, see ColormapCreate)
+    int numTextures;
+    mapTexture* textures;
+    int numTileDefs;
+    mapTileDef* tileDefs;               // Indexed by tile ID (MapTiles). Index 0 is always GROUND
+    int numBillboardDefs;
+    mapBillboardDef* billboardDefs;
+    int numBillboards;
+    mapBillboard* billboards;
+    int numFlatDefs;
+    mapFlatDef* flatDefs;
+    int floorDef;                       // Flat of the cells with no floor placed (index in flatDefs, or -1 for groundColor)
+    int ceilingDef;                     // Same, for the ceiling (-1 for ceilingColor)
+    int numFlats;
+    mapFlat* flats;                     // Placed floors and ceilings (a cell can have both)
+    int* grid;                          // Tile IDs of each cell (grid[row*numCols + col]). NULL if only the header of a compiled map was loaded
+    unsigned char* distance;            // Chebyshev distance (cells) from each cell to the nearest solid one, saturated at 255 (NULL if not computed)
+
+    // Only for compiled maps
+    int chunkSize;
+    bool hasDistance;                   // Whether the chunks in the file have distances
+    int numChunks;
+    mapChunk* chunks;                   // Directory of the chunks in the file, sorted by chunkRow then chunkCol
+} mapData;
+
+typedef struct mapdata* MapData;
+
+// Parses and validates a text map file. Exits on an invalid map, like the parser does (see loaderror.h).
+MapData MapDataCreateFromFile(const char* filename);
+
+// Returns whether filename is a compiled map file.
+bool MapDataIsCompiled(const char* filename);
+
+// Returns the format version of a compiled map file (-1 if it is not one).
+int MapDataGetCompiledVersion(const char* filename);
+
+// Loads a compiled map file. Exits on an invalid file (see loaderror.h).
+MapData MapDataLoadCompiled(const char* filename);
+
+// Loads everything but the grid of a compiled map file (grid and distance stay NULL), so its chunks can be read
+// when needed with MapDataReadChunk. Exits on an invalid file.
+MapData MapDataLoadCompiledHeader(const char* filename);
+
+// Reads a chunk (index in data->chunks) of the compiled map file that data's header was loaded from: its tiles
+// (chunkSize*chunkSize, row-major) and, if distance is not NULL, its distances. Exits on an invalid file.
+void MapDataReadChunk(MapData data, FILE* file, const char* filename, int chunk, unsigned short* tiles, unsigned char* distance);
+
+// Writes data as a compiled map file, returning whether or not it was successful.
+bool MapDataSaveCompiled(MapData data, const char* filename);
+
+// Destroys a MapData
+void MapDataDestroy(MapData* datap);
+
+
+// Returns the tile ID at a cell (GROUND outside of the map).
+int MapDataGetTile(MapData data, int row, int col);
+
+// Removes duplicate and unused tile, billboard and texture definitions (flat definitions are kept as they are), remapping tile IDs densely
+// (in order of definition). Returns the number of tile definitions that were removed.
+int MapDataOptimize(MapData data);
+
+// Sorts the billboards by the cell they are in, so they can be bucketed by cell without searching.
+void MapDataSortBillboards(MapData data);
+
+// Fills data->distance.
+void MapDataComputeDistances(MapData data);
+
+// Reads the textures' files into data (paths are relative to mapDir), returning whether or not it was successful.
+bool MapDataPackTextures(MapData data, const char* mapDir);
+
+#endif
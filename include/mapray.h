@@ -3,6 +3,7 @@
 #include "map.h"
 #include "list.h"
 #include "billboard.h"
+#include "workerpool.h"
 
 #ifndef MAPRAY_H
 #define MAPRAY_H
@@ -12,6 +13,18 @@ typedef enum MapRayHitSide {
     Y_AXIS,
 } MapRayHitSide;
 
+// How rays go through the empty space of the map. Every mode hits the same tile, except that TRAVERSAL_FIXED can hit
+// another one when the ray passes a cell corner within its 1/65536 rounding.
+typedef enum MapRayTraversal {
+    TRAVERSAL_DDA,          // One cell at a time
+    TRAVERSAL_MIPGRID,      // Skips empty chunks and 8x8 blocks (default)
+    TRAVERSAL_DISTANCE,     // Skips empty chunks, and as many cells around each one as its distance field allows
+    TRAVERSAL_FIXED,        // One cell at a time in 16.16 fixed-point, from the angle quantized to 1/65536 turns.
+                            // Gives the same results on every build. Hits the same tile as the others, unless the
+                            // ray passes a cell corner within its 1/65536 rounding, where it can go by the other
+                            // side of the corner.
+} MapRayTraversal;
+
 typedef enum CollisionType {
     COLLISION_MAP_TILE,
     COLLISION_BILLBOARD,
@@ -36,10 +49,26 @@ typedef struct rayCollision {
 
 typedef struct mapray* MapRay;
 
+// A line of sight query: whether the segment between two positions (pixels) is clear
+typedef struct mapSightQuery {
+    int fromX;
+    int fromY;
+    int toX;
+    int toY;
+} mapSightQuery;
+
+typedef struct mapSightResult {
+    bool visible;               // Whether no opaque tile is on the segment
+    int hitX;                   // First opaque cell on the segment (-1 if visible)
+    int hitY;                   //
+    double distance;            // From the start to where the segment enters that cell, or to the end if visible (pixels)
+} mapSightResult;
+
 MapRay MapRayCreate(int posX, int posY, double angle, double angleOffset, Map map);
 void MapRayDestroy(MapRay* mrp);
 
 void MapRaySetAngle(MapRay ray, double angle);
+void MapRaySetAngleOffset(MapRay ray, double angleOffset);
 void MapRaySetPosition(MapRay ray, int posX, int posY);
 void MapRaySetMap(MapRay ray, Map map);
 double MapRayGetTrueAngleRad(MapRay ray);
@@ -53,9 +82,33 @@ Vector2 MapRayGetCollisionPointGrid(MapRay ray, int idx);
 int MapRayGetMaxLength(MapRay ray);
 double MapRayGetLength(MapRay ray);
 MapRayHitSide MapRayGetHitSide(MapRay ray, int idx);
+Vector2 MapRayGetEndPoint(MapRay ray);  // Where the last cast ended: the farthest collision, or where it left the map
 
+// Sets how every ray goes through the map from now on
+void MapRaySetTraversal(MapRayTraversal mode);
+MapRayTraversal MapRayGetTraversal(void);
+const char* MapRayGetTraversalName(MapRayTraversal mode);
+
+// Walks the ray through the map, collecting what it hits up to the first opaque tile, or up to the transparent tile
+// whose texture columns hit (see TextureCacheGetColumnAlpha) leave nothing behind them to be seen. In fog, it stops where
+// the depth along the view direction (the angle offset's) reaches full fog (see ColormapGetFogDepth).
 void MapRayCast(MapRay ray);
-void MapRayDraw2D(MapRay ray);
+
+// Whether two rays from the same position only hit the same face of the same opaque tile (nothing in front of it)
+bool MapRayHitsSameFace(MapRay ray1, MapRay ray2);
+// Sets the result of ray to where it meets the face that hit (a ray with a single tile collision) hit, without
+// walking the grid. Returns false, leaving ray as it was, if it does not meet that face inside of the cell.
+// Exact when nothing is between the start and the face, as for rays between two that hit the same face.
+bool MapRayCastOnFace(MapRay ray, MapRay hit);
+
+// Answers numQueries line of sight queries at once, for gameplay code (AI sight, hitscan, sound occlusion). Only
+// opaque tiles block sight: not transparent tiles, billboards or cells outside of the map. Segments may start or end
+// outside of the map, and are clipped to it. A segment that starts inside an opaque tile is blocked at distance 0.
+// Segments through the exact corner of a cell may or may not be blocked by it. Walks the grid like MapRayCast with
+// TRAVERSAL_MIPGRID, without allocating anything per query. With a pool (and a map that is not streamed, see
+// MapIsStreamed), the queries are split between its workers, and the call waits for every job of the pool. The map
+// must not be modified until it returns.
+void MapRayCheckSight(Map map, const mapSightQuery* queries, mapSightResult* results, int numQueries, WorkerPool pool);
 
 
 #endif
\ No newline at end of file
@@ -6,10 +6,18 @@
 
 typedef struct player* Player;
 
+// How the rays are drawn in the 2D view
+typedef enum PlayerRayView {
+    RAY_VIEW_LINES,         // A line per ray
+    RAY_VIEW_FAN,           // The area they see, filled
+} PlayerRayView;
+
 Player PlayerCreate(int playerX, int playerY, int playerRotationDeg, int numRays, Map map);
 void PlayerDestroy(Player* pp);
 
 void PlayerSetMap(Player p, Map map);
+void PlayerSetNumRays(Player p, int numRays); // Columns of the 3D view. Rays are only created when there are more than ever before
+int PlayerGetNumRays(Player p);
 void PlayerRotate(Player p, double rot); // rot is in radians
 int PlayerGetX(Player p);
 int PlayerGetY(Player p);
@@ -17,10 +25,30 @@ int PlayerGetRotationDeg(Player p);
 double PlayerGetRotationRad(Player p);
 double PlayerGetCameraSensitivity(Player p);
 
+// Casting quality: 1 casts every ray. With a step of N, only every Nth ray is cast at first; the rays between two
+// that hit the same face are put on it without casting, and the rest are subdivided until they do. Objects narrower
+// than N rays can be missed.
+void PlayerSetCastStep(Player p, int step);
+int PlayerGetCastStep(Player p);
+int PlayerGetNumCasts(Player p);  // Rays cast in the last update (the rest were put on faces)
+
+// Whether the last PlayerInput changed what the player sees. It does not when the player's pixel position and
+// rotation and the map's versions are the same as before; then nothing is cast, and the last frame can be kept.
+bool PlayerViewChanged(Player p);
+
+// Drawing of the rays in the 2D view, in one batch: as lines or a fan, of every step-th ray (and the last one)
+void PlayerSetRayView(Player p, PlayerRayView view);
+PlayerRayView PlayerGetRayView(Player p);
+void PlayerSetRayDrawStep(Player p, int step);
+int PlayerGetRayDrawStep(Player p);
+
 bool PlayerIsColliding(Player p);
 
 void PlayerDraw2D(Player p);
-void PlayerDraw3D(Player p, int screenWidth, int screenHeight);
+// Adds the walls and billboards the player sees to queue, a column or sprite span per collision of each ray,
+// farthest first (their layer is their position in the ray's collisions).
+void PlayerDraw3D(Player p, RenderQueue queue, int screenWidth, int screenHeight);
+void PlayerDrawFlats(Player p, FrameBuffer fb, WorkerPool pool);   // The floor and ceiling the player sees (see MapDrawFlats)
 
 void PlayerInput(Player p);
 
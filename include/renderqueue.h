@@ -0,0 +1,94 @@
+#include <stdbool.h>
+#include "raylib.h"
+#include "texturecache.h"
+#include "framebuffer.h"
+#include "workerpool.h"
+#include "colormap.h"
+
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+// What the engine draws in a frame, as a list of commands that a backend then draws.
+typedef struct renderqueue* RenderQueue;
+
+// Share of what is behind layers under which it can not change a pixel (by more than rounding), so is not drawn
+#define RENDER_MIN_TRANSMITTANCE (0.5f / 255)
+
+typedef enum RenderCommandType {
+    RENDER_COLUMN,          // A column of a wall's texture, stretched over a screen rectangle
+    RENDER_SPRITE,          // The same, of a billboard's texture
+    RENDER_RECT,            // A filled rectangle
+    RENDER_LINE,            // A line
+} RenderCommandType;
+
+typedef struct renderCommand {
+    RenderCommandType type;
+    Color color;                    // Of rectangles and lines, and the tint of a span's shade
+    union {
+        struct {                    // RENDER_COLUMN and RENDER_SPRITE
+            TextureHandle texture;
+            int layer;              // Position in its screen column, counting from the farthest (see RenderQueueDraw)
+            Rectangle dest;
+            float u0;               // Part of the texture drawn (normalized, v is always 0 to 1)
+            float u1;               //
+            const colormapShade* shade; // Of the texels (NULL if drawn as they are)
+        } span;
+        Rectangle rect;             // RENDER_RECT
+        struct {                    // RENDER_LINE
+            Vector2 start;
+            Vector2 end;
+        } line;
+    };
+} renderCommand;
+
+// What draws the commands
+typedef enum RenderBackend {
+    RENDER_BACKEND_RAYLIB,          // Through rlgl, spans batched by texture
+    RENDER_BACKEND_SOFTWARE,        // Into a FrameBuffer, from the textures' CPU copies
+    RENDER_BACKEND_NULL,            // Nothing (the commands can still be read back)
+} RenderBackend;
+
+// Creates an empty RenderQueue
+RenderQueue RenderQueueCreate(void);
+
+// Destroys a RenderQueue
+void RenderQueueDestroy(RenderQueue* queuep);
+
+// Empties the queue, for the next frame.
+void RenderQueueClear(RenderQueue queue);
+
+// Commands are added at the end of the queue. The queue does not take the textures or the colormaps of the shades
+// (they must stay alive until it is drawn). The software backend shades each texel through the shade's tables, the
+// raylib one multiplies the texture by its tint (see ColormapGetTint).
+void RenderQueueColumn(RenderQueue queue, TextureHandle texture, int layer, Rectangle dest, float u0, float u1, const colormapShade* shade);
+void RenderQueueSprite(RenderQueue queue, TextureHandle texture, int layer, Rectangle dest, float u0, float u1, const colormapShade* shade);
+void RenderQueueRect(RenderQueue queue, Rectangle rect, Color color);
+void RenderQueueLine(RenderQueue queue, Vector2 start, Vector2 end, Color color);
+
+int RenderQueueGetNumCommands(RenderQueue queue);
+const renderCommand* RenderQueueGetCommand(RenderQueue queue, int index);
+
+// Draws the commands in order with backend, leaving them in the queue. Consecutive spans (columns and sprites) are
+// drawn by layer, so the ones of different screen columns must not overlap, and those of the same one must have
+// been added from the farthest. The software backend draws into target (NULL otherwise); its texels are sampled
+// from the textures' CPU copies (see TextureCacheSetKeepImages), and spans of textures with none are drawn in
+// their tint. With a pool, it splits the frame into vertical bands (aligned to FRAMEBUFFER_ALIGN) drawn by its
+// workers, and waits for every job of the pool; target must then be uploaded from the main thread. It composites the
+// layers of each screen column front to back, so that it stops drawing them where the nearer ones cover the column.
+void RenderQueueDraw(RenderQueue queue, RenderBackend backend, FrameBuffer target, WorkerPool pool);
+
+// Batches drawn by the last RenderQueueDraw with the raylib backend: one per layer and texture of each run of spans,
+// and one per run of rectangles or lines
+int RenderQueueGetNumBatches(RenderQueue queue);
+
+// Vertical bands the last RenderQueueDraw with the software backend drew, and the time each took (seconds)
+int RenderQueueGetNumBands(RenderQueue queue);
+double RenderQueueGetBandTime(RenderQueue queue, int band);
+
+// Pixels that spans were drawn into by the last RenderQueueDraw with the software backend, once per layer
+long long RenderQueueGetSpanFill(RenderQueue queue);
+
+// Name of a backend
+const char* RenderQueueGetBackendName(RenderBackend backend);
+
+#endif
@@ -0,0 +1,13 @@
+#include <stdbool.h>
+
+#ifndef STRUTIL_H
+#define STRUTIL_H
+
+// Hash (djb2) and comparison of string keys (char*), for HashMaps keyed by strings
+unsigned int StringHash(void* key);
+bool StringEquals(void* key1, void* key2);
+
+// Returns a copy of a string (to be freed)
+char* StringCopy(const char* str);
+
+#endif
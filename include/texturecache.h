@@ -0,0 +1,81 @@
+#include <stdbool.h>
+#include "raylib.h"
+
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+// Textures shared by tiles and billboards. Each texture is decoded and uploaded once, no matter how many handles to it
+// exist, and stays loaded after its last handle is released (until TextureCacheTrim), so reloading a map or loading
+// another one that uses it does not load it again.
+typedef struct cachedtexture* TextureHandle;
+
+// Most mip levels kept for the CPU copy of a texture (enough for 32768x32768)
+#define TEXTURECACHE_MAX_LEVELS 16
+
+// Images are decoded by worker threads, and uploaded on the main thread by TextureCacheUpdate. Until then, a handle's
+// texture is a placeholder (or, for a file that changed, the previous texture).
+
+// Returns a handle to the texture in an image file (relative to the working directory). Textures are keyed by their
+// resolved path, and loaded again if the file changed since. Exits (on upload) if the file can not be loaded the
+// first time; when loading it again fails, the previous texture is kept.
+TextureHandle TextureCacheLoad(const char* path);
+
+// Returns a handle to the texture in an image file's contents (fileType is its extension, like in LoadImageFromMemory).
+// Textures are keyed by the contents' hash. Exits (on upload) if they can not be loaded.
+TextureHandle TextureCacheLoadFromMemory(const char* fileType, const unsigned char* data, int size);
+
+// Returns a handle to a 1x1 texture of a color.
+TextureHandle TextureCacheLoadColor(Color color);
+
+// Returns another handle to the same texture (each handle must be released).
+TextureHandle TextureCacheAcquire(TextureHandle handle);
+
+// Releases a handle.
+void TextureCacheRelease(TextureHandle* handlep);
+
+Texture TextureCacheGetTexture(TextureHandle handle);
+
+// The CPU copy of the texture, or NULL if it was loaded while images were not being kept.
+const Image* TextureCacheGetImage(TextureHandle handle);
+
+// The CPU copy's texels in column-major order (texel (x, y) at x*height + y), kept with it, so that software rendering
+// reads the vertical strips of walls and billboards sequentially. NULL when the CPU copy is.
+const Color* TextureCacheGetColumns(TextureHandle handle);
+
+// Mip chain of the column-major copy: level 0 is the texture, and each level is half the size of the previous one
+// (at least 1 texel) down to 1x1. There are no levels when there is no CPU copy. The GPU textures get mipmaps too.
+int TextureCacheGetNumLevels(TextureHandle handle);
+const Color* TextureCacheGetLevelColumns(TextureHandle handle, int level, int* width, int* height);  // Size of the level in width and height (can be NULL)
+
+// Least alpha of the columns of the texture (at full size) between u0 and u1 (normalized, repeating like on the GPU):
+// 255 if a span drawn from them hides what is behind it. Known from when the texture is loaded, whether or not its CPU
+// copy is kept (0 until then). Mip levels average neighbouring columns, so they can be less opaque.
+unsigned char TextureCacheGetColumnAlpha(TextureHandle handle, float u0, float u1);
+
+// Returns the level to sample when each pixel drawn covers texelsPerPixel texels of the texture (for a wall strip,
+// texture height / strip height): the one where a pixel covers one to two texels (or the nearest level that exists).
+int TextureCacheSelectLevel(TextureHandle handle, float texelsPerPixel);
+
+// Returns a number that changes whenever a texture is uploaded (replacing a placeholder or a changed file's texture),
+// so frames drawn with the cached textures can be kept until it does.
+unsigned int TextureCacheGetVersion(void);
+
+// Whether to keep a CPU copy (Image) of the textures loaded from now on, for software rendering (not kept by default).
+void TextureCacheSetKeepImages(bool keep);
+
+// Whether to decode images on worker threads (enabled by default). When disabled, textures are ready once loaded.
+void TextureCacheSetAsync(bool enabled);
+
+// Uploads the images that finished decoding. Returns the number of images still being decoded. Call once per frame.
+int TextureCacheUpdate(void);
+
+// Waits for every image to be decoded, and uploads them.
+void TextureCacheFinish(void);
+
+// Unloads the textures that have no handles.
+void TextureCacheTrim(void);
+
+// Unloads every texture. No handles can be in use. Must be called before the window is closed.
+void TextureCacheUnloadAll(void);
+
+#endif
@@ -1,4 +1,5 @@
 #include "raylib.h"
+#include "texturecache.h"
 
 #ifndef TILE_H
 #define TILE_H
@@ -8,8 +9,9 @@
 
 typedef struct maptile* Tile;
 
-// Creates a tile object given its info.
+// Creates a tile object given its info. Textures come from the texture cache.
 Tile TileCreateTextured(char* name, int maptile, const char* imgname, bool is_transparent);
+Tile TileCreateFromTexture(char* name, int maptile, TextureHandle texture, bool is_transparent); // The tile takes the handle
 Tile TileCreateColored(char* name, int maptile, Color color);
 
 // Destroys a tile object.
@@ -21,9 +23,11 @@ char* TileGetName(Tile tile);
 
 // The number (MapTiles) that this tile represents.
 int TileGetMapTiles(Tile tile);
+void TileSetMapTiles(Tile tile, int maptile);
 
 // The texture associated with this tile.
 Texture TileGetTexture(Tile tile);
+TextureHandle TileGetTextureHandle(Tile tile);
 
 // True if the tile is transparent
 bool TileIsTransparent(Tile tile);
@@ -0,0 +1,25 @@
+#include <stdbool.h>
+
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+// A fixed set of worker threads that run submitted jobs in order of submission.
+// Without thread support (MSVC builds), jobs run on the thread that submits them.
+typedef struct workerpool* WorkerPool;
+
+// Creates a WorkerPool with numThreads threads (0 uses one per processor core)
+WorkerPool WorkerPoolCreate(int numThreads);
+
+// Destroys a WorkerPool, after waiting for its jobs to finish
+void WorkerPoolDestroy(WorkerPool* poolp);
+
+// Queues func(arg) to be run by one of the workers
+void WorkerPoolSubmit(WorkerPool pool, void (*func) (void* arg), void* arg);
+
+// Waits until every submitted job has finished
+void WorkerPoolWait(WorkerPool pool);
+
+// Returns the number of worker threads
+int WorkerPoolGetNumThreads(WorkerPool pool);
+
+#endif
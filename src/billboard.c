@@ -1,21 +1,24 @@
 #include "billboard.h"
 #include "raylib.h"
+#include "texturecache.h"
 #include <stdlib.h>
 #include <assert.h>
 
 struct billboard {
-    Texture sprite;
+    TextureHandle sprite;
     int posX;
     int posY;
     int size;
 };
 
 
-Billboard BillboardCreate(Texture sprite, int posX, int posY, int size) {
+Billboard BillboardCreate(TextureHandle sprite, int posX, int posY, int size) {
+    assert(sprite != NULL);
+
     Billboard bb = malloc(sizeof(struct billboard));
     assert(bb != NULL);
 
-    bb->sprite = sprite;
+    bb->sprite = TextureCacheAcquire(sprite);
     bb->posX = posX;
     bb->posY = posY;
     bb->size = size;
@@ -29,6 +32,7 @@ void BillboardDestroy(Billboard* bbp) {
 
     Billboard bb = *bbp;
 
+    TextureCacheRelease(&bb->sprite);
     free(bb);
 
     *bbp = NULL;
@@ -37,6 +41,12 @@ void BillboardDestroy(Billboard* bbp) {
 Texture BillboardGetTexture(CBillboard bb) {
     assert(bb != NULL);
 
+    return TextureCacheGetTexture(bb->sprite);
+}
+
+TextureHandle BillboardGetTextureHandle(CBillboard bb) {
+    assert(bb != NULL);
+
     return bb->sprite;
 }
 
@@ -67,5 +77,5 @@ void BillboardSetX(Billboard bb, int posX) {
 void BillboardSetY(Billboard bb, int posY) {
     assert(bb != NULL);
 
-    bb->posX = posY;
+    bb->posY = posY;
 }
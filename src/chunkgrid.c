@@ -0,0 +1,481 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "chunkgrid.h"
+#include "mapdata.h"
+#include "tile.h"
+
+typedef struct chunk {
+    unsigned short tiles[CHUNK_SIZE*CHUNK_SIZE];
+    unsigned long long solid[CHUNK_SIZE];  // Bit col of solid[row] is set if that cell is not GROUND
+    int index;                  // chunkRow*chunkCols + chunkCol
+    int solidCount;             // Number of cells that are not GROUND
+    unsigned char blockCounts[CHUNK_BLOCKS*CHUNK_BLOCKS];  // Number of cells that are not GROUND in each block
+    unsigned long long blocks;  // Bit (blockRow*CHUNK_BLOCKS + blockCol) is set if that block has cells that are not GROUND
+    unsigned char distance[CHUNK_SIZE*CHUNK_SIZE];  // See ChunkGridGetChunkDistances (only valid if hasDistance)
+    bool hasDistance;
+    bool modified;              // Modified chunks can not be read again, so they are never dropped
+    struct chunk* prev;         // Neighbours in the LRU list (unmodified chunks only)
+    struct chunk* next;         //
+} chunk;
+
+struct chunkgrid {
+    int numRows;
+    int numCols;
+    int chunkRows;
+    int chunkCols;
+    chunk** chunks;             // Chunks in memory (NULL if not loaded, or entirely GROUND)
+    int* stored;                // Index in directory->chunks of each chunk still to be read from the file (-1 if none)
+    MapData directory;          // Chunk directory of the file (NULL if not backed by a file)
+    FILE* file;
+    char* filename;
+    int numResident;
+    int numUnmodified;          // Chunks in the LRU list
+    int budget;
+    chunk* lruFirst;            // Most recently used
+    chunk* lruLast;             // Least recently used
+};
+
+static void lruRemove(ChunkGrid grid, chunk* ch) {
+    if (ch->prev != NULL) ch->prev->next = ch->next; else grid->lruFirst = ch->next;
+    if (ch->next != NULL) ch->next->prev = ch->prev; else grid->lruLast = ch->prev;
+    ch->prev = NULL;
+    ch->next = NULL;
+    grid->numUnmodified--;
+}
+
+static void lruPushFirst(ChunkGrid grid, chunk* ch) {
+    ch->prev = NULL;
+    ch->next = grid->lruFirst;
+    if (grid->lruFirst != NULL) grid->lruFirst->prev = ch; else grid->lruLast = ch;
+    grid->lruFirst = ch;
+    grid->numUnmodified++;
+}
+
+// INTERNAL: bit of the block that contains a cell of a chunk (row and col inside the chunk)
+static int blockBit(int row, int col) {
+    return ((row >> CHUNK_BLOCK_SHIFT) * CHUNK_BLOCKS) + (col >> CHUNK_BLOCK_SHIFT);
+}
+
+// INTERNAL: counts the cells that are not GROUND in each block of a chunk, and fills its solidity bitmap
+static void countBlocks(chunk* ch) {
+    memset(ch->blockCounts, 0, sizeof(ch->blockCounts));
+    memset(ch->solid, 0, sizeof(ch->solid));
+    ch->blocks = 0;
+    for (int row = 0; row < CHUNK_SIZE; row++) {
+        for (int col = 0; col < CHUNK_SIZE; col++) {
+            if (ch->tiles[(row << CHUNK_SHIFT) | col] != TILE_GROUND) {
+                ch->blockCounts[blockBit(row, col)]++;
+                ch->blocks |= 1ULL << blockBit(row, col);
+                ch->solid[row] |= 1ULL << col;
+            }
+        }
+    }
+}
+
+// INTERNAL: bits firstCol to lastCol (inside a chunk, inclusive) of a row of the solidity bitmap
+static unsigned long long spanMask(int firstCol, int lastCol) {
+    return (~0ULL >> (CHUNK_SIZE - 1 - lastCol)) & (~0ULL << firstCol);
+}
+
+// INTERNAL: computes the distance field of a chunk. Solid cells outside of the chunk are not known, but are at least
+// one cell past its border, so every cell starts at its distance to the border plus one.
+static void computeDistance(chunk* ch) {
+    unsigned char* dist = ch->distance;
+    for (int row = 0; row < CHUNK_SIZE; row++) {
+        for (int col = 0; col < CHUNK_SIZE; col++) {
+            int edge = row < CHUNK_SIZE-1-row ? row : CHUNK_SIZE-1-row;
+            if (col < edge) edge = col;
+            if (CHUNK_SIZE-1-col < edge) edge = CHUNK_SIZE-1-col;
+            dist[(row << CHUNK_SHIFT) | col] = (ch->solid[row] >> col) & 1 ? 0 : (unsigned char) (edge + 1);
+        }
+    }
+
+    // Two pass chamfer transform, like MapDataComputeDistances
+    for (int row = 0; row < CHUNK_SIZE; row++) {
+        for (int col = 0; col < CHUNK_SIZE; col++) {
+            int d = dist[(row << CHUNK_SHIFT) | col];
+            if (row > 0) {
+                if (dist[((row-1) << CHUNK_SHIFT) | col] + 1 < d) d = dist[((row-1) << CHUNK_SHIFT) | col] + 1;
+                if (col > 0 && dist[((row-1) << CHUNK_SHIFT) | (col-1)] + 1 < d) d = dist[((row-1) << CHUNK_SHIFT) | (col-1)] + 1;
+                if (col < CHUNK_SIZE-1 && dist[((row-1) << CHUNK_SHIFT) | (col+1)] + 1 < d) d = dist[((row-1) << CHUNK_SHIFT) | (col+1)] + 1;
+            }
+            if (col > 0 && dist[(row << CHUNK_SHIFT) | (col-1)] + 1 < d) d = dist[(row << CHUNK_SHIFT) | (col-1)] + 1;
+            dist[(row << CHUNK_SHIFT) | col] = (unsigned char) d;
+        }
+    }
+    for (int row = CHUNK_SIZE-1; row >= 0; row--) {
+        for (int col = CHUNK_SIZE-1; col >= 0; col--) {
+            int d = dist[(row << CHUNK_SHIFT) | col];
+            if (row < CHUNK_SIZE-1) {
+                if (dist[((row+1) << CHUNK_SHIFT) | col] + 1 < d) d = dist[((row+1) << CHUNK_SHIFT) | col] + 1;
+                if (col > 0 && dist[((row+1) << CHUNK_SHIFT) | (col-1)] + 1 < d) d = dist[((row+1) << CHUNK_SHIFT) | (col-1)] + 1;
+                if (col < CHUNK_SIZE-1 && dist[((row+1) << CHUNK_SHIFT) | (col+1)] + 1 < d) d = dist[((row+1) << CHUNK_SHIFT) | (col+1)] + 1;
+            }
+            if (col < CHUNK_SIZE-1 && dist[(row << CHUNK_SHIFT) | (col+1)] + 1 < d) d = dist[(row << CHUNK_SHIFT) | (col+1)] + 1;
+            dist[(row << CHUNK_SHIFT) | col] = (unsigned char) d;
+        }
+    }
+
+    ch->hasDistance = true;
+}
+
+// INTERNAL: makes the distances stored in a compiled file (to the nearest solid cell in the whole map) the chunk's
+// distance field. They are clamped to what computeDistance would find, so that changes to other chunks can not make
+// them too large. Cells past the map's edge keep their bound from the border, as no walk gets to them.
+static void clampDistance(chunk* ch) {
+    for (int row = 0; row < CHUNK_SIZE; row++) {
+        for (int col = 0; col < CHUNK_SIZE; col++) {
+            int edge = row < CHUNK_SIZE-1-row ? row : CHUNK_SIZE-1-row;
+            if (col < edge) edge = col;
+            if (CHUNK_SIZE-1-col < edge) edge = CHUNK_SIZE-1-col;
+            if (ch->distance[(row << CHUNK_SHIFT) | col] > edge + 1) {
+                ch->distance[(row << CHUNK_SHIFT) | col] = (unsigned char) (edge + 1);
+            }
+        }
+    }
+
+    ch->hasDistance = true;
+}
+
+// INTERNAL: drops a chunk from memory
+static void dropChunk(ChunkGrid grid, chunk* ch) {
+    grid->chunks[ch->index] = NULL;
+    grid->numResident--;
+    free(ch);
+}
+
+// INTERNAL: reads a stored chunk, dropping the least recently used ones if over the budget
+static chunk* loadChunk(ChunkGrid grid, int index) {
+    while (grid->numUnmodified >= grid->budget && grid->lruLast != NULL) {
+        chunk* victim = grid->lruLast;
+        lruRemove(grid, victim);
+        dropChunk(grid, victim);
+    }
+
+    chunk* ch = malloc(sizeof(chunk));
+    assert(ch != NULL);
+
+    int stored = grid->stored[index];
+    bool hasDistance = grid->directory->hasDistance;
+    MapDataReadChunk(grid->directory, grid->file, grid->filename, stored, ch->tiles, hasDistance ? ch->distance : NULL);
+    ch->index = index;
+    ch->solidCount = grid->directory->chunks[stored].solidCount;
+    ch->modified = false;
+    ch->hasDistance = false;
+    countBlocks(ch);
+    if (hasDistance) {
+        clampDistance(ch);
+    }
+
+    grid->chunks[index] = ch;
+    grid->numResident++;
+    lruPushFirst(grid, ch);
+
+    return ch;
+}
+
+// INTERNAL: the chunk at index, loading it if needed (NULL if entirely GROUND)
+static chunk* getChunk(ChunkGrid grid, int index) {
+    chunk* ch = grid->chunks[index];
+
+    if (ch == NULL) {
+        if (grid->stored == NULL || grid->stored[index] < 0) {
+            return NULL;
+        }
+        return loadChunk(grid, index);
+    }
+
+    if (!ch->modified && ch != grid->lruFirst) {
+        lruRemove(grid, ch);
+        lruPushFirst(grid, ch);
+    }
+
+    return ch;
+}
+
+ChunkGrid ChunkGridCreate(int numRows, int numCols) {
+    assert(numRows > 0);
+    assert(numCols > 0);
+
+    ChunkGrid grid = malloc(sizeof(struct chunkgrid));
+    assert(grid != NULL);
+
+    grid->numRows = numRows;
+    grid->numCols = numCols;
+    grid->chunkRows = (numRows + CHUNK_SIZE - 1) >> CHUNK_SHIFT;
+    grid->chunkCols = (numCols + CHUNK_SIZE - 1) >> CHUNK_SHIFT;
+    grid->chunks = calloc((size_t) grid->chunkRows * grid->chunkCols, sizeof(chunk*));
+    assert(grid->chunks != NULL);
+    grid->stored = NULL;
+    grid->directory = NULL;
+    grid->file = NULL;
+    grid->filename = NULL;
+    grid->numResident = 0;
+    grid->numUnmodified = 0;
+    grid->budget = CHUNKGRID_DEFAULT_BUDGET;
+    grid->lruFirst = NULL;
+    grid->lruLast = NULL;
+
+    return grid;
+}
+
+ChunkGrid ChunkGridCreateFromFile(MapData data, const char* filename) {
+    assert(data != NULL);
+    assert(filename != NULL);
+
+    if (data->chunkSize != CHUNK_SIZE) {
+        fprintf(stderr, "Error opening \"%s\": Chunks of %d cells are not supported (expected %d). Compile it again with mapc.\n", filename, data->chunkSize, CHUNK_SIZE);
+        exit(EXIT_FAILURE);
+    }
+
+    ChunkGrid grid = ChunkGridCreate(data->numRows, data->numCols);
+
+    grid->file = fopen(filename, "rb");
+    if (grid->file == NULL) {
+        perror("Error opening file!");
+        exit(EXIT_FAILURE);
+    }
+    grid->filename = calloc(strlen(filename)+1, sizeof(char));
+    assert(grid->filename != NULL);
+    strcpy(grid->filename, filename);
+
+    // Only what MapDataReadChunk needs (the rest of data is not needed after loading)
+    grid->directory = calloc(1, sizeof(struct mapdata));
+    assert(grid->directory != NULL);
+    grid->directory->numTileDefs = data->numTileDefs;
+    grid->directory->chunkSize = data->chunkSize;
+    grid->directory->hasDistance = data->hasDistance;
+    grid->directory->numChunks = data->numChunks;
+    grid->directory->chunks = malloc(sizeof(mapChunk) * (data->numChunks + 1));
+    assert(grid->directory->chunks != NULL);
+    memcpy(grid->directory->chunks, data->chunks, sizeof(mapChunk) * data->numChunks);
+
+    size_t numChunks = (size_t) grid->chunkRows * grid->chunkCols;
+    grid->stored = malloc(sizeof(int) * numChunks);
+    assert(grid->stored != NULL);
+    for (size_t i = 0; i < numChunks; i++) {
+        grid->stored[i] = -1;
+    }
+    for (int i = 0; i < data->numChunks; i++) {
+        grid->stored[(size_t) data->chunks[i].chunkRow * grid->chunkCols + data->chunks[i].chunkCol] = i;
+    }
+
+    return grid;
+}
+
+void ChunkGridDestroy(ChunkGrid* gridp) {
+    assert(gridp != NULL);
+    assert(*gridp != NULL);
+
+    ChunkGrid grid = *gridp;
+
+    size_t numChunks = (size_t) grid->chunkRows * grid->chunkCols;
+    for (size_t i = 0; i < numChunks; i++) {
+        free(grid->chunks[i]);
+    }
+    free(grid->chunks);
+
+    if (grid->directory != NULL) {
+        // Not a complete MapData, so it is not destroyed with MapDataDestroy
+        free(grid->directory->chunks);
+        free(grid->directory);
+        fclose(grid->file);
+        free(grid->filename);
+        free(grid->stored);
+    }
+
+    free(grid);
+
+    *gridp = NULL;
+}
+
+int ChunkGridGetTile(ChunkGrid grid, int row, int col) {
+    assert(grid != NULL);
+    if (row >= grid->numRows || row < 0 || col >= grid->numCols || col < 0) {
+        return TILE_GROUND;
+    }
+
+    chunk* ch = getChunk(grid, (row >> CHUNK_SHIFT) * grid->chunkCols + (col >> CHUNK_SHIFT));
+    if (ch == NULL) {
+        return TILE_GROUND;
+    }
+
+    return ch->tiles[((row & CHUNK_MASK) << CHUNK_SHIFT) | (col & CHUNK_MASK)];
+}
+
+void ChunkGridSetTile(ChunkGrid grid, int row, int col, int tile) {
+    assert(grid != NULL);
+    assert(row >= 0 && row < grid->numRows);
+    assert(col >= 0 && col < grid->numCols);
+    assert(tile >= 0 && tile <= 0xFFFF);
+
+    int index = (row >> CHUNK_SHIFT) * grid->chunkCols + (col >> CHUNK_SHIFT);
+    chunk* ch = getChunk(grid, index);
+    if (ch == NULL) {
+        if (tile == TILE_GROUND) {
+            return;
+        }
+
+        ch = calloc(1, sizeof(chunk));
+        assert(ch != NULL);
+        ch->index = index;
+        ch->modified = true;
+        grid->chunks[index] = ch;
+        grid->numResident++;
+    }
+
+    unsigned short* cell = &ch->tiles[((row & CHUNK_MASK) << CHUNK_SHIFT) | (col & CHUNK_MASK)];
+    if (*cell == tile) {
+        return;
+    }
+    int change = (tile != TILE_GROUND) - (*cell != TILE_GROUND);
+    int bit = blockBit(row & CHUNK_MASK, col & CHUNK_MASK);
+    ch->solidCount += change;
+    ch->blockCounts[bit] += change;
+    if (ch->blockCounts[bit] > 0) {
+        ch->blocks |= 1ULL << bit;
+    } else {
+        ch->blocks &= ~(1ULL << bit);
+    }
+    if (tile != TILE_GROUND) {
+        ch->solid[row & CHUNK_MASK] |= 1ULL << (col & CHUNK_MASK);
+    } else {
+        ch->solid[row & CHUNK_MASK] &= ~(1ULL << (col & CHUNK_MASK));
+    }
+    *cell = (unsigned short) tile;
+    ch->hasDistance = false;    // Computed again when needed. Other chunks are not affected
+
+    // The file's copy is no longer the chunk's contents
+    if (!ch->modified) {
+        lruRemove(grid, ch);
+        ch->modified = true;
+    }
+    if (grid->stored != NULL) {
+        grid->stored[index] = -1;
+    }
+
+    if (ch->solidCount == 0) {
+        dropChunk(grid, ch);
+    }
+}
+
+bool ChunkGridIsSolid(ChunkGrid grid, int row, int col) {
+    assert(grid != NULL);
+    if (row >= grid->numRows || row < 0 || col >= grid->numCols || col < 0) {
+        return false;
+    }
+
+    chunk* ch = getChunk(grid, (row >> CHUNK_SHIFT) * grid->chunkCols + (col >> CHUNK_SHIFT));
+
+    return ch != NULL && ((ch->solid[row & CHUNK_MASK] >> (col & CHUNK_MASK)) & 1);
+}
+
+bool ChunkGridIsSpanSolid(ChunkGrid grid, int row, int firstCol, int lastCol) {
+    return ChunkGridIsRectSolid(grid, row, firstCol, row, lastCol);
+}
+
+bool ChunkGridIsRectSolid(ChunkGrid grid, int firstRow, int firstCol, int lastRow, int lastCol) {
+    assert(grid != NULL);
+
+    // Only the part inside of the grid
+    if (firstRow < 0) firstRow = 0;
+    if (firstCol < 0) firstCol = 0;
+    if (lastRow >= grid->numRows) lastRow = grid->numRows - 1;
+    if (lastCol >= grid->numCols) lastCol = grid->numCols - 1;
+
+    for (int chunkRow = firstRow >> CHUNK_SHIFT; chunkRow <= lastRow >> CHUNK_SHIFT; chunkRow++) {
+        int rowStart = chunkRow == firstRow >> CHUNK_SHIFT ? firstRow & CHUNK_MASK : 0;
+        int rowEnd = chunkRow == lastRow >> CHUNK_SHIFT ? lastRow & CHUNK_MASK : CHUNK_SIZE - 1;
+
+        for (int chunkCol = firstCol >> CHUNK_SHIFT; chunkCol <= lastCol >> CHUNK_SHIFT; chunkCol++) {
+            chunk* ch = getChunk(grid, chunkRow * grid->chunkCols + chunkCol);
+            if (ch == NULL) {
+                continue;
+            }
+
+            unsigned long long mask = spanMask(chunkCol == firstCol >> CHUNK_SHIFT ? firstCol & CHUNK_MASK : 0,
+                chunkCol == lastCol >> CHUNK_SHIFT ? lastCol & CHUNK_MASK : CHUNK_SIZE - 1);
+            for (int row = rowStart; row <= rowEnd; row++) {
+                if (ch->solid[row] & mask) {
+                    return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+const unsigned short* ChunkGridGetChunk(ChunkGrid grid, int chunkRow, int chunkCol) {
+    assert(grid != NULL);
+    if (chunkRow >= grid->chunkRows || chunkRow < 0 || chunkCol >= grid->chunkCols || chunkCol < 0) {
+        return NULL;
+    }
+
+    chunk* ch = getChunk(grid, chunkRow * grid->chunkCols + chunkCol);
+
+    return ch != NULL ? ch->tiles : NULL;
+}
+
+const unsigned long long* ChunkGridGetChunkSolidity(ChunkGrid grid, int chunkRow, int chunkCol) {
+    assert(grid != NULL);
+    if (chunkRow >= grid->chunkRows || chunkRow < 0 || chunkCol >= grid->chunkCols || chunkCol < 0) {
+        return NULL;
+    }
+
+    chunk* ch = getChunk(grid, chunkRow * grid->chunkCols + chunkCol);
+
+    return ch != NULL ? ch->solid : NULL;
+}
+
+unsigned long long ChunkGridGetChunkBlocks(ChunkGrid grid, int chunkRow, int chunkCol) {
+    assert(grid != NULL);
+    if (chunkRow >= grid->chunkRows || chunkRow < 0 || chunkCol >= grid->chunkCols || chunkCol < 0) {
+        return 0;
+    }
+
+    chunk* ch = getChunk(grid, chunkRow * grid->chunkCols + chunkCol);
+
+    return ch != NULL ? ch->blocks : 0;
+}
+
+const unsigned char* ChunkGridGetChunkDistances(ChunkGrid grid, int chunkRow, int chunkCol) {
+    assert(grid != NULL);
+    if (chunkRow >= grid->chunkRows || chunkRow < 0 || chunkCol >= grid->chunkCols || chunkCol < 0) {
+        return NULL;
+    }
+
+    chunk* ch = getChunk(grid, chunkRow * grid->chunkCols + chunkCol);
+    if (ch == NULL) {
+        return NULL;
+    }
+    if (!ch->hasDistance) {
+        computeDistance(ch);
+    }
+
+    return ch->distance;
+}
+
+void ChunkGridSetBudget(ChunkGrid grid, int maxChunks) {
+    assert(grid != NULL);
+    assert(maxChunks >= 1);
+
+    grid->budget = maxChunks;
+    while (grid->numUnmodified > grid->budget) {
+        chunk* victim = grid->lruLast;
+        lruRemove(grid, victim);
+        dropChunk(grid, victim);
+    }
+}
+
+int ChunkGridGetNumResident(ChunkGrid grid) {
+    assert(grid != NULL);
+    return grid->numResident;
+}
+
+bool ChunkGridIsFileBacked(ChunkGrid grid) {
+    assert(grid != NULL);
+    return grid->file != NULL;
+}
@@ -0,0 +1,86 @@
+#include <stdlib.h>
+#include <assert.h>
+#include <math.h>
+#include "colormap.h"
+#include "raylib.h"
+
+// Brightness of each light level (the darker one used to be a fixed tint of the Y sides)
+static const float lightLevels[COLORMAP_LIGHTS] = {1.0f, 210.0f / 255.0f};
+
+struct colormap {
+    colormapShade shades[COLORMAP_LIGHTS][COLORMAP_LEVELS];
+    Color fogColor;
+    float fogDensity;
+};
+
+Colormap ColormapCreate(Color fogColor, float fogDensity) {
+    assert(fogDensity >= 0);
+
+    Colormap cm = malloc(sizeof(struct colormap));
+    assert(cm != NULL);
+
+    cm->fogColor = fogColor;
+    cm->fogDensity = fogDensity;
+
+    for (int light = 0; light < COLORMAP_LIGHTS; light++) {
+        for (int level = 0; level < COLORMAP_LEVELS; level++) {
+            float fog = (float) level / (COLORMAP_LEVELS - 1);
+            float scale = lightLevels[light] * (1 - fog);
+            colormapShade* shade = &cm->shades[light][level];
+            for (int v = 0; v < 256; v++) {
+                shade->r[v] = (unsigned char) (v * scale + fogColor.r * fog + 0.5f);
+                shade->g[v] = (unsigned char) (v * scale + fogColor.g * fog + 0.5f);
+                shade->b[v] = (unsigned char) (v * scale + fogColor.b * fog + 0.5f);
+            }
+        }
+    }
+
+    return cm;
+}
+
+void ColormapDestroy(Colormap* cmp) {
+    assert(cmp != NULL);
+    assert(*cmp != NULL);
+
+    free(*cmp);
+    *cmp = NULL;
+}
+
+const colormapShade* ColormapGetShade(Colormap cm, double depth, ColormapLight light) {
+    assert(cm != NULL);
+    assert(light >= 0 && light < COLORMAP_LIGHTS);
+
+    int level = 0;
+    if (cm->fogDensity > 0 && depth > 0) {
+        double fog = 1 - exp(-cm->fogDensity * depth);
+        level = (int) (fog * (COLORMAP_LEVELS - 1) + 0.5);
+    }
+
+    if (level == 0 && light == LIGHT_FULL) {
+        return NULL;
+    }
+    return &cm->shades[light][level];
+}
+
+double ColormapGetFogDepth(Colormap cm) {
+    assert(cm != NULL);
+
+    // Where the fog rounds to the last level
+    return cm->fogDensity > 0 ? log(2.0 * (COLORMAP_LEVELS - 1)) / cm->fogDensity : -1;
+}
+
+Color ColormapGetFogColor(Colormap cm) {
+    assert(cm != NULL);
+    return cm->fogColor;
+}
+
+Color ColormapApply(const colormapShade* shade, Color color) {
+    if (shade == NULL) {
+        return color;
+    }
+    return (Color) {shade->r[color.r], shade->g[color.g], shade->b[color.b], color.a};
+}
+
+Color ColormapGetTint(const colormapShade* shade) {
+    return ColormapApply(shade, (Color) {255, 255, 255, 255});
+}
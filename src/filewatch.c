@@ -0,0 +1,151 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "filewatch.h"
+#include "strutil.h"
+#include "raylib.h"
+#include "list.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+// Minimum time between two modification time checks (seconds), when not using inotify
+#define FILEWATCH_POLL_INTERVAL 0.5
+
+typedef struct watchedFile {
+    char* path;
+    char* name;         // File name, without the directory
+    int wd;             // inotify watch descriptor of the file's directory (-1 if not watched with inotify)
+    long modTime;       // Last known modification time
+} watchedFile;
+
+struct filewatch {
+    List files;         // watchedFile*
+    int fd;             // inotify instance (-1 if not available)
+    double lastPoll;    // Time of the last modification time check
+};
+
+FileWatch FileWatchCreate(void) {
+    FileWatch watch = malloc(sizeof(struct filewatch));
+    assert(watch != NULL);
+
+    watch->files = ListCreate(NULL);
+    watch->lastPoll = 0;
+    watch->fd = -1;
+
+#ifdef __linux__
+    watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch->fd < 0) {
+        TraceLog(LOG_WARNING, "FILEWATCH: inotify is not available, checking modification times instead");
+    }
+#endif
+
+    return watch;
+}
+
+void FileWatchDestroy(FileWatch* watchp) {
+    assert(watchp != NULL);
+    assert(*watchp != NULL);
+
+    FileWatch watch = *watchp;
+
+    ListMoveToStart(watch->files);
+    while (ListCanOperate(watch->files)) {
+        watchedFile* file = ListPopFirst(watch->files);
+        free(file->path);
+        free(file->name);
+        free(file);
+    }
+    ListDestroy(&watch->files);
+
+#ifdef __linux__
+    // Closing the instance removes all of its watches
+    if (watch->fd >= 0) {
+        close(watch->fd);
+    }
+#endif
+
+    free(watch);
+
+    *watchp = NULL;
+}
+
+void FileWatchAdd(FileWatch watch, const char* path) {
+    assert(watch != NULL);
+    assert(path != NULL);
+
+    watchedFile* file = malloc(sizeof(watchedFile));
+    assert(file != NULL);
+
+    file->path = StringCopy(path);
+    file->name = StringCopy(GetFileName(path));
+    file->modTime = GetFileModTime(path);
+    file->wd = -1;
+
+#ifdef __linux__
+    if (watch->fd >= 0) {
+        // The directory is watched rather than the file, since editors usually replace files instead of writing them
+        const char* dir = GetDirectoryPath(path);
+        file->wd = inotify_add_watch(watch->fd, dir[0] != '\0' ? dir : ".", IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (file->wd < 0) {
+            TraceLog(LOG_WARNING, "FILEWATCH: [%s] Could not be watched, checking its modification time instead", path);
+        }
+    }
+#endif
+
+    ListAppendLast(watch->files, file);
+}
+
+bool FileWatchPoll(FileWatch watch) {
+    assert(watch != NULL);
+
+    bool changed = false;
+
+#ifdef __linux__
+    if (watch->fd >= 0) {
+        char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+        ssize_t len;
+        while ((len = read(watch->fd, buffer, sizeof(buffer))) > 0) {
+            for (char* ptr = buffer; ptr < buffer + len; ptr += sizeof(struct inotify_event) + ((struct inotify_event*) ptr)->len) {
+                struct inotify_event* event = (struct inotify_event*) ptr;
+                if (event->len == 0) {
+                    continue;
+                }
+
+                ListMoveToStart(watch->files);
+                while (ListCanOperate(watch->files)) {
+                    watchedFile* file = ListGetCurrent(watch->files);
+                    if (file->wd == event->wd && strcmp(file->name, event->name) == 0) {
+                        changed = true;
+                    }
+                    ListMoveToNext(watch->files);
+                }
+            }
+        }
+    }
+#endif
+
+    // Files not watched by inotify
+    if (GetTime() - watch->lastPoll < FILEWATCH_POLL_INTERVAL) {
+        return changed;
+    }
+    watch->lastPoll = GetTime();
+
+    ListMoveToStart(watch->files);
+    while (ListCanOperate(watch->files)) {
+        watchedFile* file = ListGetCurrent(watch->files);
+        if (file->wd < 0) {
+            long modTime = GetFileModTime(file->path);
+            if (modTime != file->modTime) {
+                file->modTime = modTime;
+                changed = true;
+            }
+        }
+        ListMoveToNext(watch->files);
+    }
+
+    return changed;
+}
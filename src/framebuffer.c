@@ -0,0 +1,119 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include "framebuffer.h"
+#include "raylib.h"
+
+struct framebuffer {
+    int width;
+    int height;
+    int stride;
+    void* memory;                   // What pixels was allocated in
+    Color* pixels;                  // Aligned to FRAMEBUFFER_ALIGN
+    Color* packed;                  // The pixels without the padding of the rows, to upload them (NULL if they have none)
+    Texture texture;
+};
+
+// INTERNAL: makes the pixels and texture of the current size
+static void allocate(FrameBuffer fb) {
+    int alignPixels = FRAMEBUFFER_ALIGN / sizeof(Color);
+    fb->stride = (fb->width + alignPixels - 1) / alignPixels * alignPixels;
+
+    // No aligned_alloc on every platform, so the pixels start at the first aligned address of a larger allocation
+    fb->memory = calloc((size_t) fb->stride * fb->height * sizeof(Color) + FRAMEBUFFER_ALIGN - 1, 1);
+    assert(fb->memory != NULL);
+    fb->pixels = (Color*) (((uintptr_t) fb->memory + FRAMEBUFFER_ALIGN - 1) & ~(uintptr_t) (FRAMEBUFFER_ALIGN - 1));
+
+    fb->packed = NULL;
+    if (fb->stride != fb->width) {
+        fb->packed = calloc((size_t) fb->width * fb->height, sizeof(Color));
+        assert(fb->packed != NULL);
+    }
+
+    fb->texture = LoadTextureFromImage((Image) {fb->packed != NULL ? fb->packed : fb->pixels, fb->width, fb->height, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8});
+}
+
+FrameBuffer FrameBufferCreate(int width, int height) {
+    assert(width > 0);
+    assert(height > 0);
+
+    FrameBuffer fb = malloc(sizeof(struct framebuffer));
+    assert(fb != NULL);
+
+    fb->width = width;
+    fb->height = height;
+    allocate(fb);
+
+    return fb;
+}
+
+void FrameBufferDestroy(FrameBuffer* fbp) {
+    assert(fbp != NULL);
+    assert(*fbp != NULL);
+
+    FrameBuffer fb = *fbp;
+
+    UnloadTexture(fb->texture);
+    free(fb->packed);
+    free(fb->memory);
+    free(fb);
+
+    *fbp = NULL;
+}
+
+void FrameBufferResize(FrameBuffer fb, int width, int height) {
+    assert(fb != NULL);
+    assert(width > 0);
+    assert(height > 0);
+
+    if (width == fb->width && height == fb->height) {
+        return;
+    }
+
+    UnloadTexture(fb->texture);
+    free(fb->packed);
+    free(fb->memory);
+    fb->width = width;
+    fb->height = height;
+    allocate(fb);
+}
+
+int FrameBufferGetWidth(FrameBuffer fb) {
+    assert(fb != NULL);
+    return fb->width;
+}
+
+int FrameBufferGetHeight(FrameBuffer fb) {
+    assert(fb != NULL);
+    return fb->height;
+}
+
+int FrameBufferGetStride(FrameBuffer fb) {
+    assert(fb != NULL);
+    return fb->stride;
+}
+
+Color* FrameBufferGetPixels(FrameBuffer fb) {
+    assert(fb != NULL);
+    return fb->pixels;
+}
+
+void FrameBufferUpload(FrameBuffer fb) {
+    assert(fb != NULL);
+
+    if (fb->packed == NULL) {
+        UpdateTexture(fb->texture, fb->pixels);
+        return;
+    }
+
+    for (int y = 0; y < fb->height; y++) {
+        memcpy(fb->packed + (size_t) y * fb->width, fb->pixels + (size_t) y * fb->stride, sizeof(Color) * fb->width);
+    }
+    UpdateTexture(fb->texture, fb->packed);
+}
+
+Texture FrameBufferGetTexture(FrameBuffer fb) {
+    assert(fb != NULL);
+    return fb->texture;
+}
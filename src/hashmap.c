@@ -169,12 +169,12 @@ bool HashMapRemove(CHashMap map, void* key) {
         
         if (map->compFunc != NULL) {
             if (map->compFunc(element->key, key)) {
-                ListPop(list, i);
+                free(ListPop(list, i));
                 return true;
             }
         } else {
             if (element->key == key) {
-                ListPop(list, i);
+                free(ListPop(list, i));
                 return true;
             }
         }
@@ -201,12 +201,16 @@ void* HashMapPop(CHashMap map, void* key) {
         
         if (map->compFunc != NULL) {
             if (map->compFunc(element->key, key)) {
-                void* val = ListPop(list, i);
+                HashMapElement popped = ListPop(list, i);
+                void* val = popped->value;
+                free(popped);
                 return val;
             }
         } else {
             if (element->key == key) {
-                void* val = ListPop(list, i);
+                HashMapElement popped = ListPop(list, i);
+                void* val = popped->value;
+                free(popped);
                 return val;
             }
         }
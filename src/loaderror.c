@@ -0,0 +1,41 @@
+#include <stdlib.h>
+#include <assert.h>
+#include "loaderror.h"
+
+static jmp_buf* currentHandler = NULL;
+static FILE* files[LOADERROR_MAX_FILES];
+static int numFiles = 0;
+
+jmp_buf* LoadErrorSetHandler(jmp_buf* handler) {
+    jmp_buf* previous = currentHandler;
+    currentHandler = handler;
+
+    return previous;
+}
+
+_Noreturn void LoadErrorFail(void) {
+    if (currentHandler == NULL) {
+        exit(EXIT_FAILURE);
+    }
+
+    while (numFiles > 0) {
+        fclose(files[--numFiles]);
+    }
+    longjmp(*currentHandler, 1);
+}
+
+void LoadErrorAddFile(FILE* file) {
+    assert(file != NULL);
+    assert(numFiles < LOADERROR_MAX_FILES);
+
+    files[numFiles++] = file;
+}
+
+void LoadErrorRemoveFile(FILE* file) {
+    for (int i = 0; i < numFiles; i++) {
+        if (files[i] == file) {
+            files[i] = files[--numFiles];
+            return;
+        }
+    }
+}
@@ -8,35 +8,149 @@
 #include "list.h"
 #include <string.h>
 #include "mapparser.h"
+#include "mapcache.h"
+#include "filewatch.h"
+#include "texturecache.h"
+#include "mapray.h"
+#include "framebuffer.h"
+#include "workerpool.h"
+#include "renderqueue.h"
 
 #include "resource_dir.h"	// utility header for SearchAndSetResourceDir
 
-#define USAGE_MESSAGE "Usage: raycaster [-h] mapname\n"
-#define DESCRIPTION_MESSAGE "Runs the raycaster, loading the specified map file.\n"
+#define USAGE_MESSAGE "Usage: raycaster [-h] [-n] [-w] [-a] [-r WIDTHxHEIGHT] [-d] mapname\n"
+#define DESCRIPTION_MESSAGE "Runs the raycaster, loading the specified map file.\n" \
+    "  -n   do not use the map parse cache\n" \
+    "  -w   do not reload the map when it or its textures change\n" \
+    "  -a   draw every frame, even when nothing changed since the last one\n" \
+    "  -r   internal resolution, independent of the window size (default: 1280x720)\n" \
+    "  -d   scale the internal resolution to keep the frame rate\n"
 
-float min(float v1, float v2) {
+// Time to wait after a watched file changes before reloading (seconds), so that a file being written is only read once
+#define RELOAD_DELAY 0.2
+
+#define TARGET_FPS 60
+
+// The internal resolution is the one set with -r times a scale, changed with the keys or by dynamic resolution,
+// and limited to these widths (the 3D view has a column per pixel)
+#define MIN_RENDER_WIDTH 160
+#define MAX_RENDER_WIDTH 3840
+#define RENDER_SCALE_STEP 1.25f
+
+// Dynamic resolution: every RESOLUTION_INTERVAL seconds, the scale goes down if frames were late or their work
+// (updating and drawing the scene) took more than RESOLUTION_HIGH of the frame time budget, and up if it took
+// less than RESOLUTION_LOW of it
+#define RESOLUTION_INTERVAL 0.5
+#define RESOLUTION_HIGH 0.8
+#define RESOLUTION_LOW 0.4
+
+// Zoom of the 2D view, changed by the mouse wheel in steps of VIEW_ZOOM_STEP
+#define MIN_VIEW_ZOOM 0.0625f
+#define MAX_VIEW_ZOOM 16.0f
+#define VIEW_ZOOM_STEP 1.25f
+
+typedef struct resolution {
+    int baseWidth;              // Set with -r
+    int baseHeight;             //
+    float scale;
+    bool dynamic;
+    double workTime;            // Measured since the last adjustment (seconds)
+    double frameTime;           //
+    int frames;                 //
+} resolution;
+
+static float min(float v1, float v2) {
     return v1 < v2 ? v1 : v2;
 }
 
-int main(int argc, char* argv[]) {
-    // Argument handling
-    if (argc <= 1) {
-        fprintf(stderr, USAGE_MESSAGE);
-        fprintf(stderr, "Must specify a map file to load!\n");
+// Returns the size of the render texture for a resolution
+static void renderSize(resolution* res, int* width, int* height) {
+    float scale = res->scale;
+    if (res->baseWidth*scale < MIN_RENDER_WIDTH) scale = (float) MIN_RENDER_WIDTH / (float) res->baseWidth;
+    if (res->baseWidth*scale > MAX_RENDER_WIDTH) scale = (float) MAX_RENDER_WIDTH / (float) res->baseWidth;
+    res->scale = scale;
 
-        return EXIT_FAILURE;
+    *width = (int) (res->baseWidth*scale + 0.5f);
+    *height = (int) (res->baseHeight*scale + 0.5f);
+    if (*height < 1) *height = 1;
+}
+
+// Measures a frame for dynamic resolution, changing the scale every RESOLUTION_INTERVAL seconds if needed
+static void adjustResolution(resolution* res, double work, double frame) {
+    res->workTime += work;
+    res->frameTime += frame;
+    res->frames++;
+    if (res->frameTime < RESOLUTION_INTERVAL) {
+        return;
     }
-    
-    const char* map_name;
+
+    double budget = 1.0 / TARGET_FPS;
+    double averageWork = res->workTime / res->frames;
+    double averageFrame = res->frameTime / res->frames;
+    if (averageFrame > budget*1.1 || averageWork > budget*RESOLUTION_HIGH) {
+        res->scale /= RENDER_SCALE_STEP;
+    } else if (averageWork < budget*RESOLUTION_LOW) {
+        res->scale *= RENDER_SCALE_STEP;
+    }
+
+    res->workTime = 0;
+    res->frameTime = 0;
+    res->frames = 0;
+}
+
+// Creates a FileWatch for the map file and the textures it uses
+static FileWatch watchMap(Map map, const char* map_name) {
+    FileWatch watch = FileWatchCreate();
+    FileWatchAdd(watch, map_name);
+
+    const char* dir = GetDirectoryPath(map_name);
+    List textures = MapGetTextureFiles(map);
+    ListMoveToStart(textures);
+    while (ListCanOperate(textures)) {
+        const char* texture = ListGetCurrent(textures);
+        FileWatchAdd(watch, dir[0] != '\0' ? TextFormat("%s/%s", dir, texture) : texture);
+        ListMoveToNext(textures);
+    }
+    ListDestroy(&textures);
+
+    return watch;
+}
+
+int main(int argc, char* argv[]) {
+    // Argument handling
+    const char* map_name = NULL;
+    bool watching = true;
+    bool reuse_frames = true;
+    resolution res = {.baseWidth = 1280, .baseHeight = 720, .scale = 1, .dynamic = false};
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-h") == 0) {
             printf(USAGE_MESSAGE);
             printf(DESCRIPTION_MESSAGE);
             return EXIT_SUCCESS;
+        } else if (strcmp(argv[i], "-n") == 0) {
+            MapCacheSetEnabled(false);
+        } else if (strcmp(argv[i], "-w") == 0) {
+            watching = false;
+        } else if (strcmp(argv[i], "-a") == 0) {
+            reuse_frames = false;
+        } else if (strcmp(argv[i], "-r") == 0 && i+1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &res.baseWidth, &res.baseHeight) != 2 || res.baseWidth <= 0 || res.baseHeight <= 0) {
+                fprintf(stderr, USAGE_MESSAGE);
+                fprintf(stderr, "Invalid resolution \"%s\"!\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "-d") == 0) {
+            res.dynamic = true;
         } else {
             map_name = argv[i];
         }
     }
+    if (map_name == NULL) {
+        fprintf(stderr, USAGE_MESSAGE);
+        fprintf(stderr, "Must specify a map file to load!\n");
+
+        return EXIT_FAILURE;
+    }
 
     // Tell the window to use vsync and work on high DPI displays
     SetConfigFlags(FLAG_VSYNC_HINT | FLAG_WINDOW_HIGHDPI);
@@ -46,34 +160,96 @@ int main(int argc, char* argv[]) {
     bool window_focused = false;
 
     bool drawing3D = false;
+    float view_zoom = 1;    // Of the 2D view, which follows the player
     
     // Create the window and OpenGL context
     InitWindow(window_size_x, window_size_y, "Raycaster");
-    SetTargetFPS(60);
+    SetTargetFPS(TARGET_FPS);
 
-    RenderTexture2D render_texture = LoadRenderTexture(window_size_x, window_size_y);
+    int render_width, render_height;
+    renderSize(&res, &render_width, &render_height);
+    RenderTexture2D render_texture = LoadRenderTexture(render_width, render_height);
+    FrameBuffer frame = FrameBufferCreate(render_width, render_height);    // Floor and ceiling cast on the CPU, and the software backend's frame
+    RenderQueue queue = RenderQueueCreate();
+    RenderBackend backend = RENDER_BACKEND_RAYLIB;
+    WorkerPool workers = WorkerPoolCreate(0);
+    bool frame_valid = false;           // Whether render_texture still shows the scene as it is
+    unsigned int frame_textures = 0;    // TextureCacheGetVersion when it was drawn
     
     // MAP VARS
+    TextureCacheSetKeepImages(true);    // Flats and the software backend sample the textures' CPU copies
     Map map = MapCreateFromFile(map_name);
+    FileWatch watch = watching ? watchMap(map, map_name) : NULL;
+    double reload_time = -1;    // When to reload the map because of a file change (-1 if not needed)
     
     // PLAYER VARS
-    Player player = PlayerCreate(10, 10, 45, 1280, map);
+    Player player = PlayerCreate(10, 10, 45, render_width, map);
     
     // game loop
     SetExitKey(KEY_Q);
     while (!WindowShouldClose()) {		// run the loop until the user presses ESCAPE or presses the Close button on the window
 
+        // Textures decoded since the last frame replace their placeholders
+        TextureCacheUpdate();
+
         // How much the screen is scaled from the starting size
         float scale = min((float)GetScreenWidth()/(float)window_size_x, (float)GetScreenHeight()/(float)window_size_y);
 
         // Player control
         if (IsKeyPressed(KEY_G)) {
             drawing3D = !drawing3D;
+            frame_valid = false;
         }
-        if (IsKeyPressed(KEY_R)) { // Reload map
-            MapDestroy(&map);
-            map = MapCreateFromFile(map_name);
-            PlayerSetMap(player, map);
+        if (IsKeyPressed(KEY_T)) {
+            MapRaySetTraversal((MapRayGetTraversal() + 1) % (TRAVERSAL_FIXED + 1));
+            frame_valid = false;
+        }
+        if (IsKeyPressed(KEY_B)) { // Backend drawing the 3D view
+            backend = (backend + 1) % (RENDER_BACKEND_NULL + 1);
+            frame_valid = false;
+        }
+        if (IsKeyPressed(KEY_MINUS)) { // Internal resolution
+            res.scale /= RENDER_SCALE_STEP;
+            res.dynamic = false;
+        }
+        if (IsKeyPressed(KEY_EQUAL)) {
+            res.scale *= RENDER_SCALE_STEP;
+            res.dynamic = false;
+        }
+        if (IsKeyPressed(KEY_ZERO)) {
+            res.dynamic = !res.dynamic;
+        }
+        if (!drawing3D && GetMouseWheelMove() != 0) { // Zoom of the 2D view
+            view_zoom = Clamp(view_zoom * powf(VIEW_ZOOM_STEP, GetMouseWheelMove()), MIN_VIEW_ZOOM, MAX_VIEW_ZOOM);
+            frame_valid = false;
+        }
+        if (IsKeyPressed(KEY_V)) { // Rays in the 2D view: lines or fan
+            PlayerSetRayView(player, PlayerGetRayView(player) == RAY_VIEW_LINES ? RAY_VIEW_FAN : RAY_VIEW_LINES);
+            frame_valid = false;
+        }
+        if (IsKeyPressed(KEY_N)) { // Drawing every Nth ray in the 2D view: 1, 2, 4, ..., 64
+            PlayerSetRayDrawStep(player, PlayerGetRayDrawStep(player) < 64 ? PlayerGetRayDrawStep(player) * 2 : 1);
+            frame_valid = false;
+        }
+        if (IsKeyPressed(KEY_C)) { // Cast step: 1, 2, 4, 8, 16
+            PlayerSetCastStep(player, PlayerGetCastStep(player) < 16 ? PlayerGetCastStep(player) * 2 : 1);
+            frame_valid = false;
+        }
+        if (watch != NULL && FileWatchPoll(watch)) {
+            reload_time = GetTime() + RELOAD_DELAY;
+        }
+        if (IsKeyPressed(KEY_R) || (reload_time >= 0 && GetTime() >= reload_time)) { // Reload map
+            bool reloaded = MapReload(map, map_name);
+            reload_time = -1;
+
+            // The textures used may have changed: the ones no longer used are unloaded, and the new ones watched
+            if (reloaded) {
+                TextureCacheTrim();
+            }
+            if (reloaded && watch != NULL) {
+                FileWatchDestroy(&watch);
+                watch = watchMap(map, map_name);
+            }
         }
         if (IsKeyPressed(KEY_ESCAPE)) { // Unfocus window
             window_focused = false;
@@ -93,25 +269,73 @@ int main(int argc, char* argv[]) {
             ShowCursor();
         }
 
+        // A new internal resolution takes a new render texture and a ray per column
+        renderSize(&res, &render_width, &render_height);
+        if (render_width != render_texture.texture.width || render_height != render_texture.texture.height) {
+            UnloadRenderTexture(render_texture);
+            render_texture = LoadRenderTexture(render_width, render_height);
+            FrameBufferResize(frame, render_width, render_height);
+            PlayerSetNumRays(player, render_width);
+            frame_valid = false;
+        }
+
+        double work_start = GetTime();
         PlayerInput(player);
-        
-        BeginTextureMode(render_texture);
-            // Setup the back buffer for drawing (clear color and depth buffers)
-            ClearBackground(BLACK);
 
-            if (drawing3D) {
-                MapDraw3D(map, window_size_x, window_size_y);
+        // The scene is only drawn again if the player's view, the map or a texture changed
+        if (!reuse_frames || PlayerViewChanged(player) || TextureCacheGetVersion() != frame_textures) {
+            frame_valid = false;
+        }
 
-                PlayerDraw3D(player, window_size_x, window_size_y);
-            } else {
-                MapDraw2D(map);
-                
-                PlayerDraw2D(player);
-            }
+        if (!frame_valid) {
+            BeginTextureMode(render_texture);
+                // Setup the back buffer for drawing (clear color and depth buffers)
+                ClearBackground(BLACK);
 
-            DrawFPS(0, 0);
+                if (drawing3D) {
+                    RenderQueueClear(queue);
+                    if (!MapHasFlats(map)) {
+                        MapDraw3D(map, queue, render_width, render_height);
+                    }
+                    PlayerDraw3D(player, queue, render_width, render_height);
+
+                    // The flats are drawn first, then the queue over them
+                    if (MapHasFlats(map)) {
+                        PlayerDrawFlats(player, frame, workers);
+                    }
+                    if (backend == RENDER_BACKEND_SOFTWARE) {
+                        RenderQueueDraw(queue, backend, frame, workers);
+                    }
+                    if (MapHasFlats(map) || backend == RENDER_BACKEND_SOFTWARE) {
+                        FrameBufferUpload(frame);
+                        DrawTexture(FrameBufferGetTexture(frame), 0, 0, WHITE);
+                    }
+                    if (backend != RENDER_BACKEND_SOFTWARE) {
+                        RenderQueueDraw(queue, backend, NULL, NULL);
+                    }
+                } else {
+                    // Centered on the player, showing the same area at any resolution
+                    BeginMode2D((Camera2D) {
+                        .offset = {render_width / 2.0f, render_height / 2.0f},
+                        .target = {(float) PlayerGetX(player), (float) PlayerGetY(player)},
+                        .zoom = view_zoom * (float) render_width / (float) window_size_x,
+                    });
+                        MapDraw2D(map);
+
+                        PlayerDraw2D(player);
+                    EndMode2D();
+                }
+
+            EndTextureMode();
 
-        EndTextureMode();
+            frame_valid = true;
+            frame_textures = TextureCacheGetVersion();
+
+            // Kept frames say nothing about how long drawing takes
+            if (res.dynamic) {
+                adjustResolution(&res, GetTime() - work_start, GetFrameTime());
+            }
+        }
 
         // Then draw the texture on screen.
         BeginDrawing();
@@ -124,6 +348,28 @@ int main(int argc, char* argv[]) {
                 (Rectangle) { ((float)GetScreenWidth() - ((float)window_size_x*scale))*0.5f, ((float)GetScreenHeight() - ((float)window_size_y*scale))*0.5f, // Draw at the center of the screen
                 (float)window_size_x*scale, (float)window_size_y*scale }, (Vector2){ 0, 0 }, 0.0f, WHITE);
 
+            // Drawn over the scene, which can be kept from the last frames
+            DrawFPS(0, 0);
+            DrawText(MapRayGetTraversalName(MapRayGetTraversal()), 0, 20, 20, LIME);
+            DrawText(TextFormat("step %d: %d casts", PlayerGetCastStep(player), PlayerGetNumCasts(player)), 0, 40, 20, LIME);
+            DrawText(TextFormat("%dx%d%s", render_width, render_height, res.dynamic ? " (dynamic)" : ""), 0, 60, 20, LIME);
+            if (backend == RENDER_BACKEND_SOFTWARE) {
+                // Timings of the bands of the last frame drawn
+                int numBands = RenderQueueGetNumBands(queue);
+                double slowest = 0;
+                double total = 0;
+                for (int i = 0; i < numBands; i++) {
+                    double time = RenderQueueGetBandTime(queue, i);
+                    slowest = time > slowest ? time : slowest;
+                    total += time;
+                }
+                DrawText(TextFormat("software: %d commands, %d bands (%.2f ms mean, %.2f ms slowest)", RenderQueueGetNumCommands(queue),
+                    numBands, numBands > 0 ? total * 1000 / numBands : 0, slowest * 1000), 0, 80, 20, LIME);
+            } else {
+                DrawText(TextFormat("%s: %d commands, %d batches", RenderQueueGetBackendName(backend), RenderQueueGetNumCommands(queue),
+                    backend == RENDER_BACKEND_RAYLIB ? RenderQueueGetNumBatches(queue) : 0), 0, 80, 20, LIME);
+            }
+
 
         // End the frame and get ready for the next one  (display frame, poll input, etc...)
         EndDrawing();
@@ -131,9 +377,16 @@ int main(int argc, char* argv[]) {
 
     // Cleanup
     // Unload the render texture and objects.
+    if (watch != NULL) {
+        FileWatchDestroy(&watch);
+    }
     MapDestroy(&map);
     PlayerDestroy(&player);
+    TextureCacheUnloadAll();
     UnloadRenderTexture(render_texture);
+    FrameBufferDestroy(&frame);
+    RenderQueueDestroy(&queue);
+    WorkerPoolDestroy(&workers);
 
     // Destroy the window and cleanup the OpenGL context
     CloseWindow();
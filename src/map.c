@@ -2,7 +2,9 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <math.h>
 #include "map.h"
+#include "strutil.h"
 #include "raylib.h"
 #include "hashmap.h"
 #include <stdbool.h>
@@ -10,38 +12,96 @@
 #include "list.h"
 #include "mapparser.h"
 #include "billboard.h"
-#include <errno.h>
+#include "mapdata.h"
+#include "mapcache.h"
+#include "loaderror.h"
+#include "texturecache.h"
+#include "chunkgrid.h"
+#include "framebuffer.h"
+#include "workerpool.h"
+#include "renderqueue.h"
+#include "colormap.h"
+#include "rlgl.h"
 
 #include "resource_dir.h"	// utility header for SearchAndSetResourceDir
 
+typedef struct tileSource {
+    char* path;                     // Texture file of the tile (NULL for colored tiles)
+    unsigned long long stamp;       // Modification time of the texture file (hash of its contents when packed)
+    Color color;                    // Color of the tile, when colored
+    bool isTransparent;
+} tileSource;
+
+// A chunk of the cached 2D view of the tiles (see MapDraw2D)
+typedef struct layerChunk {
+    Texture2D texture;              // A texel per cell (id 0 if not created, or the chunk is entirely GROUND)
+    bool dirty;                     // Whether its tiles changed since the texture was made
+} layerChunk;
+
+// Floors and ceilings (flats). Their grids keep a flat ID per cell: 0 for the default one, or 1 plus the index of
+// the FlatDefinition.
+#define FLAT_FLOOR 0
+#define FLAT_CEILING 1
+
+// A floor or ceiling type, as defined in FlatDefinition
+typedef struct flatType {
+    TextureHandle texture;          // NULL for colored flats
+    char* path;                     // Texture file (NULL for colored flats)
+    Color color;                    // Color of colored flats
+} flatType;
+
+// Fraction bits of the fixed-point cell coordinates stepped along the rows by the floor caster. They are relative to
+// the viewer's cell and biased by FLAT_BIAS cells, so that they are positive (and truncating them rounds down) and
+// small enough for floats to keep their precision. Rows that see cells further away are clamped pixel by pixel.
+#define FLAT_FRAC_BITS 12
+#define FLAT_FRAC_MASK ((1 << FLAT_FRAC_BITS) - 1)
+#define FLAT_BIAS 2048
+#define FLAT_MAX_COORD (2 * FLAT_BIAS)
+
+// Pixels whose coordinates are stepped together: a whole number of SIMD vectors, so that compilers that only vectorize
+// loops with a known trip count (like GCC at -O2) vectorize them
+#define FLAT_BLOCK 8
+
+// Rows of floor (and as many of ceiling) drawn by each job of the floor caster
+#define FLAT_BAND_ROWS 16
+
+typedef struct billboardType {
+    TextureHandle texture;
+    char* path;                     // Texture file
+    unsigned long long stamp;       // Same as in tileSource
+} billboardType;
+
 struct map {
     int numRows;
     int numCols;
     int tileSize;                       // Size of each tile (pixels)
     HashMap tileMap;                    // HashMap that contains the details (texture) for a tile, given its name
     List tileNames;                   // Array associating tile indices (MapTiles) to the tile names (char*)             TODO: change to ArrayList
-    HashMap billboardMap;           // HashMap that contains the details (texture) for a billboard, given its name
+    tileSource* tileSources;            // Where each tile (indexed by MapTiles) came from, to know what changed on a reload
+    int numTileSources;
+    HashMap billboardMap;           // HashMap that contains the details (billboardType*) for a billboard, given its name
     List billboards;                // List of all billboards (enemies, etc.)
+    HashMap billboardBuckets;       // HashMap that associates a cell index (int*) to the List of billboards in that cell
     Color  groundColor;     // TEMPORARY
     Color  ceilingColor;    // TEMPORARY
-    int** grid;                    // The grid of tiles that represents this map
+    Colormap colormap;              // Shades of the map's fog
+    ChunkGrid grid;                // The grid of tiles that represents this map
+    layerChunk* layer;              // Cached 2D view of each chunk of the grid (NULL until drawn in 2D)
+    flatType* flats;                // Flat types, by flat ID (ID 0 is unused, see defaultFlats)
+    int numFlats;                   //
+    int defaultFlats[2];            // Flat ID of the cells with none placed, for FLAT_FLOOR and FLAT_CEILING (0 for the colors)
+    ChunkGrid flatGrids[2];         // Flat IDs of each cell, for FLAT_FLOOR and FLAT_CEILING (NULL if none are placed)
+    unsigned int version;           // See MapGetVersion
+    unsigned int billboardVersion;  // See MapGetBillboardVersion
 };
 
-// djb2 hash
-static unsigned int djb2hash(void* key) {
-    char* str = (char*) key;
-
-    int hash = 5381;
-    int c;
-
-    while (c = *str++)
-       hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
-
-    return hash;
+static unsigned int cellhash(void* key) {
+    long long cell = *(long long*) key;
+    return (unsigned int) (cell ^ (cell >> 32));
 }
 
-static bool hashmapstrcmp(void* key1, void* key2) {
-    return strcmp((char*) key1, (char*) key2) == 0;
+static bool hashmapcellcmp(void* key1, void* key2) {
+    return *(long long*) key1 == *(long long*) key2;
 }
 
 // INTERNAL: registers a new tile type in a map. Returns false on error (if tile with that name already exists)
@@ -61,46 +121,6 @@ static bool registerTile(Map map, Tile tile, int* tileID) {
     return true;
 }
 
-static Color parseColor(ParserElement element, const char* filename) {
-    if (element == NULL) { // Give default value
-        errno = -1;
-        return (Color) {0, 0, 0, 255};
-    } else if (ParserElementGetType(element) != LIST_TYPE) {  // Wrong because it was defined but with wrong type
-        fprintf(stderr, "Error opening \"%s\": %s must be an array of RGB(A) values (0-255 integers).\n", filename, ParserElementGetKey(element));
-        errno = -1;
-        return (Color) {0, 0, 0, 255};
-    }
-    
-    List val = (List) ParserElementGetValue(element);
-    if (ListGetSize(val) != 3 && ListGetSize(val) != 4) {   // Wrong because of color definition
-        fprintf(stderr, "Error opening \"%s\": %s must be an array of RGB(A) values (0-255 integers).\n", filename, ParserElementGetKey(element));
-        errno = -1;
-        return (Color) {0, 0, 0, 255};
-    }
-
-    // Type checking
-    ListMoveToStart(val);
-    while (ListCanOperate(val)) {
-        ParserElement elem = (ParserElement) ListGetCurrent(val);
-
-        if (ParserElementGetType(elem) != INT_TYPE || (*(int*) ParserElementGetValue(elem)) < 0 || (*(int*) ParserElementGetValue(elem)) > 255) {
-            fprintf(stderr, "Error opening \"%s\": %s must be an array of RGB(A) values (0-255 integers).\n", filename, ParserElementGetKey(element));
-            errno = -1;
-            return (Color) {0, 0, 0, 255};
-        }
-        ListMoveToNext(val);
-    }
-    
-    int r = *(int*) ParserElementGetValue(ListGet(val, 0));
-    int g = *(int*) ParserElementGetValue(ListGet(val, 1));
-    int b = *(int*) ParserElementGetValue(ListGet(val, 2));
-    int a = 255;
-    if (ListGetSize(val) == 4) {
-        a = *(int*) ParserElementGetValue(ListGet(val, 3));
-    }
-    return (Color) {(unsigned char) r, (unsigned char) g, (unsigned char) b, (unsigned char) a};
-}
-
 // DO NOT USE NOW
 // TODO: alterar para receber um HashMap de cenas para preencher o tileNames e tileMap
 Map MapCreate(int numRows, int numCols, int tileSize) {
@@ -110,329 +130,630 @@ Map MapCreate(int numRows, int numCols, int tileSize) {
     assert(numCols > 0);
 
     // Initialize grid
-    map->grid = malloc(sizeof(int*)*numRows);
-    assert(map->grid != NULL);
-    for (int i = 0; i < numRows; i++) {
-        map->grid[i] = calloc(numCols, sizeof(int));
-        assert(map->grid[i] != NULL);
-    }
+    map->grid = ChunkGridCreate(numRows, numCols);
+    map->layer = NULL;
+    map->flats = NULL;
+    map->numFlats = 0;
+    map->defaultFlats[FLAT_FLOOR] = map->defaultFlats[FLAT_CEILING] = 0;
+    map->flatGrids[FLAT_FLOOR] = map->flatGrids[FLAT_CEILING] = NULL;
 
     map->numCols = numCols;
     map->numRows = numRows;
     map->tileSize = tileSize;
+    map->version = 0;
+    map->billboardVersion = 0;
 
     map->tileNames = ListCreate(NULL);
     char* ground = calloc(7, sizeof(char)); assert(ground != NULL); ground = strncpy(ground, "GROUND", 6); ListAppendLast(map->tileNames, ground);
 
-    map->tileMap = HashMapCreate(5, djb2hash, hashmapstrcmp);
+    map->tileMap = HashMapCreate(5, StringHash, StringEquals);
     HashMapPut(map->tileMap, ground, TileCreateTextured(ground, TILE_GROUND, "resources/default.png", false));
 
+    map->numTileSources = 1;
+    map->tileSources = calloc(1, sizeof(tileSource));
+    assert(map->tileSources != NULL);
+
+    map->billboardMap = HashMapCreate(5, StringHash, StringEquals);
+    map->billboards = ListCreate(NULL);
+    map->billboardBuckets = HashMapCreate(5, cellhash, hashmapcellcmp);
+
     // TEMPORARY
     map->ceilingColor = (Color) {255, 255, 255, 255};
     map->groundColor = (Color) {128, 100, 20, 255};
-
+    map->colormap = ColormapCreate((Color) {0, 0, 0, 255}, 0);
 
     return map;
 }
 
 
-Map MapCreateFromFile(const char* filename) {
-    Map map = malloc(sizeof(struct map));
-    assert(map != NULL);
+// INTERNAL: loads one of the textures referenced by the map data, through the texture cache (the working directory must be the map's)
+static TextureHandle loadMapTexture(MapData data, int texture) {
+    mapTexture tex = data->textures[texture];
 
-    int tileID = 1;     // ID of next tile to be defined
-    
-    map->tileNames = ListCreate(NULL);
-    char* ground = calloc(7, sizeof(char)); assert(ground != NULL); ground = strncpy(ground, "GROUND", 6); ListAppendLast(map->tileNames, ground);
+    if (tex.packed != NULL) {
+        return TextureCacheLoadFromMemory(GetFileExtension(tex.path), tex.packed, tex.packedSize);
+    }
 
-    // Default tileMap values
-    map->tileMap = HashMapCreate(5, djb2hash, hashmapstrcmp);
-    HashMapPut(map->tileMap, ground, TileCreateTextured(ground, TILE_GROUND, "resources/default.png", false));
+    return TextureCacheLoad(tex.path);
+}
 
-    MapParser parser = MapParserCreate(filename);
-    ParserResult res = MapParserParse(parser);
-    
-    ParserTable mapSettings = ParserResultGetTable(res, "MapSettings");
-    ParserTable tileDefinition = ParserResultGetTable(res, "TileDefinition");
-    ParserTable tilePlacing = ParserResultGetTable(res, "TilePlacing");
-    ParserTable billboardDefinition = ParserResultGetTable(res, "BillboardDefinition");
-    ParserTable billboardPlacing = ParserResultGetTable(res, "BillboardPlacing");
-    if (mapSettings == NULL) {
-        fprintf(stderr, "Error opening \"%s\": No table named \"MapSettings\".\n", filename);
-        exit(EXIT_FAILURE);
-    }
-    if (tileDefinition == NULL) {
-        fprintf(stderr, "Error opening \"%s\": No table named \"TileDefinition\".\n", filename);
-        exit(EXIT_FAILURE);
-    }
-    if (tilePlacing == NULL) {
-        fprintf(stderr, "Error opening \"%s\": No table named \"TilePlacing\".\n", filename);
-        exit(EXIT_FAILURE);
+// INTERNAL: identifies the version of a texture: modification time of its file, or hash of its contents when packed
+// (the working directory must be the map's)
+static unsigned long long textureStamp(MapData data, int texture) {
+    mapTexture tex = data->textures[texture];
+
+    if (tex.packed == NULL) {
+        return (unsigned long long) GetFileModTime(tex.path);
     }
-    if (billboardDefinition == NULL) {
-        fprintf(stderr, "Error opening \"%s\": No table named \"BillboardDefinition\".\n", filename);
-        exit(EXIT_FAILURE);
+
+    unsigned long long hash = 14695981039346656037ULL;  // FNV-1a
+    for (int i = 0; i < tex.packedSize; i++) {
+        hash ^= tex.packed[i];
+        hash *= 1099511628211ULL;
     }
-    if (billboardPlacing == NULL) {
-        fprintf(stderr, "Error opening \"%s\": No table named \"BillboardPlacing\".\n", filename);
-        exit(EXIT_FAILURE);
+    return hash;
+}
+
+// INTERNAL: where the surface of a tile came from (the working directory must be the map's)
+static tileSource getTileSource(MapData data, int tileID) {
+    mapTileDef def = data->tileDefs[tileID];
+
+    tileSource src = {
+        .path = NULL,
+        .stamp = 0,
+        .color = def.color,
+        .isTransparent = def.isTransparent,
+    };
+    if (def.texture >= 0) {
+        src.path = StringCopy(data->textures[def.texture].path);
+        src.stamp = textureStamp(data, def.texture);
     }
 
-    // Map dimensions
-    ParserElement e = ParserTableGetElement(mapSettings, "mapSize");
-    if (e == NULL || ParserElementGetType(e) != LIST_TYPE) {
-        fprintf(stderr, "Error opening \"%s\": MapSettings must have a \"mapSize\" list parameter.\n", filename);
-        exit(EXIT_FAILURE);
+    return src;
+}
+
+// INTERNAL: whether two tiles sources would make the same tile
+static bool sameTileSource(tileSource src1, tileSource src2) {
+    if (src1.isTransparent != src2.isTransparent) {
+        return false;
     }
-    List val = ParserElementGetValue(e);
-    if (ListGetSize(val) != 2 || ParserElementGetType(ListGet(val, 0)) != INT_TYPE || ParserElementGetType(ListGet(val, 1)) != INT_TYPE) {
-        fprintf(stderr, "Error opening \"%s\": mapSize must be [sizeX, sizeY] (both positive integers).\n", filename);
-        exit(EXIT_FAILURE);
+    if (src1.path == NULL || src2.path == NULL) {
+        return src1.path == src2.path
+            && src1.color.r == src2.color.r && src1.color.g == src2.color.g && src1.color.b == src2.color.b && src1.color.a == src2.color.a;
     }
 
-    map->numRows = *(int*) ParserElementGetValue(ListGet(val, 0));
-    map->numCols = *(int*) ParserElementGetValue(ListGet(val, 1));
-    if (map->numRows <= 0 || map->numCols <= 0) {
-        fprintf(stderr, "Error opening \"%s\": mapSize must be [sizeX, sizeY] (both positive integers).\n", filename);
-        exit(EXIT_FAILURE);
-    }
+    return strcmp(src1.path, src2.path) == 0 && src1.stamp == src2.stamp;
+}
 
-    // Initialize grid
-    map->grid = malloc(sizeof(int*) * map->numRows);
-    assert(map->grid != NULL);
-    for (int i = 0; i < map->numRows; i++) {
-        map->grid[i] = calloc(map->numCols, sizeof(int));
-        assert(map->grid[i] != NULL);
-    }
+// INTERNAL: creates the tile with that ID (the working directory must be the map's)
+static Tile createTile(MapData data, int tileID) {
+    mapTileDef def = data->tileDefs[tileID];
 
-    // Tile dimensions
-    e = ParserTableGetElement(mapSettings, "tileSize");
-    if (e == NULL || ParserElementGetType(e) != INT_TYPE) {
-        fprintf(stderr, "Error opening \"%s\": MapSettings must have a \"tileSize\" integer parameter.\n", filename);
-        exit(EXIT_FAILURE);
+    char* tilename = StringCopy(def.name);
+
+    if (def.texture < 0) {
+        return TileCreateColored(tilename, tileID, def.color);
     }
 
-    map->tileSize = *(int*) ParserElementGetValue(e);
-    if (map->tileSize <= 0) {
-        fprintf(stderr, "Error opening \"%s\": MapSettings must have a \"tileSize\" positive integer parameter.\n", filename);
-        exit(EXIT_FAILURE);
+    return TileCreateFromTexture(tilename, tileID, loadMapTexture(data, def.texture), def.isTransparent);
+}
+
+// INTERNAL: creates a billboard type (the working directory must be the map's)
+static billboardType* createBillboardType(MapData data, int def) {
+    int texture = data->billboardDefs[def].texture;
+
+    billboardType* type = malloc(sizeof(billboardType));
+    assert(type != NULL);
+
+    type->texture = loadMapTexture(data, texture);
+
+    type->path = StringCopy(data->textures[texture].path);
+    type->stamp = textureStamp(data, texture);
+
+    return type;
+}
+
+static void destroyBillboardType(billboardType* type) {
+    TextureCacheRelease(&type->texture);
+    free(type->path);
+    free(type);
+}
+
+// INTERNAL: cell index used as the key of billboardBuckets
+static long long billboardCell(Map map, int posX, int posY) {
+    return (long long) (posX / map->tileSize) * map->numCols + (posY / map->tileSize);
+}
+
+// INTERNAL: adds a billboard to the bucket of the cell it is in, returning the bucket
+static List bucketBillboard(Map map, Billboard bb) {
+    long long cell = billboardCell(map, BillboardGetX(bb), BillboardGetY(bb));
+
+    List bucket = HashMapGet(map->billboardBuckets, &cell);
+    if (bucket == NULL) {
+        long long* key = malloc(sizeof(long long));
+        assert(key != NULL);
+        *key = cell;
+
+        bucket = ListCreate(NULL);
+        HashMapPut(map->billboardBuckets, key, bucket);
     }
-    
-    // Ceiling color
-    map->ceilingColor = parseColor(ParserTableGetElement(mapSettings, "ceilingColor"), filename);
+    ListAppendLast(bucket, bb);
 
-    // Ground color
-    map->groundColor = parseColor(ParserTableGetElement(mapSettings, "groundColor"), filename);
-    
-    // Change working resource directory to folder containing map file
-    const char* last_workdir = GetWorkingDirectory();
-    SearchAndSetResourceDir(GetDirectoryPath(filename));
+    return bucket;
+}
 
-    // Tile definitions
-    HashMap tiledefs = ParserTableGetHashMap(tileDefinition);
-    HashMapIterator iter = HashMapGetIterator(tiledefs);
-    while (HashMapIterCanOperate(iter)) {
-        ParserElement tile = (ParserElement) HashMapIterGetCurrentValue(iter);
-        char* n = ParserElementGetKey(tile);
-        
-        char* tilename = calloc(strlen(n)+1, sizeof(char));
-        assert(tilename != NULL);
-        strncpy(tilename, n, strlen(n));
-        
-        if (ParserElementGetType(tile) != TABLE_TYPE) {
-            fprintf(stderr, "Error opening \"%s\": In TileDefinition, only tiles can be defined ({surface: SURFACE, <options>...}).\n", filename);
-            exit(EXIT_FAILURE);
-        }
+// INTERNAL: removes a billboard from the bucket of the cell it is in
+static void unbucketBillboard(Map map, Billboard bb) {
+    long long cell = billboardCell(map, BillboardGetX(bb), BillboardGetY(bb));
 
-        HashMap tilestuff = (HashMap) ParserElementGetValue(tile);
-        if (!HashMapContains(tilestuff, "surface")) {
-            fprintf(stderr, "Error opening \"%s\": Tile \"%s\" has no attribute \"surface\".\n", filename, n);
-            exit(EXIT_FAILURE);
+    List bucket = HashMapGet(map->billboardBuckets, &cell);
+    assert(bucket != NULL);
+
+    ListMoveToStart(bucket);
+    int i = 0;
+    while (ListCanOperate(bucket)) {
+        if (ListGetCurrent(bucket) == bb) {
+            ListRemove(bucket, i);
+            return;
         }
+        i++;
+        ListMoveToNext(bucket);
+    }
+}
 
-        ParserElement tileSurface = (ParserElement) HashMapGet(tilestuff, "surface");
-        Tile tileobj = NULL;
-        if (ParserElementGetType(tileSurface) == STRING_TYPE) { // Is a file name
-            char* tileSurfaceName = (char*) ParserElementGetValue(HashMapGet(tilestuff, "surface"));
-
-            // Handle transparency (TODO: change this to be less ugly)
-            bool isTransparent = false;
-            ParserElement transparencyelem = HashMapGet(tilestuff, "transparent");
-            if (transparencyelem != NULL && ParserElementGetType(transparencyelem) != BOOL_TYPE) {
-                fprintf(stderr, "Error opening \"%s\": Tile transparency must be represented by a bool value! (in tile \"%s\")\n", filename, n);
-                exit(EXIT_FAILURE);
-            } else if (transparencyelem != NULL) {
-                isTransparent = *(bool*) ParserElementGetValue(transparencyelem);
-            }
-            
-            
-            tileobj = TileCreateTextured(tilename, tileID, tileSurfaceName, isTransparent);
+// INTERNAL: creates the billboards placed in the map data (types is indexed like data->billboardDefs).
+// Compiled maps have them sorted by cell (MapDataSortBillboards), so each run of billboards in the same cell only looks up
+// its bucket once.
+static void placeBillboards(Map map, MapData data, billboardType** types) {
+    map->billboards = ListCreate(NULL);
+    map->billboardBuckets = HashMapCreate(data->numBillboards + 1, cellhash, hashmapcellcmp);
 
-        } else { // Might be a color
-            errno = 0;
-            Color color = parseColor(tileSurface, filename);
+    long long lastCell = -1;
+    List lastBucket = NULL;
+    for (int i = 0; i < data->numBillboards; i++) {
+        mapBillboard bb = data->billboards[i];
 
-            if (errno != 0) {   // Not a color, so surface is wrong
-                fprintf(stderr, "Error opening \"%s\": Tile surfaces must be either a string file name or a color! (in tile \"%s\")\n", filename, n);
-                exit(EXIT_FAILURE);
-            }
+        // Create and store the billboard itself
+        Billboard billboard = BillboardCreate(types[bb.def]->texture, bb.posX, bb.posY, 10);
+        ListAppendLast(map->billboards, billboard);
 
-            tileobj = TileCreateColored(tilename, tileID, color);
+        long long cell = billboardCell(map, bb.posX, bb.posY);
+        if (cell == lastCell) {
+            ListAppendLast(lastBucket, billboard);
+        } else {
+            lastBucket = bucketBillboard(map, billboard);
+            lastCell = cell;
         }
+    }
+}
 
-        
+// INTERNAL: destroys the billboards and their buckets
+static void destroyBillboards(Map map) {
+    // Destroy billboard buckets (the billboards themselves are in map->billboards)
+    HashMapIterator iter = HashMapGetIterator(map->billboardBuckets);
+    while (HashMapIterCanOperate(iter)) {
+        long long* key = HashMapIterGetCurrentKey(iter);
+        List bucket = HashMapIterGetCurrentValue(iter);
 
-        registerTile(map, tileobj, &tileID);
+        ListDestroy(&bucket);
+        free(key);
 
         HashMapIterGoToNext(iter);
     }
-    
     HashMapIterDestroy(&iter);
+    HashMapDestroy(&map->billboardBuckets);
 
-    // Change working resource directory back
-    ChangeDirectory(last_workdir);
-    
-    // Tile placements
-    ParserElement tiles = ParserTableGetElement(tilePlacing, "Tiles");
-    if (tiles != NULL) {
-        if (ParserElementGetType(tiles) != LIST_TYPE) {
-            fprintf(stderr, "Error opening \"%s\": \"Tiles\" parameter must be a list of [int tileX, int tileY, string tileName].\n", filename);
-            exit(EXIT_FAILURE);
-        }
+    // Destroy billboards
+    ListMoveToStart(map->billboards);
+    while (ListCanOperate(map->billboards)) {
+        Billboard billboard = ListPopFirst(map->billboards);
+        BillboardDestroy(&billboard);
+    }
+    ListDestroy(&map->billboards);
+}
 
-        List tileList = (List) ParserElementGetValue(tiles);
-        ListMoveToStart(tileList);
-        while (ListCanOperate(tileList)) {
-            if (ParserElementGetType(ListGetCurrent(tileList)) != LIST_TYPE) {
-                fprintf(stderr, "Error opening \"%s\": \"Tiles\" parameter must be a list of [int tileX, int tileY, string tileName].\n", filename);
-                exit(EXIT_FAILURE);
-            }
-            
-            // Verify tile placement list semantics
-            List tilePlacement = (List) ParserElementGetValue(ListGetCurrent(tileList));
-            if (ListGetSize(tilePlacement) != 3 || ParserElementGetType(ListGet(tilePlacement, 0)) != INT_TYPE || ParserElementGetType(ListGet(tilePlacement, 1)) != INT_TYPE || ParserElementGetType(ListGet(tilePlacement, 2)) != STRING_TYPE) {
-                fprintf(stderr, "Error opening \"%s\": \"Tiles\" parameter must be a list of [int tileX, int tileY, string tileName].\n", filename);
-                exit(EXIT_FAILURE);
-            }
+// INTERNAL: creates the flat types and grids of the map data (the working directory must be the map's)
+static void createFlats(Map map, MapData data) {
+    map->numFlats = data->numFlatDefs + 1;
+    map->flats = calloc(map->numFlats, sizeof(flatType));
+    assert(map->flats != NULL);
+    for (int i = 0; i < data->numFlatDefs; i++) {
+        mapFlatDef def = data->flatDefs[i];
+        flatType* flat = &map->flats[i + 1];
+
+        flat->color = def.color;
+        if (def.texture >= 0) {
+            flat->texture = loadMapTexture(data, def.texture);
+            flat->path = StringCopy(data->textures[def.texture].path);
+        }
+    }
+    map->defaultFlats[FLAT_FLOOR] = data->floorDef + 1;
+    map->defaultFlats[FLAT_CEILING] = data->ceilingDef + 1;
+
+    // Only the placed cells are stored (the grids are sparse, so a few placements take a few chunks)
+    map->flatGrids[FLAT_FLOOR] = map->flatGrids[FLAT_CEILING] = NULL;
+    for (int i = 0; i < data->numFlats; i++) {
+        mapFlat flat = data->flats[i];
+        ChunkGrid* grid = &map->flatGrids[flat.isCeiling ? FLAT_CEILING : FLAT_FLOOR];
+        if (*grid == NULL) {
+            *grid = ChunkGridCreate(data->numRows, data->numCols);
+        }
+        ChunkGridSetTile(*grid, flat.row, flat.col, flat.def + 1);
+    }
+}
 
-            Tile tile = (Tile) HashMapGet(map->tileMap, (char*) ParserElementGetValue(ListGet(tilePlacement, 2)));
-            MapSetTile(map,
-                *((int*) ParserElementGetValue(ListGet(tilePlacement, 0))),
-                *((int*) ParserElementGetValue(ListGet(tilePlacement, 1))),
-                TileGetMapTiles(tile));
+// INTERNAL: destroys the flat types and grids
+static void destroyFlats(Map map) {
+    for (int i = 1; i < map->numFlats; i++) {
+        if (map->flats[i].texture != NULL) {
+            TextureCacheRelease(&map->flats[i].texture);
+        }
+        free(map->flats[i].path);
+    }
+    free(map->flats);
+    map->flats = NULL;
+    map->numFlats = 0;
 
-            ListMoveToNext(tileList);
+    for (int i = FLAT_FLOOR; i <= FLAT_CEILING; i++) {
+        if (map->flatGrids[i] != NULL) {
+            ChunkGridDestroy(&map->flatGrids[i]);
         }
-    } else {
-        fprintf(stderr, "Warning opening \"%s\": No parameter \"Tiles\" was given in table \"TilePlacing\", so the map will be blank.\n", filename);
     }
+}
 
-    // Change working resource directory to folder containing map file
-    last_workdir = GetWorkingDirectory();
-    SearchAndSetResourceDir(GetDirectoryPath(filename));
+// INTERNAL: loads the map data of a map file (compiled or not)
+static MapData loadMapData(const char* filename) {
+    MapData data = MapDataIsCompiled(filename) ? MapDataLoadCompiledHeader(filename) : MapCacheLoad(filename);
+    if (data->numTileDefs > 0x10000) {
+        fprintf(stderr, "Error opening \"%s\": Maps can have at most %d tile types.\n", filename, 0xFFFF);
+        MapDataDestroy(&data);
+        LoadErrorFail();
+    }
+    if (data->grid == NULL && data->chunkSize != MAP_CHUNK_SIZE) {
+        fprintf(stderr, "Error opening \"%s\": Chunks of %d cells are not supported (expected %d). Compile it again with mapc.\n", filename, data->chunkSize, MAP_CHUNK_SIZE);
+        MapDataDestroy(&data);
+        LoadErrorFail();
+    }
 
-    // Billboard definitions
-    map->billboardMap = HashMapCreate(5, djb2hash, hashmapstrcmp);
-    HashMap billboard_defs = ParserTableGetHashMap(billboardDefinition);
-    HashMapIterator billboard_defs_iter = HashMapGetIterator(billboard_defs);
+    return data;
+}
 
-    while (HashMapIterCanOperate(billboard_defs_iter)) {
-        ParserElement def = HashMapIterGetCurrentValue(billboard_defs_iter);
-        char* n = ParserElementGetKey(def);
+// INTERNAL: loadMapData, but returns NULL (after printing the error) instead of exiting if the file is invalid
+static MapData tryLoadMapData(const char* filename) {
+    jmp_buf handler;
+    jmp_buf* previous = LoadErrorSetHandler(&handler);
+    MapData volatile data = NULL;
+    if (setjmp(handler) == 0) {
+        data = loadMapData(filename);
+    }
+    LoadErrorSetHandler(previous);
 
-        char* bbname = calloc(strlen(n)+1, sizeof(char));
-        assert(bbname != NULL);
-        strncpy(bbname, n, strlen(n));
+    return data;
+}
 
-        if (ParserElementGetType(def) != TABLE_TYPE) {
-            fprintf(stderr, "Warning opening \"%s\": In BillboardDefinition, only billboards can be defined ({surface: SURFACE, <options>...}).\n", filename);
-            exit(EXIT_FAILURE);
+_Static_assert(MAP_CHUNK_SIZE == CHUNK_SIZE && MAP_BLOCK_SIZE == CHUNK_BLOCK_SIZE, "map.h and chunkgrid.h must agree on the chunk size");
+
+// INTERNAL: creates the grid of a map (of at most 0x10000 tile types, see loadMapData). Compiled maps (whose grid was not loaded) have their chunks read when needed.
+static ChunkGrid createGrid(MapData data, const char* filename) {
+    if (data->grid == NULL) {
+        return ChunkGridCreateFromFile(data, filename);
+    }
+
+    ChunkGrid grid = ChunkGridCreate(data->numRows, data->numCols);
+    for (int row = 0; row < data->numRows; row++) {
+        for (int col = 0; col < data->numCols; col++) {
+            int tile = data->grid[(size_t) row*data->numCols + col];
+            if (tile != TILE_GROUND) {
+                ChunkGridSetTile(grid, row, col, tile);
+            }
         }
+    }
 
-        HashMap defMap = ParserElementGetValue(def);
-        if (!HashMapContains(defMap, "surface")) {
-            fprintf(stderr, "Error opening \"%s\": Tile \"%s\" has no attribute \"surface\".\n", filename, n);
-            exit(EXIT_FAILURE);
+    return grid;
+}
+
+// INTERNAL: number of chunk columns of the cached 2D view
+static int layerCols(Map map) {
+    return (map->numCols + MAP_CHUNK_SIZE - 1) >> MAP_CHUNK_SHIFT;
+}
+
+// INTERNAL: unloads the cached 2D view, to be made again when next drawn
+static void destroyLayer(Map map) {
+    if (map->layer == NULL) {
+        return;
+    }
+
+    int numChunks = ((map->numRows + MAP_CHUNK_SIZE - 1) >> MAP_CHUNK_SHIFT) * layerCols(map);
+    for (int i = 0; i < numChunks; i++) {
+        if (map->layer[i].texture.id != 0) {
+            UnloadTexture(map->layer[i].texture);
         }
+    }
+    free(map->layer);
+    map->layer = NULL;
+}
 
-        ParserElement surfaceEl = (ParserElement) HashMapGet(defMap, "surface");
-        if (ParserElementGetType(surfaceEl) != STRING_TYPE) { // TODO: this could also MAYBE be a color, since its possible when defining the same attribute in a tile
-            fprintf(stderr, "Error opening \"%s\": Billboard surfaces must be a string file name! (in tile \"%s\")\n", filename, n);
-            exit(EXIT_FAILURE);
+// INTERNAL: makes the texture of a chunk of the cached 2D view again: a texel per cell (x is the row, like on the
+// screen), white if it is not GROUND. Chunks that are entirely GROUND have none.
+static void updateLayerChunk(Map map, int chunkRow, int chunkCol) {
+    layerChunk* lc = &map->layer[chunkRow * layerCols(map) + chunkCol];
+    const unsigned long long* solid = ChunkGridGetChunkSolidity(map->grid, chunkRow, chunkCol);
+    lc->dirty = false;
+
+    if (solid == NULL) {
+        if (lc->texture.id != 0) {
+            UnloadTexture(lc->texture);
+            lc->texture = (Texture2D) {0};
         }
+        return;
+    }
 
-        // TODO: While I don't invent anything else, only a texture will need to be saved, later should probably be a "BillboardData" object or something
-        char* fname = ParserElementGetValue(surfaceEl);
-        Texture* texp = malloc(sizeof(Texture));
-        assert(texp != NULL);
+    static unsigned char pixels[MAP_CHUNK_SIZE * MAP_CHUNK_SIZE];
+    for (int col = 0; col < MAP_CHUNK_SIZE; col++) {
+        for (int row = 0; row < MAP_CHUNK_SIZE; row++) {
+            pixels[col * MAP_CHUNK_SIZE + row] = ((solid[row] >> col) & 1) ? 255 : 0;
+        }
+    }
 
-        *texp = LoadTexture(fname);
+    if (lc->texture.id == 0) {
+        lc->texture = LoadTextureFromImage((Image) {pixels, MAP_CHUNK_SIZE, MAP_CHUNK_SIZE, 1, PIXELFORMAT_UNCOMPRESSED_GRAYSCALE});
+    } else {
+        UpdateTexture(lc->texture, pixels);
+    }
+}
 
-        // Duplicate checking
-        if (!HashMapContains(map->billboardMap, bbname)) {
-            HashMapPut(map->billboardMap, bbname, texp);
-        } else {
-            UnloadTexture(*texp);
-            free(texp); texp = NULL;
+// INTERNAL: builds a map from its (validated) data. filename is used to find the textures.
+static Map createFromData(MapData data, const char* filename) {
+    Map map = malloc(sizeof(struct map));
+    assert(map != NULL);
+
+    map->numRows = data->numRows;
+    map->numCols = data->numCols;
+    map->tileSize = data->tileSize;
+    map->version = 0;
+    map->billboardVersion = 0;
+    map->ceilingColor = data->ceilingColor;
+    map->groundColor = data->groundColor;
+    map->colormap = ColormapCreate(data->fogColor, data->fogDensity);
+
+    map->tileNames = ListCreate(NULL);
+    char* ground = calloc(7, sizeof(char)); assert(ground != NULL); ground = strncpy(ground, "GROUND", 6); ListAppendLast(map->tileNames, ground);
+
+    // Default tileMap values
+    map->tileMap = HashMapCreate(5, StringHash, StringEquals);
+    HashMapPut(map->tileMap, ground, TileCreateTextured(ground, TILE_GROUND, "resources/default.png", false));
+
+    // Initialize grid
+    map->grid = createGrid(data, filename);
+    map->layer = NULL;
+
+    // Change working resource directory to folder containing map file
+    // (copied, since GetWorkingDirectory's buffer is reused by the texture cache)
+    char* last_workdir = StringCopy(GetWorkingDirectory());
+    SearchAndSetResourceDir(GetDirectoryPath(filename));
+
+    // Tile definitions (the data's tile IDs are kept)
+    map->numTileSources = data->numTileDefs;
+    map->tileSources = calloc(data->numTileDefs, sizeof(tileSource));
+    assert(map->tileSources != NULL);
+
+    int tileID = 1;     // ID of next tile to be defined
+    while (tileID < data->numTileDefs) {
+        map->tileSources[tileID] = getTileSource(data, tileID);
+
+        if (!registerTile(map, createTile(data, tileID), &tileID)) {
+            fprintf(stderr, "Error opening \"%s\": Tile \"%s\" is defined more than once.\n", filename, data->tileDefs[tileID].name);
+            exit(EXIT_FAILURE);
         }
+    }
 
-        HashMapIterGoToNext(billboard_defs_iter);
+    // Billboard definitions
+    map->billboardMap = HashMapCreate(5, StringHash, StringEquals);
+    billboardType** types = malloc(sizeof(billboardType*) * (data->numBillboardDefs + 1));
+    assert(types != NULL);
+    for (int i = 0; i < data->numBillboardDefs; i++) {
+        types[i] = createBillboardType(data, i);
+        HashMapPut(map->billboardMap, StringCopy(data->billboardDefs[i].name), types[i]);
     }
 
-    HashMapIterDestroy(&billboard_defs_iter);
+    // Floors and ceilings
+    createFlats(map, data);
 
     // Change working resource directory back
     ChangeDirectory(last_workdir);
-    
+    free(last_workdir);
+
     // Billboard placements
-    map->billboards = ListCreate(NULL);
-    if (!ParserTableHasElement(billboardPlacing, "Billboards")) {
-        fprintf(stderr, "Warning opening \"%s\": No parameter \"Billboards\" was given in table \"BillboardPlacing\", so the map will be blank.\n", filename);
+    placeBillboards(map, data, types);
+    free(types);
+
+    return map;
+}
+
+Map MapCreateFromFile(const char* filename) {
+    MapData data = loadMapData(filename);
+
+    Map map = createFromData(data, filename);
+
+    MapDataDestroy(&data);
+
+    return map;
+}
+
+bool MapReload(Map map, const char* filename) {
+    assert(map != NULL);
+    assert(filename != NULL);
+
+    double start = GetTime();
+    MapData data = tryLoadMapData(filename);
+    if (data == NULL) {
+        TraceLog(LOG_WARNING, "MAP: [%s] Could not be reloaded, keeping the loaded map", filename);
+        return false;
     }
 
-    ParserElement billboardsEl = ParserTableGetElement(billboardPlacing, "Billboards");
-    if (ParserElementGetType(billboardsEl) != LIST_TYPE) {
-        fprintf(stderr, "Error opening \"%s\": \"Billboards\" parameter must be a list of [int bbX, int bbY, string bbName].\n", filename);
-        exit(EXIT_FAILURE);
+    // A different grid size changes everything, so just swap in a new map (the Map itself stays the same)
+    if (data->numRows != map->numRows || data->numCols != map->numCols || data->tileSize != map->tileSize) {
+        Map fresh = createFromData(data, filename);
+        struct map old = *map;
+        *map = *fresh;
+        *fresh = old;
+        map->version = old.version + 1;
+        map->billboardVersion = old.billboardVersion + 1;
+        MapDestroy(&fresh);
+        MapDataDestroy(&data);
+
+        TraceLog(LOG_INFO, "MAP: [%s] Size changed, fully reloaded in %.2f ms", filename, (GetTime() - start)*1000.0);
+        return true;
     }
 
-    List billboards = ParserElementGetValue(billboardsEl);
-    ListMoveToStart(billboards);
-    while (ListCanOperate(billboards)) {
-        ParserElement bbEl = ListGetCurrent(billboards);
+    map->ceilingColor = data->ceilingColor;
+    map->groundColor = data->groundColor;
+    ColormapDestroy(&map->colormap);
+    map->colormap = ColormapCreate(data->fogColor, data->fogDensity);
+    map->version++;
+    map->billboardVersion++;
 
-        if (ParserElementGetType(bbEl) != LIST_TYPE) {
-            fprintf(stderr, "Error opening \"%s\": \"Billboards\" parameter must be a list of [int bbX, int bbY, string bbName].\n", filename);
-            exit(EXIT_FAILURE);
+    // Change working resource directory to folder containing map file
+    // (copied, since GetWorkingDirectory's buffer is reused by the texture cache)
+    char* last_workdir = StringCopy(GetWorkingDirectory());
+    SearchAndSetResourceDir(GetDirectoryPath(filename));
+
+    // Tiles: the ones whose surface did not change are moved to the new tables, the others are created again
+    char* ground = ListGet(map->tileNames, TILE_GROUND);
+    Tile groundTile = HashMapPop(map->tileMap, ground);
+
+    List tileNames = ListCreate(NULL);
+    ListAppendLast(tileNames, ground);
+    HashMap tileMap = HashMapCreate(5, StringHash, StringEquals);
+    HashMapPut(tileMap, ground, groundTile);
+    tileSource* tileSources = calloc(data->numTileDefs, sizeof(tileSource));
+    assert(tileSources != NULL);
+
+    int reloadedTextures = 0;
+    for (int tileID = 1; tileID < data->numTileDefs; tileID++) {
+        tileSources[tileID] = getTileSource(data, tileID);
+
+        Tile tile = HashMapGet(map->tileMap, data->tileDefs[tileID].name);
+        if (tile != NULL && sameTileSource(map->tileSources[TileGetMapTiles(tile)], tileSources[tileID])) {
+            HashMapPop(map->tileMap, data->tileDefs[tileID].name);
+            TileSetMapTiles(tile, tileID);
+        } else {
+            tile = createTile(data, tileID);
+            if (data->tileDefs[tileID].texture >= 0) {
+                reloadedTextures++;
+            }
         }
 
-        // Verify billboard placement list semantics
-        List bbPlacement = (List) ParserElementGetValue(bbEl);
+        ListAppendLast(tileNames, TileGetName(tile));
+        HashMapPut(tileMap, TileGetName(tile), tile);
+    }
 
-        if (ListGetSize(bbPlacement) != 3 || ParserElementGetType(ListGet(bbPlacement, 0)) != INT_TYPE || ParserElementGetType(ListGet(bbPlacement, 1)) != INT_TYPE || ParserElementGetType(ListGet(bbPlacement, 2)) != STRING_TYPE) {
-            fprintf(stderr, "Error opening \"%s\": \"Billboards\" parameter must be a list of [int tileX, int tileY, string tileName].\n", filename);
-            exit(EXIT_FAILURE);
+    // What is left in the old tables is no longer used
+    HashMapIterator iter = HashMapGetIterator(map->tileMap);
+    while (HashMapIterCanOperate(iter)) {
+        Tile tile = HashMapIterGetCurrentValue(iter);
+        char* name = TileGetName(tile);
+
+        TileDestroy(&tile);
+        free(name);
+
+        HashMapIterGoToNext(iter);
+    }
+    HashMapIterDestroy(&iter);
+    HashMapDestroy(&map->tileMap);
+    ListDestroy(&map->tileNames);
+    for (int i = 0; i < map->numTileSources; i++) {
+        free(map->tileSources[i].path);
+    }
+    free(map->tileSources);
+
+    map->tileMap = tileMap;
+    map->tileNames = tileNames;
+    map->tileSources = tileSources;
+    map->numTileSources = data->numTileDefs;
+
+    // Billboard types: same as the tiles
+    HashMap billboardMap = HashMapCreate(5, StringHash, StringEquals);
+    billboardType** types = malloc(sizeof(billboardType*) * (data->numBillboardDefs + 1));
+    assert(types != NULL);
+    for (int i = 0; i < data->numBillboardDefs; i++) {
+        char* name = data->billboardDefs[i].name;
+        int texture = data->billboardDefs[i].texture;
+
+        billboardType* type = HashMapGet(map->billboardMap, name);
+        if (type != NULL && strcmp(type->path, data->textures[texture].path) == 0 && type->stamp == textureStamp(data, texture)) {
+            char* key = NULL;
+            iter = HashMapGetIterator(map->billboardMap);
+            while (HashMapIterCanOperate(iter) && key == NULL) {
+                if (HashMapIterGetCurrentValue(iter) == type) {
+                    key = HashMapIterGetCurrentKey(iter);
+                }
+                HashMapIterGoToNext(iter);
+            }
+            HashMapIterDestroy(&iter);
+
+            HashMapPop(map->billboardMap, name);
+            free(key);
+        } else {
+            type = createBillboardType(data, i);
+            reloadedTextures++;
         }
 
-        Texture* texp = (Texture*) HashMapGet(map->billboardMap, (char*) ParserElementGetValue(ListGet(bbPlacement, 2)));
+        types[i] = type;
+        HashMapPut(billboardMap, StringCopy(name), type);
+    }
 
-        // Create and store the billboard itself
-        Billboard billboard = BillboardCreate(
-            *texp,
-            *((int*) ParserElementGetValue(ListGet(bbPlacement, 0))),
-            *((int*) ParserElementGetValue(ListGet(bbPlacement, 1))),
-            10
-        );
-        ListAppendLast(map->billboards, billboard);
+    iter = HashMapGetIterator(map->billboardMap);
+    while (HashMapIterCanOperate(iter)) {
+        free(HashMapIterGetCurrentKey(iter));
+        destroyBillboardType(HashMapIterGetCurrentValue(iter));
 
-        ListMoveToNext(billboards);
+        HashMapIterGoToNext(iter);
     }
+    HashMapIterDestroy(&iter);
+    HashMapDestroy(&map->billboardMap);
+    map->billboardMap = billboardMap;
 
-    // Cleanup
-    ParserResultDestroy(&res);
-    MapParserDestroy(&parser);
+    // Flats are few, and their textures stay in the texture cache, so they are just made again
+    destroyFlats(map);
+    createFlats(map, data);
 
-    return map;
+    // Change working resource directory back
+    ChangeDirectory(last_workdir);
+    free(last_workdir);
+
+    // Billboards are cheap to create again
+    destroyBillboards(map);
+    placeBillboards(map, data, types);
+    free(types);
+
+    // Grid: only the cells that changed are written. The chunks of compiled maps are read on demand, so the grid is replaced.
+    if (data->grid == NULL) {
+        ChunkGridDestroy(&map->grid);
+        map->grid = createGrid(data, filename);
+        destroyLayer(map);
+        MapDataDestroy(&data);
+
+        TraceLog(LOG_INFO, "MAP: [%s] Reloaded in %.2f ms (grid replaced, %d textures reloaded)", filename, (GetTime() - start)*1000.0, reloadedTextures);
+        return true;
+    }
+
+    int patchedCells = 0;
+    for (int row = 0; row < map->numRows; row++) {
+        for (int col = 0; col < map->numCols; col++) {
+            int tile = data->grid[(size_t) row*map->numCols + col];
+            if (ChunkGridGetTile(map->grid, row, col) != tile) {
+                MapSetTile(map, row, col, tile);
+                patchedCells++;
+            }
+        }
+    }
+
+    MapDataDestroy(&data);
+
+    TraceLog(LOG_INFO, "MAP: [%s] Reloaded in %.2f ms (%d cells patched, %d textures reloaded)", filename, (GetTime() - start)*1000.0, patchedCells, reloadedTextures);
+
+    return true;
 }
 
 void MapDestroy(Map* mp) {
@@ -442,10 +763,8 @@ void MapDestroy(Map* mp) {
     Map map = *mp;
 
     // Destroy grid
-    for (int i = 0; i < map->numRows; i++) {
-        free(map->grid[i]);
-    }
-    free(map->grid);
+    ChunkGridDestroy(&map->grid);
+    destroyLayer(map);
 
     // Clear (free) tiles in tilemap
     HashMapIterator iter = HashMapGetIterator(map->tileMap);
@@ -468,43 +787,74 @@ void MapDestroy(Map* mp) {
     }
     ListDestroy(&(map->tileNames));
 
+    for (int i = 0; i < map->numTileSources; i++) {
+        free(map->tileSources[i].path);
+    }
+    free(map->tileSources);
+
     // Clear (unload) billboard textures in billboardmap
     iter = HashMapGetIterator(map->billboardMap);
     while (HashMapIterCanOperate(iter)) {
         char* str = (char*) HashMapIterGetCurrentKey(iter);
-        Texture* texp = HashMapGet(map->billboardMap, str);
+        billboardType* type = HashMapGet(map->billboardMap, str);
 
-        Texture tex = *texp;
-        UnloadTexture(tex);
-        
+        destroyBillboardType(type);
         free(str);
-        free(texp);
 
         HashMapIterGoToNext(iter);
     }
     HashMapIterDestroy(&iter);
     HashMapDestroy(&(map->billboardMap));
 
-
-    // Destroy billboards
-    ListMoveToStart(map->billboards);
-    while (ListCanOperate(map->billboards)) {
-        Billboard billboard = ListPopFirst(map->billboards);
-        BillboardDestroy(&billboard);
-    }
-    ListDestroy(&map->billboards);
+    destroyBillboards(map);
+    destroyFlats(map);
+    ColormapDestroy(&map->colormap);
     
     free(map);
 
     *mp = NULL;
 }
 
+List MapGetTextureFiles(Map map) {
+    assert(map != NULL);
+
+    List files = ListCreate(NULL);
+
+    for (int i = 0; i < map->numTileSources; i++) {
+        if (map->tileSources[i].path != NULL) {
+            ListAppendLast(files, map->tileSources[i].path);
+        }
+    }
+
+    HashMapIterator iter = HashMapGetIterator(map->billboardMap);
+    while (HashMapIterCanOperate(iter)) {
+        billboardType* type = HashMapIterGetCurrentValue(iter);
+        ListAppendLast(files, type->path);
+
+        HashMapIterGoToNext(iter);
+    }
+    HashMapIterDestroy(&iter);
+
+    for (int i = 1; i < map->numFlats; i++) {
+        if (map->flats[i].path != NULL) {
+            ListAppendLast(files, map->flats[i].path);
+        }
+    }
+
+    return files;
+}
+
 void MapSetTile(Map map, int row, int col, int tile) {
     assert(map != NULL);
     assert(row >= 0);
     assert(col >= 0);
     
-    map->grid[row][col] = tile;
+    ChunkGridSetTile(map->grid, row, col, tile);
+    map->version++;
+
+    if (map->layer != NULL) {
+        map->layer[(row >> MAP_CHUNK_SHIFT) * layerCols(map) + (col >> MAP_CHUNK_SHIFT)].dirty = true;
+    }
 }
 
 int MapGetTile(Map map, int row, int col) {
@@ -513,7 +863,67 @@ int MapGetTile(Map map, int row, int col) {
         return TILE_GROUND;
     }
 
-    return map->grid[row][col];
+    return ChunkGridGetTile(map->grid, row, col);
+}
+
+bool MapIsSolid(Map map, int row, int col) {
+    assert(map != NULL);
+
+    return ChunkGridIsSolid(map->grid, row, col);
+}
+
+bool MapIsSolidAt(Map map, int posX, int posY) {
+    assert(map != NULL);
+
+    return ChunkGridIsSolid(map->grid, posX / map->tileSize, posY / map->tileSize);
+}
+
+bool MapIsSpanSolid(Map map, int row, int firstCol, int lastCol) {
+    assert(map != NULL);
+
+    return ChunkGridIsSpanSolid(map->grid, row, firstCol, lastCol);
+}
+
+bool MapIsRectSolid(Map map, int firstRow, int firstCol, int lastRow, int lastCol) {
+    assert(map != NULL);
+
+    return ChunkGridIsRectSolid(map->grid, firstRow, firstCol, lastRow, lastCol);
+}
+
+const unsigned short* MapGetChunk(Map map, int chunkRow, int chunkCol) {
+    assert(map != NULL);
+
+    return ChunkGridGetChunk(map->grid, chunkRow, chunkCol);
+}
+
+const unsigned long long* MapGetChunkSolidity(Map map, int chunkRow, int chunkCol) {
+    assert(map != NULL);
+
+    return ChunkGridGetChunkSolidity(map->grid, chunkRow, chunkCol);
+}
+
+unsigned long long MapGetChunkBlocks(Map map, int chunkRow, int chunkCol) {
+    assert(map != NULL);
+
+    return ChunkGridGetChunkBlocks(map->grid, chunkRow, chunkCol);
+}
+
+const unsigned char* MapGetChunkDistances(Map map, int chunkRow, int chunkCol) {
+    assert(map != NULL);
+
+    return ChunkGridGetChunkDistances(map->grid, chunkRow, chunkCol);
+}
+
+void MapSetChunkBudget(Map map, int maxChunks) {
+    assert(map != NULL);
+
+    ChunkGridSetBudget(map->grid, maxChunks);
+}
+
+bool MapIsStreamed(Map map) {
+    assert(map != NULL);
+
+    return ChunkGridIsFileBacked(map->grid);
 }
 
 Tile MapGetTileObject(Map map, int tile) {
@@ -521,6 +931,11 @@ Tile MapGetTileObject(Map map, int tile) {
     return HashMapGet(map->tileMap, ListGet(map->tileNames, tile));
 }
 
+int MapGetNumTiles(Map map) {
+    assert(map != NULL);
+    return ListGetSize(map->tileNames);
+}
+
 int MapGetTileSize(Map map) {
     assert(map != NULL);
     
@@ -546,33 +961,61 @@ List MapGetBillboardsAt(Map map, int col, int row) {
     
     List ret = ListCreate(NULL);
 
-    // TODO: this is inneficient, putting all billboards in sectors and only verifying those sectors should help with performance
-    ListMoveToStart(map->billboards);
-    while (ListCanOperate(map->billboards)) {
-        Billboard bb = ListGetCurrent(map->billboards);
-
-        int x = BillboardGetX(bb);
-        int y = BillboardGetY(bb);
+    // Only the buckets of the cells around this one can have billboards close enough
+    for (int gridX = col - check_margin; gridX <= col + check_margin; gridX++) {
+        for (int gridY = row - check_margin; gridY <= row + check_margin; gridY++) {
+            if (gridX < 0 || gridX >= map->numRows || gridY < 0 || gridY >= map->numCols) {
+                continue;
+            }
 
-        int gridX = x / map->tileSize;
-        int gridY = y / map->tileSize;
+            long long cell = (long long) gridX * map->numCols + gridY;
+            List bucket = HashMapGet(map->billboardBuckets, &cell);
+            if (bucket == NULL) {
+                continue;
+            }
 
-        
-        for (int r = -check_margin + gridY; r <= check_margin + gridY; r++) {
-            for (int c = -check_margin + gridX; c <= check_margin + gridX; c++) {
-                if (c == col && r == row) {
-                    ListAppendLast(ret, bb);
-                    break;
-                }
+            ListMoveToStart(bucket);
+            while (ListCanOperate(bucket)) {
+                ListAppendLast(ret, ListGetCurrent(bucket));
+                ListMoveToNext(bucket);
             }
         }
-
-        ListMoveToNext(map->billboards);
     }
 
     return ret;
 }
 
+void MapMoveBillboard(Map map, Billboard bb, int posX, int posY) {
+    assert(map != NULL);
+    assert(bb != NULL);
+    assert(posX >= 0 && posX < map->numRows*map->tileSize);
+    assert(posY >= 0 && posY < map->numCols*map->tileSize);
+
+    unbucketBillboard(map, bb);
+    BillboardSetX(bb, posX);
+    BillboardSetY(bb, posY);
+    bucketBillboard(map, bb);
+    map->billboardVersion++;
+}
+
+Colormap MapGetColormap(Map map) {
+    assert(map != NULL);
+
+    return map->colormap;
+}
+
+unsigned int MapGetVersion(Map map) {
+    assert(map != NULL);
+
+    return map->version;
+}
+
+unsigned int MapGetBillboardVersion(Map map) {
+    assert(map != NULL);
+
+    return map->billboardVersion;
+}
+
 Texture MapGetTextureAt(Map map, int row, int col) {
     assert(map != NULL);
 
@@ -583,15 +1026,48 @@ Texture MapGetTextureAt(Map map, int row, int col) {
 void MapDraw2D(Map map) {
     assert(map != NULL);
 
-    for (int row = 0; row < map->numRows; row++) {
-        for (int col = 0; col < map->numCols; col++) {
-            Color color;
-            if (map->grid[row][col] == TILE_GROUND) {
-                color = (Color) {0, 0, 0, 255};
-            } else {
-                color = (Color) {255, 255, 255, 255};
+    // The part of the map inside the render target (it can be panned and zoomed by a 2D camera, but not rotated)
+    Matrix view = rlGetMatrixModelview();
+    float left = -view.m12 / view.m0;
+    float top = -view.m13 / view.m5;
+    float right = left + rlGetFramebufferWidth() / view.m0;
+    float bottom = top + rlGetFramebufferHeight() / view.m5;
+
+    int mapWidth = map->numRows * map->tileSize;
+    int mapHeight = map->numCols * map->tileSize;
+    if (right <= 0 || bottom <= 0 || left >= mapWidth || top >= mapHeight) {
+        return;
+    }
+
+    // The tiles are kept as a texture per chunk, made when first seen and again after MapSetTile changes them.
+    // Under them, one rectangle for the GROUND.
+    if (map->layer == NULL) {
+        map->layer = calloc((size_t) ((map->numRows + MAP_CHUNK_SIZE - 1) >> MAP_CHUNK_SHIFT) * layerCols(map), sizeof(layerChunk));
+        assert(map->layer != NULL);
+    }
+    DrawRectangle(0, 0, mapWidth, mapHeight, (Color) {0, 0, 0, 255});
+
+    int chunkPixels = MAP_CHUNK_SIZE * map->tileSize;
+    int firstChunkRow = left > 0 ? (int) left / chunkPixels : 0;
+    int firstChunkCol = top > 0 ? (int) top / chunkPixels : 0;
+    int lastChunkRow = (int) (right < mapWidth ? right : mapWidth - 1) / chunkPixels;
+    int lastChunkCol = (int) (bottom < mapHeight ? bottom : mapHeight - 1) / chunkPixels;
+    for (int chunkRow = firstChunkRow; chunkRow <= lastChunkRow; chunkRow++) {
+        for (int chunkCol = firstChunkCol; chunkCol <= lastChunkCol; chunkCol++) {
+            layerChunk* lc = &map->layer[chunkRow * layerCols(map) + chunkCol];
+            if (lc->texture.id == 0 || lc->dirty) {
+                updateLayerChunk(map, chunkRow, chunkCol);
             }
-            DrawRectangle(row*map->tileSize, col*map->tileSize, map->tileSize, map->tileSize, color);
+            if (lc->texture.id == 0) {
+                continue;
+            }
+
+            // Chunks on the edges can be partly outside of the map
+            int rows = map->numRows - chunkRow * MAP_CHUNK_SIZE < MAP_CHUNK_SIZE ? map->numRows - chunkRow * MAP_CHUNK_SIZE : MAP_CHUNK_SIZE;
+            int cols = map->numCols - chunkCol * MAP_CHUNK_SIZE < MAP_CHUNK_SIZE ? map->numCols - chunkCol * MAP_CHUNK_SIZE : MAP_CHUNK_SIZE;
+            DrawTexturePro(lc->texture, (Rectangle) {0, 0, (float) rows, (float) cols},
+                (Rectangle) {(float) (chunkRow * chunkPixels), (float) (chunkCol * chunkPixels), (float) (rows * map->tileSize), (float) (cols * map->tileSize)},
+                (Vector2) {0, 0}, 0, WHITE);
         }
     }
 
@@ -599,15 +1075,302 @@ void MapDraw2D(Map map) {
     ListMoveToStart(map->billboards);
     while (ListCanOperate(map->billboards)) {
         Billboard bb = ListGetCurrent(map->billboards);
-        DrawCircle(BillboardGetX(bb), BillboardGetY(bb), (float) BillboardGetSize(bb), (Color) {0, 0, 255, 255});
+        float size = (float) BillboardGetSize(bb);
+        if (BillboardGetX(bb) + size >= left && BillboardGetX(bb) - size <= right && BillboardGetY(bb) + size >= top && BillboardGetY(bb) - size <= bottom) {
+            DrawCircle(BillboardGetX(bb), BillboardGetY(bb), size, (Color) {0, 0, 255, 255});
+        }
 
         ListMoveToNext(map->billboards);
     }
 }
 
-void MapDraw3D(Map map, int screenWidth, int screenHeight) {
+// INTERNAL: distance (cells, along the view direction) of the floor or ceiling seen by a row of the 3D view: where the
+// bottom (or top) of a wall that far away would be drawn (see PlayerDraw3D)
+static double flatRowDistance(int y, int height) {
+    double offset = fabs(y + 0.5 - height / 2.0);
+    return 0.75 * height / (offset < 0.5 ? 0.5 : offset);
+}
+
+// INTERNAL: records the rows [firstRow, lastRow) of a flat of a color, a rectangle per run of rows at the same shade
+static void queueFlatRows(Map map, RenderQueue queue, Color color, int firstRow, int lastRow, int screenWidth, int screenHeight) {
+    int start = firstRow;
+    const colormapShade* shade = ColormapGetShade(map->colormap, flatRowDistance(firstRow, screenHeight), LIGHT_FULL);
+    for (int y = firstRow + 1; y <= lastRow; y++) {
+        const colormapShade* next = y < lastRow ? ColormapGetShade(map->colormap, flatRowDistance(y, screenHeight), LIGHT_FULL) : NULL;
+        if (y == lastRow || next != shade) {
+            RenderQueueRect(queue, (Rectangle) {0, (float) start, (float) screenWidth, (float) (y - start)}, ColormapApply(shade, color));
+            start = y;
+            shade = next;
+        }
+    }
+}
+
+void MapDraw3D(Map map, RenderQueue queue, int screenWidth, int screenHeight) {
+    assert(map != NULL);
+    assert(queue != NULL);
+
+    if (ColormapGetFogDepth(map->colormap) < 0) {
+        RenderQueueRect(queue, (Rectangle) {0, 0, (float) screenWidth, (float) (screenHeight/2)}, map->ceilingColor);
+        RenderQueueRect(queue, (Rectangle) {0, (float) (screenHeight/2), (float) screenWidth, (float) (screenHeight - screenHeight/2)}, map->groundColor);
+        return;
+    }
+
+    // In fog, bands of rows fading into it towards the horizon
+    if (screenHeight/2 > 0) {
+        queueFlatRows(map, queue, map->ceilingColor, 0, screenHeight/2, screenWidth, screenHeight);
+    }
+    queueFlatRows(map, queue, map->groundColor, screenHeight/2, screenHeight, screenWidth, screenHeight);
+}
+
+bool MapHasFlats(Map map) {
+    assert(map != NULL);
+
+    return map->numFlats > 1;
+}
+
+// A flat as sampled for a row by the floor caster: the mip level of its texture nearest to the row's scale
+typedef struct flatSampler {
+    const Color* texels;            // Column-major (texel (u, v) at u*height + v), like TextureCacheGetLevelColumns
+    int width;
+    int height;
+} flatSampler;
+
+// Looks up the flat IDs of cells, keeping the chunk of flats it last read
+typedef struct flatLookup {
+    ChunkGrid grid;                 // NULL if no flats are placed
+    int numRows;
+    int numCols;
+    int chunkRow;                   // Chunk last read (-1 before the first one)
+    int chunkCol;                   //
+    const unsigned short* ids;      // Its flat IDs (NULL if it has none placed)
+} flatLookup;
+
+// Work of a job of the floor caster: a band of floor rows, and the ceiling rows mirroring them
+typedef struct flatJob {
+    Map map;
+    Color* pixels;
+    int width;
+    int height;
+    int stride;                     // Of the frame buffer's rows
+    int firstRow;                   // Floor rows drawn (the ceiling row of floor row y is height-1-y)
+    int lastRow;                    // (exclusive)
+    const float* tangents;          // Tangent of the angle between each column and the view direction (count of them)
+    int count;                      // Width rounded up to a multiple of FLAT_BLOCK (the extra tangents repeat the last one)
+    double posX;                    // View position (cells)
+    double posY;                    //
+    double dirX;                    // View direction
+    double dirY;                    //
+    double pixelAngle;              // Angle between two columns
+} flatJob;
+
+// INTERNAL: flat ID of a cell (0 outside of the map, or if it has none placed)
+static inline int lookupFlat(flatLookup* lookup, int row, int col) {
+    if (lookup->grid == NULL || (unsigned) row >= (unsigned) lookup->numRows || (unsigned) col >= (unsigned) lookup->numCols) {
+        return 0;
+    }
+
+    if (row >> MAP_CHUNK_SHIFT != lookup->chunkRow || col >> MAP_CHUNK_SHIFT != lookup->chunkCol) {
+        lookup->chunkRow = row >> MAP_CHUNK_SHIFT;
+        lookup->chunkCol = col >> MAP_CHUNK_SHIFT;
+        lookup->ids = ChunkGridGetChunk(lookup->grid, lookup->chunkRow, lookup->chunkCol);
+    }
+
+    return lookup->ids != NULL ? lookup->ids[((row & MAP_CHUNK_MASK) << MAP_CHUNK_SHIFT) + (col & MAP_CHUNK_MASK)] : 0;
+}
+
+// INTERNAL: how a flat (ID, with 0 for the default one of the surface) is sampled where a pixel covers cellsPerPixel cells
+static flatSampler sampleFlat(Map map, int surface, int flat, double cellsPerPixel) {
+    if (flat == 0) {
+        flat = map->defaultFlats[surface];
+    }
+
+    // Colored flats, and textured ones while they have no CPU copy, are a single texel
+    TextureHandle texture = flat != 0 ? map->flats[flat].texture : NULL;
+    if (texture == NULL || TextureCacheGetNumLevels(texture) == 0) {
+        if (flat != 0 && texture == NULL) {
+            return (flatSampler) {&map->flats[flat].color, 1, 1};
+        }
+        return (flatSampler) {surface == FLAT_FLOOR ? &map->groundColor : &map->ceilingColor, 1, 1};
+    }
+
+    int width, height;
+    TextureCacheGetLevelColumns(texture, 0, &width, &height);
+    int level = TextureCacheSelectLevel(texture, (float) (cellsPerPixel * (width > height ? width : height)));
+
+    flatSampler sampler;
+    sampler.texels = TextureCacheGetLevelColumns(texture, level, &sampler.width, &sampler.height);
+    return sampler;
+}
+
+// INTERNAL: biased fixed-point cell coordinates of the pixels of a row (count, a multiple of FLAT_BLOCK). They are on a
+// line, at a distance along it proportional to the tangent of the column's angle: a multiply-add per pixel and
+// coordinate, with no dependency between pixels.
+static void stepFlatRow(int* restrict cellX, int* restrict cellY, const float* restrict tangents, int count,
+    float startX, float startY, float stepX, float stepY) {
+    for (int first = 0; first < count; first += FLAT_BLOCK) {
+        for (int x = first; x < first + FLAT_BLOCK; x++) {
+            cellX[x] = (int) ((startX + stepX * tangents[x]) * (1 << FLAT_FRAC_BITS));
+            cellY[x] = (int) ((startY + stepY * tangents[x]) * (1 << FLAT_FRAC_BITS));
+        }
+    }
+}
+
+// INTERNAL: same as stepFlatRow, for rows that see cells out of the range of the coordinates (clamped to it)
+static void stepFlatRowClamped(int* cellX, int* cellY, const float* tangents, int count, float startX, float startY, float stepX, float stepY) {
+    for (int x = 0; x < count; x++) {
+        float fx = startX + stepX * tangents[x];
+        float fy = startY + stepY * tangents[x];
+        fx = fx < 0 ? 0 : fx > (float) FLAT_MAX_COORD ? (float) FLAT_MAX_COORD : fx;
+        fy = fy < 0 ? 0 : fy > (float) FLAT_MAX_COORD ? (float) FLAT_MAX_COORD : fy;
+        cellX[x] = (int) (fx * (1 << FLAT_FRAC_BITS));
+        cellY[x] = (int) (fy * (1 << FLAT_FRAC_BITS));
+    }
+}
+
+// INTERNAL: whether a coordinate (biased, in cells) is in the range of the fixed-point ones
+static bool flatCoordInRange(float coord) {
+    return coord >= 0 && coord <= (float) FLAT_MAX_COORD;
+}
+
+// INTERNAL: run by the workers of MapDrawFlats
+static void drawFlatRows(void* arg) {
+    flatJob* job = arg;
+    Map map = job->map;
+    int width = job->width;
+    int count = job->count;
+
+    int* cellX = malloc(sizeof(int) * count * 2);   // Fixed-point cell coordinates of the row's pixels
+    int* cellY = cellX + count;                     //
+    flatSampler* samplers = malloc(sizeof(flatSampler) * map->numFlats * 2);
+    assert(cellX != NULL && samplers != NULL);
+    flatSampler* floorSamplers = samplers;
+    flatSampler* ceilingSamplers = samplers + map->numFlats;
+
+    int baseRow = (int) floor(job->posX) - FLAT_BIAS;    // Cell at the coordinates' origin
+    int baseCol = (int) floor(job->posY) - FLAT_BIAS;    //
+
+    flatLookup lookups[2];
+    for (int i = FLAT_FLOOR; i <= FLAT_CEILING; i++) {
+        lookups[i] = (flatLookup) {map->flatGrids[i], map->numRows, map->numCols, -1, -1, NULL};
+    }
+
+    double fogDepth = ColormapGetFogDepth(map->colormap);
+    Color fogColor = ColormapGetFogColor(map->colormap);
+
+    for (int y = job->firstRow; y < job->lastRow; y++) {
+        // The ceiling row mirroring the floor row sees the ceiling at the same distance
+        double offset = y + 0.5 - job->height / 2.0;
+        if (offset < 0.5) {
+            offset = 0.5;
+        }
+        double distance = flatRowDistance(y, job->height);
+
+        Color* floorRow = job->pixels + (size_t) y * job->stride;
+        Color* ceilingRow = job->pixels + (size_t) (job->height - 1 - y) * job->stride;
+
+        // Rows in full fog are not cast
+        if (fogDepth >= 0 && distance >= fogDepth) {
+            for (int x = 0; x < width; x++) {
+                floorRow[x] = fogColor;
+                ceilingRow[x] = fogColor;
+            }
+            continue;
+        }
+
+        // A pixel covers the most cells across the rows (between two columns) or along them (between two rows)
+        double cellsPerPixel = distance * job->pixelAngle > distance / offset ? distance * job->pixelAngle : distance / offset;
+        for (int i = 0; i < map->numFlats; i++) {
+            floorSamplers[i] = sampleFlat(map, FLAT_FLOOR, i, cellsPerPixel);
+            ceilingSamplers[i] = sampleFlat(map, FLAT_CEILING, i, cellsPerPixel);
+        }
+
+        // The coordinates are linear in the tangents, so the first and last columns are the furthest apart
+        float startX = (float) (job->posX - baseRow + distance * job->dirX);
+        float startY = (float) (job->posY - baseCol + distance * job->dirY);
+        float stepX = (float) (-distance * job->dirY);
+        float stepY = (float) (distance * job->dirX);
+        const float* tangents = job->tangents;
+        if (flatCoordInRange(startX + stepX * tangents[0]) && flatCoordInRange(startX + stepX * tangents[count - 1])
+            && flatCoordInRange(startY + stepY * tangents[0]) && flatCoordInRange(startY + stepY * tangents[count - 1])) {
+            stepFlatRow(cellX, cellY, tangents, count, startX, startY, stepX, stepY);
+        } else {
+            stepFlatRowClamped(cellX, cellY, tangents, count, startX, startY, stepX, stepY);
+        }
+
+        // Then each pixel is a texel of its cell's flat, at the row's shade
+        const colormapShade* shade = ColormapGetShade(map->colormap, distance, LIGHT_FULL);
+        for (int x = 0; x < width; x++) {
+            int row = (cellX[x] >> FLAT_FRAC_BITS) + baseRow;
+            int col = (cellY[x] >> FLAT_FRAC_BITS) + baseCol;
+            int fracX = cellX[x] & FLAT_FRAC_MASK;
+            int fracY = cellY[x] & FLAT_FRAC_MASK;
+
+            const flatSampler* s = &floorSamplers[lookupFlat(&lookups[FLAT_FLOOR], row, col)];
+            floorRow[x] = s->texels[((fracX * s->width) >> FLAT_FRAC_BITS) * s->height + ((fracY * s->height) >> FLAT_FRAC_BITS)];
+            s = &ceilingSamplers[lookupFlat(&lookups[FLAT_CEILING], row, col)];
+            ceilingRow[x] = s->texels[((fracX * s->width) >> FLAT_FRAC_BITS) * s->height + ((fracY * s->height) >> FLAT_FRAC_BITS)];
+        }
+        if (shade != NULL) {
+            for (int x = 0; x < width; x++) {
+                floorRow[x] = ColormapApply(shade, floorRow[x]);
+                ceilingRow[x] = ColormapApply(shade, ceilingRow[x]);
+            }
+        }
+    }
+
+    free(samplers);
+    free(cellX);
+}
+
+void MapDrawFlats(Map map, FrameBuffer fb, double posX, double posY, double rotation, double fov, WorkerPool pool) {
     assert(map != NULL);
+    assert(fb != NULL);
+
+    int width = FrameBufferGetWidth(fb);
+    int height = FrameBufferGetHeight(fb);
+
+    int count = (width + FLAT_BLOCK - 1) / FLAT_BLOCK * FLAT_BLOCK;
+    float* tangents = malloc(sizeof(float) * count);
+    assert(tangents != NULL);
+    for (int x = 0; x < count; x++) {
+        int column = x < width ? x : width - 1;
+        tangents[x] = width > 1 ? (float) tan(fov * ((double) column / (width - 1) - 0.5)) : 0;
+    }
 
-    DrawRectangle(0, 0, screenWidth, screenHeight/2, map->ceilingColor);
-    DrawRectangle(0, screenHeight/2, screenWidth, screenHeight/2, map->groundColor);
-}
\ No newline at end of file
+    // Bands of rows below the horizon, each with the rows above it that mirror them
+    int numRows = height - height / 2;
+    int numJobs = (numRows + FLAT_BAND_ROWS - 1) / FLAT_BAND_ROWS;
+    flatJob* jobs = malloc(sizeof(flatJob) * numJobs);
+    assert(jobs != NULL);
+    for (int i = 0; i < numJobs; i++) {
+        int firstRow = height / 2 + i * FLAT_BAND_ROWS;
+        jobs[i] = (flatJob) {
+            .map = map,
+            .pixels = FrameBufferGetPixels(fb),
+            .width = width,
+            .height = height,
+            .stride = FrameBufferGetStride(fb),
+            .firstRow = firstRow,
+            .lastRow = firstRow + FLAT_BAND_ROWS < height ? firstRow + FLAT_BAND_ROWS : height,
+            .tangents = tangents,
+            .count = count,
+            .posX = posX / map->tileSize,
+            .posY = posY / map->tileSize,
+            .dirX = cos(rotation),
+            .dirY = sin(rotation),
+            .pixelAngle = width > 1 ? fov / (width - 1) : fov,
+        };
+
+        if (pool != NULL) {
+            WorkerPoolSubmit(pool, drawFlatRows, &jobs[i]);
+        } else {
+            drawFlatRows(&jobs[i]);
+        }
+    }
+    if (pool != NULL) {
+        WorkerPoolWait(pool);
+    }
+
+    free(jobs);
+    free(tangents);
+}
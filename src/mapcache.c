@@ -0,0 +1,110 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "mapcache.h"
+#include "mapdata.h"
+#include "raylib.h"
+
+static bool cacheEnabled = true;
+
+// INTERNAL: 64-bit FNV-1a hash of a file's contents. Returns false if the file could not be read.
+static bool hashFile(const char* filename, unsigned long long* hash) {
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL) {
+        return false;
+    }
+
+    unsigned long long h = 14695981039346656037ULL;
+    unsigned char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            h ^= buffer[i];
+            h *= 1099511628211ULL;
+        }
+    }
+    fclose(file);
+
+    *hash = h;
+    return true;
+}
+
+// INTERNAL: path of the cache entry for a map file with that hash (the string is only valid until the next call)
+static const char* cachePath(const char* filename, unsigned long long hash) {
+    static char path[4096];
+
+    const char* dir = GetDirectoryPath(filename);
+    snprintf(path, sizeof(path), "%s/" MAPCACHE_DIR "/%s-%016llx.cmap", dir[0] != '\0' ? dir : ".", GetFileNameWithoutExt(filename), hash);
+
+    return path;
+}
+
+// INTERNAL: removes the cache entries of a map file other than the one at keep (they were made for older contents)
+static void removeOldEntries(const char* filename, const char* keep) {
+    char name[4096];
+    strncpy(name, GetFileNameWithoutExt(filename), sizeof(name)-1);
+    name[sizeof(name)-1] = '\0';
+    size_t nameLength = strlen(name);
+
+    FilePathList files = LoadDirectoryFiles(GetDirectoryPath(keep));
+    for (unsigned int i = 0; i < files.count; i++) {
+        // Entries are named "<name>-<16 hex digits>.cmap", so maps whose names start with this one are not matched
+        const char* entry = GetFileName(files.paths[i]);
+        if (strlen(entry) != nameLength + 1 + 16 + 5 || strncmp(entry, name, nameLength) != 0 || entry[nameLength] != '-'
+            || strspn(entry + nameLength + 1, "0123456789abcdef") != 16 || strcmp(entry + nameLength + 17, ".cmap") != 0) {
+            continue;
+        }
+
+        if (strcmp(entry, GetFileName(keep)) != 0 && remove(files.paths[i]) == 0) {
+            TraceLog(LOG_INFO, "MAPCACHE: [%s] Removed old cache entry %s", filename, entry);
+        }
+    }
+    UnloadDirectoryFiles(files);
+}
+
+MapData MapCacheLoad(const char* filename) {
+    assert(filename != NULL);
+
+    unsigned long long hash;
+    if (!cacheEnabled || !hashFile(filename, &hash)) {
+        return MapDataCreateFromFile(filename);
+    }
+
+    double start = GetTime();
+    char path[4096];
+    strncpy(path, cachePath(filename, hash), sizeof(path)-1);
+    path[sizeof(path)-1] = '\0';
+
+    if (MapDataGetCompiledVersion(path) == MAPDATA_VERSION) {
+        MapData data = MapDataLoadCompiled(path);
+        TraceLog(LOG_INFO, "MAPCACHE: [%s] Cache hit, loaded in %.2f ms", filename, (GetTime() - start)*1000.0);
+        return data;
+    }
+
+    MapData data = MapDataCreateFromFile(filename);
+    TraceLog(LOG_INFO, "MAPCACHE: [%s] Cache miss, parsed in %.2f ms", filename, (GetTime() - start)*1000.0);
+
+    // Store the entry. It is written to a temporary file first, so a half written entry is never loaded.
+    const char* dir = GetDirectoryPath(path);
+    if (!DirectoryExists(dir) && MakeDirectory(dir) != 0) {
+        TraceLog(LOG_WARNING, "MAPCACHE: [%s] Could not create the cache folder", filename);
+        return data;
+    }
+
+    removeOldEntries(filename, path);
+
+    char tmpPath[4096 + 4];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+    remove(path);
+    if (!MapDataSaveCompiled(data, tmpPath) || rename(tmpPath, path) != 0) {
+        remove(tmpPath);
+        TraceLog(LOG_WARNING, "MAPCACHE: [%s] Could not write the cache entry", filename);
+    }
+
+    return data;
+}
+
+void MapCacheSetEnabled(bool enabled) {
+    cacheEnabled = enabled;
+}
@@ -0,0 +1,1454 @@
+// fseeko and ftello, with 64-bit offsets on 32-bit systems too
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include "mapdata.h"
+#include "strutil.h"
+#include "loaderror.h"
+#include "mapparser.h"
+#include "hashmap.h"
+#include "list.h"
+#include "tile.h"
+#include "raylib.h"
+
+#define COMPILED_ERROR_STR "Error opening \"%s\": Compiled map file is truncated or corrupted.\n"
+
+// INTERNAL: fseek and ftell with 64-bit offsets (long is 32 bits on Windows, and compiled maps can be larger)
+static int fileSeek(FILE* file, unsigned long long offset) {
+#if defined(_WIN32)
+    return _fseeki64(file, (long long) offset, SEEK_SET);
+#else
+    return fseeko(file, (off_t) offset, SEEK_SET);
+#endif
+}
+
+static unsigned long long fileTell(FILE* file) {
+#if defined(_WIN32)
+    return (unsigned long long) _ftelli64(file);
+#else
+    return (unsigned long long) ftello(file);
+#endif
+}
+
+// INTERNAL: size of an open file, in bytes
+static unsigned long long fileSize(FILE* file) {
+#if defined(_WIN32)
+    _fseeki64(file, 0, SEEK_END);
+#else
+    fseeko(file, 0, SEEK_END);
+#endif
+    return fileTell(file);
+}
+
+static bool colorsEqual(Color c1, Color c2) {
+    return c1.r == c2.r && c1.g == c2.g && c1.b == c2.b && c1.a == c2.a;
+}
+
+// INTERNAL: creates an empty MapData with a GROUND tile definition
+static MapData createEmpty(void) {
+    MapData data = calloc(1, sizeof(struct mapdata));
+    assert(data != NULL);
+
+    data->numTileDefs = 1;
+    data->tileDefs = malloc(sizeof(mapTileDef));
+    assert(data->tileDefs != NULL);
+    data->tileDefs[TILE_GROUND] = (mapTileDef) {
+        .name = StringCopy("GROUND"),
+        .isTransparent = false,
+        .texture = -1,
+        .color = (Color) {0, 0, 0, 255},
+    };
+    data->floorDef = -1;
+    data->ceilingDef = -1;
+    data->fogColor = (Color) {0, 0, 0, 255};
+    data->fogDensity = 0;
+
+    return data;
+}
+
+// INTERNAL: returns the index of the texture with that path, adding it if it is new
+static int addTexture(MapData data, const char* path) {
+    for (int i = 0; i < data->numTextures; i++) {
+        if (strcmp(data->textures[i].path, path) == 0) {
+            return i;
+        }
+    }
+
+    data->textures = realloc(data->textures, sizeof(mapTexture) * (data->numTextures+1));
+    assert(data->textures != NULL);
+    data->textures[data->numTextures] = (mapTexture) {
+        .path = StringCopy(path),
+        .packed = NULL,
+        .packedSize = 0,
+    };
+
+    return data->numTextures++;
+}
+
+// INTERNAL: returns the index of the flat definition with that name (-1 if there is none)
+static int findFlatDef(MapData data, const char* name) {
+    for (int i = 0; i < data->numFlatDefs; i++) {
+        if (strcmp(data->flatDefs[i].name, name) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static Color parseColor(ParserElement element, const char* filename) {
+    if (element == NULL) { // Give default value
+        errno = -1;
+        return (Color) {0, 0, 0, 255};
+    } else if (ParserElementGetType(element) != LIST_TYPE) {  // Wrong because it was defined but with wrong type
+        fprintf(stderr, "Error opening \"%s\": %s must be an array of RGB(A) values (0-255 integers).\n", filename, ParserElementGetKey(element));
+        errno = -1;
+        return (Color) {0, 0, 0, 255};
+    }
+
+    List val = (List) ParserElementGetValue(element);
+    if (ListGetSize(val) != 3 && ListGetSize(val) != 4) {   // Wrong because of color definition
+        fprintf(stderr, "Error opening \"%s\": %s must be an array of RGB(A) values (0-255 integers).\n", filename, ParserElementGetKey(element));
+        errno = -1;
+        return (Color) {0, 0, 0, 255};
+    }
+
+    // Type checking
+    ListMoveToStart(val);
+    while (ListCanOperate(val)) {
+        ParserElement elem = (ParserElement) ListGetCurrent(val);
+
+        if (ParserElementGetType(elem) != INT_TYPE || (*(int*) ParserElementGetValue(elem)) < 0 || (*(int*) ParserElementGetValue(elem)) > 255) {
+            fprintf(stderr, "Error opening \"%s\": %s must be an array of RGB(A) values (0-255 integers).\n", filename, ParserElementGetKey(element));
+            errno = -1;
+            return (Color) {0, 0, 0, 255};
+        }
+        ListMoveToNext(val);
+    }
+
+    int r = *(int*) ParserElementGetValue(ListGet(val, 0));
+    int g = *(int*) ParserElementGetValue(ListGet(val, 1));
+    int b = *(int*) ParserElementGetValue(ListGet(val, 2));
+    int a = 255;
+    if (ListGetSize(val) == 4) {
+        a = *(int*) ParserElementGetValue(ListGet(val, 3));
+    }
+    return (Color) {(unsigned char) r, (unsigned char) g, (unsigned char) b, (unsigned char) a};
+}
+
+MapData MapDataCreateFromFile(const char* filename) {
+    assert(filename != NULL);
+
+    MapData data = createEmpty();
+
+    MapParser parser = MapParserCreate(filename);
+    ParserResult res = MapParserParse(parser);
+
+    ParserTable mapSettings = ParserResultGetTable(res, "MapSettings");
+    ParserTable tileDefinition = ParserResultGetTable(res, "TileDefinition");
+    ParserTable tilePlacing = ParserResultGetTable(res, "TilePlacing");
+    ParserTable billboardDefinition = ParserResultGetTable(res, "BillboardDefinition");
+    ParserTable billboardPlacing = ParserResultGetTable(res, "BillboardPlacing");
+    ParserTable flatDefinition = ParserResultGetTable(res, "FlatDefinition");     // Optional
+    ParserTable flatPlacing = ParserResultGetTable(res, "FlatPlacing");           // Optional
+    if (mapSettings == NULL) {
+        fprintf(stderr, "Error opening \"%s\": No table named \"MapSettings\".\n", filename);
+        LoadErrorFail();
+    }
+    if (tileDefinition == NULL) {
+        fprintf(stderr, "Error opening \"%s\": No table named \"TileDefinition\".\n", filename);
+        LoadErrorFail();
+    }
+    if (tilePlacing == NULL) {
+        fprintf(stderr, "Error opening \"%s\": No table named \"TilePlacing\".\n", filename);
+        LoadErrorFail();
+    }
+    if (billboardDefinition == NULL) {
+        fprintf(stderr, "Error opening \"%s\": No table named \"BillboardDefinition\".\n", filename);
+        LoadErrorFail();
+    }
+    if (billboardPlacing == NULL) {
+        fprintf(stderr, "Error opening \"%s\": No table named \"BillboardPlacing\".\n", filename);
+        LoadErrorFail();
+    }
+
+    // Map dimensions
+    ParserElement e = ParserTableGetElement(mapSettings, "mapSize");
+    if (e == NULL || ParserElementGetType(e) != LIST_TYPE) {
+        fprintf(stderr, "Error opening \"%s\": MapSettings must have a \"mapSize\" list parameter.\n", filename);
+        LoadErrorFail();
+    }
+    List val = ParserElementGetValue(e);
+    if (ListGetSize(val) != 2 || ParserElementGetType(ListGet(val, 0)) != INT_TYPE || ParserElementGetType(ListGet(val, 1)) != INT_TYPE) {
+        fprintf(stderr, "Error opening \"%s\": mapSize must be [sizeX, sizeY] (both positive integers).\n", filename);
+        LoadErrorFail();
+    }
+
+    data->numRows = *(int*) ParserElementGetValue(ListGet(val, 0));
+    data->numCols = *(int*) ParserElementGetValue(ListGet(val, 1));
+    if (data->numRows <= 0 || data->numCols <= 0) {
+        fprintf(stderr, "Error opening \"%s\": mapSize must be [sizeX, sizeY] (both positive integers).\n", filename);
+        LoadErrorFail();
+    }
+
+    data->grid = calloc((size_t) data->numRows * data->numCols, sizeof(int));
+    assert(data->grid != NULL);
+
+    // Tile dimensions
+    e = ParserTableGetElement(mapSettings, "tileSize");
+    if (e == NULL || ParserElementGetType(e) != INT_TYPE) {
+        fprintf(stderr, "Error opening \"%s\": MapSettings must have a \"tileSize\" integer parameter.\n", filename);
+        LoadErrorFail();
+    }
+
+    data->tileSize = *(int*) ParserElementGetValue(e);
+    if (data->tileSize <= 0) {
+        fprintf(stderr, "Error opening \"%s\": MapSettings must have a \"tileSize\" positive integer parameter.\n", filename);
+        LoadErrorFail();
+    }
+
+    // Ceiling color
+    data->ceilingColor = parseColor(ParserTableGetElement(mapSettings, "ceilingColor"), filename);
+
+    // Ground color
+    data->groundColor = parseColor(ParserTableGetElement(mapSettings, "groundColor"), filename);
+
+    // Fog (none unless a density is given)
+    data->fogColor = parseColor(ParserTableGetElement(mapSettings, "fogColor"), filename);
+    e = ParserTableGetElement(mapSettings, "fogDensity");
+    if (e != NULL) {
+        if (ParserElementGetType(e) == FLOAT_TYPE) {
+            data->fogDensity = (float) *(double*) ParserElementGetValue(e);
+        } else if (ParserElementGetType(e) == INT_TYPE) {
+            data->fogDensity = (float) *(int*) ParserElementGetValue(e);
+        } else {
+            data->fogDensity = -1;
+        }
+        if (data->fogDensity < 0) {
+            fprintf(stderr, "Error opening \"%s\": \"fogDensity\" must be a number that is not negative.\n", filename);
+            LoadErrorFail();
+        }
+    }
+
+    // Tile definitions (IDs are given in definition iteration order, starting after GROUND)
+    HashMap tiledefs = ParserTableGetHashMap(tileDefinition);
+    HashMapIterator iter = HashMapGetIterator(tiledefs);
+    while (HashMapIterCanOperate(iter)) {
+        ParserElement tile = (ParserElement) HashMapIterGetCurrentValue(iter);
+        char* n = ParserElementGetKey(tile);
+
+        if (ParserElementGetType(tile) != TABLE_TYPE) {
+            fprintf(stderr, "Error opening \"%s\": In TileDefinition, only tiles can be defined ({surface: SURFACE, <options>...}).\n", filename);
+            LoadErrorFail();
+        }
+
+        HashMap tilestuff = (HashMap) ParserElementGetValue(tile);
+        if (!HashMapContains(tilestuff, "surface")) {
+            fprintf(stderr, "Error opening \"%s\": Tile \"%s\" has no attribute \"surface\".\n", filename, n);
+            LoadErrorFail();
+        }
+
+        mapTileDef def = {
+            .name = NULL,
+            .isTransparent = false,
+            .texture = -1,
+            .color = (Color) {0, 0, 0, 255},
+        };
+
+        ParserElement tileSurface = (ParserElement) HashMapGet(tilestuff, "surface");
+        if (ParserElementGetType(tileSurface) == STRING_TYPE) { // Is a file name
+            // Handle transparency (TODO: change this to be less ugly)
+            ParserElement transparencyelem = HashMapGet(tilestuff, "transparent");
+            if (transparencyelem != NULL && ParserElementGetType(transparencyelem) != BOOL_TYPE) {
+                fprintf(stderr, "Error opening \"%s\": Tile transparency must be represented by a bool value! (in tile \"%s\")\n", filename, n);
+                LoadErrorFail();
+            } else if (transparencyelem != NULL) {
+                def.isTransparent = *(bool*) ParserElementGetValue(transparencyelem);
+            }
+
+            def.texture = addTexture(data, (char*) ParserElementGetValue(tileSurface));
+        } else { // Might be a color
+            errno = 0;
+            def.color = parseColor(tileSurface, filename);
+
+            if (errno != 0) {   // Not a color, so surface is wrong
+                fprintf(stderr, "Error opening \"%s\": Tile surfaces must be either a string file name or a color! (in tile \"%s\")\n", filename, n);
+                LoadErrorFail();
+            }
+        }
+
+        if (strcmp(n, data->tileDefs[TILE_GROUND].name) == 0) { // Duplicate checking
+            fprintf(stderr, "Error opening \"%s\": Tile name \"%s\" is reserved.\n", filename, n);
+            LoadErrorFail();
+        }
+        def.name = StringCopy(n);
+
+        data->tileDefs = realloc(data->tileDefs, sizeof(mapTileDef) * (data->numTileDefs+1));
+        assert(data->tileDefs != NULL);
+        data->tileDefs[data->numTileDefs++] = def;
+
+        HashMapIterGoToNext(iter);
+    }
+    HashMapIterDestroy(&iter);
+
+    // Associates tile names to their IDs (the array is complete, so the pointers are stable)
+    int* tileIDs = malloc(sizeof(int) * data->numTileDefs);
+    assert(tileIDs != NULL);
+    HashMap tileNameMap = HashMapCreate(5, StringHash, StringEquals);
+    for (int i = 1; i < data->numTileDefs; i++) {
+        tileIDs[i] = i;
+        HashMapPut(tileNameMap, data->tileDefs[i].name, &tileIDs[i]);
+    }
+
+    // Tile placements
+    ParserElement tiles = ParserTableGetElement(tilePlacing, "Tiles");
+    if (tiles != NULL) {
+        if (ParserElementGetType(tiles) != LIST_TYPE) {
+            fprintf(stderr, "Error opening \"%s\": \"Tiles\" parameter must be a list of [int tileX, int tileY, string tileName].\n", filename);
+            LoadErrorFail();
+        }
+
+        List tileList = (List) ParserElementGetValue(tiles);
+        ListMoveToStart(tileList);
+        while (ListCanOperate(tileList)) {
+            if (ParserElementGetType(ListGetCurrent(tileList)) != LIST_TYPE) {
+                fprintf(stderr, "Error opening \"%s\": \"Tiles\" parameter must be a list of [int tileX, int tileY, string tileName].\n", filename);
+                LoadErrorFail();
+            }
+
+            // Verify tile placement list semantics
+            List tilePlacement = (List) ParserElementGetValue(ListGetCurrent(tileList));
+            if (ListGetSize(tilePlacement) != 3 || ParserElementGetType(ListGet(tilePlacement, 0)) != INT_TYPE || ParserElementGetType(ListGet(tilePlacement, 1)) != INT_TYPE || ParserElementGetType(ListGet(tilePlacement, 2)) != STRING_TYPE) {
+                fprintf(stderr, "Error opening \"%s\": \"Tiles\" parameter must be a list of [int tileX, int tileY, string tileName].\n", filename);
+                LoadErrorFail();
+            }
+
+            int tileX = *((int*) ParserElementGetValue(ListGet(tilePlacement, 0)));
+            int tileY = *((int*) ParserElementGetValue(ListGet(tilePlacement, 1)));
+            char* tileName = (char*) ParserElementGetValue(ListGet(tilePlacement, 2));
+
+            if (tileX < 0 || tileX >= data->numRows || tileY < 0 || tileY >= data->numCols) {
+                fprintf(stderr, "Error opening \"%s\": Tile \"%s\" placed outside of the map, at [%d, %d].\n", filename, tileName, tileX, tileY);
+                LoadErrorFail();
+            }
+
+            int* tileID = (int*) HashMapGet(tileNameMap, tileName);
+            if (tileID == NULL) {
+                fprintf(stderr, "Error opening \"%s\": Tile \"%s\" placed at [%d, %d] was never defined.\n", filename, tileName, tileX, tileY);
+                LoadErrorFail();
+            }
+
+            data->grid[tileX*data->numCols + tileY] = *tileID;
+
+            ListMoveToNext(tileList);
+        }
+    } else {
+        fprintf(stderr, "Warning opening \"%s\": No parameter \"Tiles\" was given in table \"TilePlacing\", so the map will be blank.\n", filename);
+    }
+
+    HashMapDestroy(&tileNameMap);
+    free(tileIDs);
+
+    // Billboard definitions
+    HashMap billboard_defs = ParserTableGetHashMap(billboardDefinition);
+    HashMapIterator billboard_defs_iter = HashMapGetIterator(billboard_defs);
+
+    while (HashMapIterCanOperate(billboard_defs_iter)) {
+        ParserElement def = HashMapIterGetCurrentValue(billboard_defs_iter);
+        char* n = ParserElementGetKey(def);
+
+        if (ParserElementGetType(def) != TABLE_TYPE) {
+            fprintf(stderr, "Warning opening \"%s\": In BillboardDefinition, only billboards can be defined ({surface: SURFACE, <options>...}).\n", filename);
+            LoadErrorFail();
+        }
+
+        HashMap defMap = ParserElementGetValue(def);
+        if (!HashMapContains(defMap, "surface")) {
+            fprintf(stderr, "Error opening \"%s\": Tile \"%s\" has no attribute \"surface\".\n", filename, n);
+            LoadErrorFail();
+        }
+
+        ParserElement surfaceEl = (ParserElement) HashMapGet(defMap, "surface");
+        if (ParserElementGetType(surfaceEl) != STRING_TYPE) { // TODO: this could also MAYBE be a color, since its possible when defining the same attribute in a tile
+            fprintf(stderr, "Error opening \"%s\": Billboard surfaces must be a string file name! (in tile \"%s\")\n", filename, n);
+            LoadErrorFail();
+        }
+
+        data->billboardDefs = realloc(data->billboardDefs, sizeof(mapBillboardDef) * (data->numBillboardDefs+1));
+        assert(data->billboardDefs != NULL);
+        data->billboardDefs[data->numBillboardDefs++] = (mapBillboardDef) {
+            .name = StringCopy(n),
+            .texture = addTexture(data, (char*) ParserElementGetValue(surfaceEl)),
+        };
+
+        HashMapIterGoToNext(billboard_defs_iter);
+    }
+
+    HashMapIterDestroy(&billboard_defs_iter);
+
+    // Billboard placements
+    ParserElement billboardsEl = ParserTableGetElement(billboardPlacing, "Billboards");
+    if (billboardsEl == NULL) {
+        fprintf(stderr, "Warning opening \"%s\": No parameter \"Billboards\" was given in table \"BillboardPlacing\", so the map will be blank.\n", filename);
+    } else if (ParserElementGetType(billboardsEl) != LIST_TYPE) {
+        fprintf(stderr, "Error opening \"%s\": \"Billboards\" parameter must be a list of [int bbX, int bbY, string bbName].\n", filename);
+        LoadErrorFail();
+    } else {
+        List billboards = ParserElementGetValue(billboardsEl);
+        ListMoveToStart(billboards);
+        while (ListCanOperate(billboards)) {
+            ParserElement bbEl = ListGetCurrent(billboards);
+
+            if (ParserElementGetType(bbEl) != LIST_TYPE) {
+                fprintf(stderr, "Error opening \"%s\": \"Billboards\" parameter must be a list of [int bbX, int bbY, string bbName].\n", filename);
+                LoadErrorFail();
+            }
+
+            // Verify billboard placement list semantics
+            List bbPlacement = (List) ParserElementGetValue(bbEl);
+
+            if (ListGetSize(bbPlacement) != 3 || ParserElementGetType(ListGet(bbPlacement, 0)) != INT_TYPE || ParserElementGetType(ListGet(bbPlacement, 1)) != INT_TYPE || ParserElementGetType(ListGet(bbPlacement, 2)) != STRING_TYPE) {
+                fprintf(stderr, "Error opening \"%s\": \"Billboards\" parameter must be a list of [int tileX, int tileY, string tileName].\n", filename);
+                LoadErrorFail();
+            }
+
+            mapBillboard bb = {
+                .posX = *((int*) ParserElementGetValue(ListGet(bbPlacement, 0))),
+                .posY = *((int*) ParserElementGetValue(ListGet(bbPlacement, 1))),
+                .def = -1,
+            };
+            char* bbName = (char*) ParserElementGetValue(ListGet(bbPlacement, 2));
+
+            for (int i = 0; i < data->numBillboardDefs; i++) {
+                if (strcmp(data->billboardDefs[i].name, bbName) == 0) {
+                    bb.def = i;
+                    break;
+                }
+            }
+            if (bb.def == -1) {
+                fprintf(stderr, "Error opening \"%s\": Billboard \"%s\" placed at [%d, %d] was never defined.\n", filename, bbName, bb.posX, bb.posY);
+                LoadErrorFail();
+            }
+            if (bb.posX < 0 || bb.posX >= data->numRows*data->tileSize || bb.posY < 0 || bb.posY >= data->numCols*data->tileSize) {
+                fprintf(stderr, "Error opening \"%s\": Billboard \"%s\" placed outside of the map, at [%d, %d].\n", filename, bbName, bb.posX, bb.posY);
+                LoadErrorFail();
+            }
+
+            data->billboards = realloc(data->billboards, sizeof(mapBillboard) * (data->numBillboards+1));
+            assert(data->billboards != NULL);
+            data->billboards[data->numBillboards++] = bb;
+
+            ListMoveToNext(billboards);
+        }
+    }
+
+    // Flat (floor and ceiling) definitions
+    if (flatDefinition != NULL) {
+        HashMapIterator flat_defs_iter = HashMapGetIterator(ParserTableGetHashMap(flatDefinition));
+        while (HashMapIterCanOperate(flat_defs_iter)) {
+            ParserElement def = HashMapIterGetCurrentValue(flat_defs_iter);
+            char* n = ParserElementGetKey(def);
+
+            if (ParserElementGetType(def) != TABLE_TYPE) {
+                fprintf(stderr, "Error opening \"%s\": In FlatDefinition, only flats can be defined ({surface: SURFACE}).\n", filename);
+                LoadErrorFail();
+            }
+
+            HashMap defMap = ParserElementGetValue(def);
+            if (!HashMapContains(defMap, "surface")) {
+                fprintf(stderr, "Error opening \"%s\": Flat \"%s\" has no attribute \"surface\".\n", filename, n);
+                LoadErrorFail();
+            }
+
+            mapFlatDef flat = {
+                .name = NULL,
+                .texture = -1,
+                .color = (Color) {0, 0, 0, 255},
+            };
+
+            ParserElement surfaceEl = (ParserElement) HashMapGet(defMap, "surface");
+            if (ParserElementGetType(surfaceEl) == STRING_TYPE) {
+                flat.texture = addTexture(data, (char*) ParserElementGetValue(surfaceEl));
+            } else {
+                errno = 0;
+                flat.color = parseColor(surfaceEl, filename);
+
+                if (errno != 0) {
+                    fprintf(stderr, "Error opening \"%s\": Flat surfaces must be either a string file name or a color! (in flat \"%s\")\n", filename, n);
+                    LoadErrorFail();
+                }
+            }
+            flat.name = StringCopy(n);
+
+            data->flatDefs = realloc(data->flatDefs, sizeof(mapFlatDef) * (data->numFlatDefs+1));
+            assert(data->flatDefs != NULL);
+            data->flatDefs[data->numFlatDefs++] = flat;
+
+            HashMapIterGoToNext(flat_defs_iter);
+        }
+        HashMapIterDestroy(&flat_defs_iter);
+    }
+
+    // Default floor and ceiling (the colors, unless a flat is named)
+    char* defaultNames[2] = {"floor", "ceiling"};
+    int* defaultDefs[2] = {&data->floorDef, &data->ceilingDef};
+    for (int i = 0; i < 2; i++) {
+        ParserElement defaultEl = ParserTableGetElement(mapSettings, defaultNames[i]);
+        if (defaultEl == NULL) {
+            continue;
+        }
+        if (ParserElementGetType(defaultEl) != STRING_TYPE) {
+            fprintf(stderr, "Error opening \"%s\": \"%s\" must be the name of a flat.\n", filename, defaultNames[i]);
+            LoadErrorFail();
+        }
+
+        char* flatName = (char*) ParserElementGetValue(defaultEl);
+        *defaultDefs[i] = findFlatDef(data, flatName);
+        if (*defaultDefs[i] == -1) {
+            fprintf(stderr, "Error opening \"%s\": Flat \"%s\" used as the %s was never defined.\n", filename, flatName, defaultNames[i]);
+            LoadErrorFail();
+        }
+    }
+
+    // Flat placements: Floors and Ceilings
+    char* placingNames[2] = {"Floors", "Ceilings"};
+    for (int i = 0; i < 2 && flatPlacing != NULL; i++) {
+        ParserElement flatsEl = ParserTableGetElement(flatPlacing, placingNames[i]);
+        if (flatsEl == NULL) {
+            continue;
+        }
+        if (ParserElementGetType(flatsEl) != LIST_TYPE) {
+            fprintf(stderr, "Error opening \"%s\": \"%s\" parameter must be a list of [int tileX, int tileY, string flatName].\n", filename, placingNames[i]);
+            LoadErrorFail();
+        }
+
+        List flatList = ParserElementGetValue(flatsEl);
+        ListMoveToStart(flatList);
+        while (ListCanOperate(flatList)) {
+            ParserElement flatEl = ListGetCurrent(flatList);
+            List flatPlacement = ParserElementGetType(flatEl) == LIST_TYPE ? (List) ParserElementGetValue(flatEl) : NULL;
+            if (flatPlacement == NULL || ListGetSize(flatPlacement) != 3 || ParserElementGetType(ListGet(flatPlacement, 0)) != INT_TYPE || ParserElementGetType(ListGet(flatPlacement, 1)) != INT_TYPE || ParserElementGetType(ListGet(flatPlacement, 2)) != STRING_TYPE) {
+                fprintf(stderr, "Error opening \"%s\": \"%s\" parameter must be a list of [int tileX, int tileY, string flatName].\n", filename, placingNames[i]);
+                LoadErrorFail();
+            }
+
+            mapFlat flat = {
+                .row = *((int*) ParserElementGetValue(ListGet(flatPlacement, 0))),
+                .col = *((int*) ParserElementGetValue(ListGet(flatPlacement, 1))),
+                .def = -1,
+                .isCeiling = i == 1,
+            };
+            char* flatName = (char*) ParserElementGetValue(ListGet(flatPlacement, 2));
+
+            flat.def = findFlatDef(data, flatName);
+            if (flat.def == -1) {
+                fprintf(stderr, "Error opening \"%s\": Flat \"%s\" placed at [%d, %d] was never defined.\n", filename, flatName, flat.row, flat.col);
+                LoadErrorFail();
+            }
+            if (flat.row < 0 || flat.row >= data->numRows || flat.col < 0 || flat.col >= data->numCols) {
+                fprintf(stderr, "Error opening \"%s\": Flat \"%s\" placed outside of the map, at [%d, %d].\n", filename, flatName, flat.row, flat.col);
+                LoadErrorFail();
+            }
+
+            data->flats = realloc(data->flats, sizeof(mapFlat) * (data->numFlats+1));
+            assert(data->flats != NULL);
+            data->flats[data->numFlats++] = flat;
+
+            ListMoveToNext(flatList);
+        }
+    }
+
+    // Cleanup
+    ParserResultDestroy(&res);
+    MapParserDestroy(&parser);
+
+    return data;
+}
+
+void MapDataDestroy(MapData* datap) {
+    assert(datap != NULL);
+    assert(*datap != NULL);
+
+    MapData data = *datap;
+
+    for (int i = 0; i < data->numTextures; i++) {
+        free(data->textures[i].path);
+        free(data->textures[i].packed);
+    }
+    free(data->textures);
+
+    for (int i = 0; i < data->numTileDefs; i++) {
+        free(data->tileDefs[i].name);
+    }
+    free(data->tileDefs);
+
+    for (int i = 0; i < data->numBillboardDefs; i++) {
+        free(data->billboardDefs[i].name);
+    }
+    free(data->billboardDefs);
+
+    for (int i = 0; i < data->numFlatDefs; i++) {
+        free(data->flatDefs[i].name);
+    }
+    free(data->flatDefs);
+    free(data->flats);
+
+    free(data->billboards);
+    free(data->chunks);
+    free(data->grid);
+    free(data->distance);
+    free(data);
+
+    *datap = NULL;
+}
+
+int MapDataGetTile(MapData data, int row, int col) {
+    assert(data != NULL);
+    if (row >= data->numRows || row < 0 || col >= data->numCols || col < 0) {
+        return TILE_GROUND;
+    }
+
+    return data->grid[row*data->numCols + col];
+}
+
+int MapDataOptimize(MapData data) {
+    assert(data != NULL);
+
+    size_t numCells = (size_t) data->numRows * data->numCols;
+
+    // Which tile definitions are actually placed
+    bool* used = calloc(data->numTileDefs, sizeof(bool));
+    assert(used != NULL);
+    used[TILE_GROUND] = true;
+    for (size_t i = 0; i < numCells; i++) {
+        used[data->grid[i]] = true;
+    }
+
+    // Remap tile IDs: duplicates take the ID of the first equal definition, unused ones are dropped
+    int* remap = malloc(sizeof(int) * data->numTileDefs);
+    assert(remap != NULL);
+    int numKept = 0;
+    for (int i = 0; i < data->numTileDefs; i++) {
+        mapTileDef* def = &data->tileDefs[i];
+        remap[i] = -1;
+        if (!used[i]) {
+            free(def->name);
+            def->name = NULL;
+            continue;
+        }
+
+        for (int j = 1; j < numKept && i != TILE_GROUND; j++) {
+            mapTileDef* kept = &data->tileDefs[j];
+            bool sameSurface = def->texture >= 0 ? kept->texture == def->texture : kept->texture < 0 && colorsEqual(kept->color, def->color);
+            if (sameSurface && kept->isTransparent == def->isTransparent) {
+                remap[i] = j;
+                break;
+            }
+        }
+        if (remap[i] != -1) {
+            free(def->name);
+            def->name = NULL;
+            continue;
+        }
+
+        // Kept definitions are compacted towards the start of the array (j <= i, so nothing unread is overwritten)
+        mapTileDef moved = *def;
+        def->name = NULL;
+        data->tileDefs[numKept] = moved;
+        remap[i] = numKept++;
+    }
+    int removed = data->numTileDefs - numKept;
+    data->numTileDefs = numKept;
+
+    for (size_t i = 0; i < numCells; i++) {
+        data->grid[i] = remap[data->grid[i]];
+    }
+
+    free(remap);
+    free(used);
+
+    // Billboard definitions: same treatment, but duplicates are the ones with the same texture
+    used = calloc(data->numBillboardDefs + 1, sizeof(bool));
+    assert(used != NULL);
+    for (int i = 0; i < data->numBillboards; i++) {
+        used[data->billboards[i].def] = true;
+    }
+    remap = malloc(sizeof(int) * (data->numBillboardDefs + 1));
+    assert(remap != NULL);
+    numKept = 0;
+    for (int i = 0; i < data->numBillboardDefs; i++) {
+        remap[i] = -1;
+        if (!used[i]) {
+            free(data->billboardDefs[i].name);
+            continue;
+        }
+
+        for (int j = 0; j < numKept; j++) {
+            if (data->billboardDefs[j].texture == data->billboardDefs[i].texture) {
+                remap[i] = j;
+                break;
+            }
+        }
+        if (remap[i] != -1) {
+            free(data->billboardDefs[i].name);
+            continue;
+        }
+
+        data->billboardDefs[numKept] = data->billboardDefs[i];
+        remap[i] = numKept++;
+    }
+    data->numBillboardDefs = numKept;
+
+    for (int i = 0; i < data->numBillboards; i++) {
+        data->billboards[i].def = remap[data->billboards[i].def];
+    }
+
+    free(remap);
+    free(used);
+
+    // Textures: drop the ones nothing refers to anymore
+    used = calloc(data->numTextures + 1, sizeof(bool));
+    assert(used != NULL);
+    for (int i = 0; i < data->numTileDefs; i++) {
+        if (data->tileDefs[i].texture >= 0) {
+            used[data->tileDefs[i].texture] = true;
+        }
+    }
+    for (int i = 0; i < data->numBillboardDefs; i++) {
+        used[data->billboardDefs[i].texture] = true;
+    }
+    for (int i = 0; i < data->numFlatDefs; i++) {
+        if (data->flatDefs[i].texture >= 0) {
+            used[data->flatDefs[i].texture] = true;
+        }
+    }
+    remap = malloc(sizeof(int) * (data->numTextures + 1));
+    assert(remap != NULL);
+    numKept = 0;
+    for (int i = 0; i < data->numTextures; i++) {
+        if (!used[i]) {
+            free(data->textures[i].path);
+            free(data->textures[i].packed);
+            remap[i] = -1;
+            continue;
+        }
+
+        data->textures[numKept] = data->textures[i];
+        remap[i] = numKept++;
+    }
+    data->numTextures = numKept;
+
+    for (int i = 0; i < data->numTileDefs; i++) {
+        if (data->tileDefs[i].texture >= 0) {
+            data->tileDefs[i].texture = remap[data->tileDefs[i].texture];
+        }
+    }
+    for (int i = 0; i < data->numBillboardDefs; i++) {
+        data->billboardDefs[i].texture = remap[data->billboardDefs[i].texture];
+    }
+    for (int i = 0; i < data->numFlatDefs; i++) {
+        if (data->flatDefs[i].texture >= 0) {
+            data->flatDefs[i].texture = remap[data->flatDefs[i].texture];
+        }
+    }
+
+    free(remap);
+    free(used);
+
+    return removed;
+}
+
+typedef struct billboardKey {
+    long cell;
+    int idx;
+} billboardKey;
+
+static int compareBillboardKeys(const void* k1, const void* k2) {
+    const billboardKey* key1 = k1;
+    const billboardKey* key2 = k2;
+
+    if (key1->cell != key2->cell) {
+        return key1->cell < key2->cell ? -1 : 1;
+    }
+    return key1->idx - key2->idx;
+}
+
+void MapDataSortBillboards(MapData data) {
+    assert(data != NULL);
+
+    if (data->numBillboards == 0) {
+        return;
+    }
+
+    billboardKey* keys = malloc(sizeof(billboardKey) * data->numBillboards);
+    assert(keys != NULL);
+    for (int i = 0; i < data->numBillboards; i++) {
+        int gridX = data->billboards[i].posX / data->tileSize;
+        int gridY = data->billboards[i].posY / data->tileSize;
+        keys[i] = (billboardKey) {(long) gridX * data->numCols + gridY, i};
+    }
+    qsort(keys, data->numBillboards, sizeof(billboardKey), compareBillboardKeys);
+
+    mapBillboard* sorted = malloc(sizeof(mapBillboard) * data->numBillboards);
+    assert(sorted != NULL);
+    for (int i = 0; i < data->numBillboards; i++) {
+        sorted[i] = data->billboards[keys[i].idx];
+    }
+
+    free(data->billboards);
+    data->billboards = sorted;
+    free(keys);
+}
+
+void MapDataComputeDistances(MapData data) {
+    assert(data != NULL);
+
+    size_t numCells = (size_t) data->numRows * data->numCols;
+    if (data->distance == NULL) {
+        data->distance = malloc(numCells);
+        assert(data->distance != NULL);
+    }
+
+    // Two pass chamfer transform. With every neighbour (diagonals included) at 1, it is exact for the Chebyshev distance
+    int rows = data->numRows;
+    int cols = data->numCols;
+    unsigned char* dist = data->distance;
+    for (size_t i = 0; i < numCells; i++) {
+        dist[i] = data->grid[i] != TILE_GROUND ? 0 : 255;
+    }
+
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < cols; c++) {
+            int d = dist[(size_t) r*cols + c];
+            if (r > 0) {
+                if (dist[(size_t) (r-1)*cols + c] + 1 < d) d = dist[(size_t) (r-1)*cols + c] + 1;
+                if (c > 0 && dist[(size_t) (r-1)*cols + c-1] + 1 < d) d = dist[(size_t) (r-1)*cols + c-1] + 1;
+                if (c < cols-1 && dist[(size_t) (r-1)*cols + c+1] + 1 < d) d = dist[(size_t) (r-1)*cols + c+1] + 1;
+            }
+            if (c > 0 && dist[(size_t) r*cols + c-1] + 1 < d) d = dist[(size_t) r*cols + c-1] + 1;
+            dist[(size_t) r*cols + c] = (unsigned char) d;
+        }
+    }
+    for (int r = rows-1; r >= 0; r--) {
+        for (int c = cols-1; c >= 0; c--) {
+            int d = dist[(size_t) r*cols + c];
+            if (r < rows-1) {
+                if (dist[(size_t) (r+1)*cols + c] + 1 < d) d = dist[(size_t) (r+1)*cols + c] + 1;
+                if (c > 0 && dist[(size_t) (r+1)*cols + c-1] + 1 < d) d = dist[(size_t) (r+1)*cols + c-1] + 1;
+                if (c < cols-1 && dist[(size_t) (r+1)*cols + c+1] + 1 < d) d = dist[(size_t) (r+1)*cols + c+1] + 1;
+            }
+            if (c < cols-1 && dist[(size_t) r*cols + c+1] + 1 < d) d = dist[(size_t) r*cols + c+1] + 1;
+            dist[(size_t) r*cols + c] = (unsigned char) d;
+        }
+    }
+}
+
+bool MapDataPackTextures(MapData data, const char* mapDir) {
+    assert(data != NULL);
+    assert(mapDir != NULL);
+
+    for (int i = 0; i < data->numTextures; i++) {
+        mapTexture* tex = &data->textures[i];
+        if (tex->packed != NULL) {
+            continue;
+        }
+
+        const char* path = mapDir[0] != '\0' ? TextFormat("%s/%s", mapDir, tex->path) : tex->path;
+        int size = 0;
+        unsigned char* fileData = LoadFileData(path, &size);
+        if (fileData == NULL || size <= 0) {
+            fprintf(stderr, "Error packing texture \"%s\": could not read the file.\n", path);
+            return false;
+        }
+
+        // Keep our own copy, so it can be freed like everything else in MapData
+        tex->packed = malloc(size);
+        assert(tex->packed != NULL);
+        memcpy(tex->packed, fileData, size);
+        tex->packedSize = size;
+        UnloadFileData(fileData);
+    }
+
+    return true;
+}
+
+
+// Compiled map files
+//
+// All integers are little-endian. Strings are an u32 length followed by that many chars (no terminator).
+//
+//   char[4]  magic ("RCMP")
+//   u32      version
+//   i32      numRows, numCols, tileSize
+//   u8[4]    ceilingColor, groundColor, fogColor (RGBA)
+//   f32      fogDensity (IEEE 754, stored as an u32)
+//   u32      numTextures, then for each: string path, u32 packedSize (0 if not packed), packedSize bytes
+//   u32      numTileDefs, then for each (index = tile ID): string name, u8 isTransparent, i32 texture, u8[4] color
+//   u32      numBillboardDefs, then for each: string name, i32 texture
+//   u32      numBillboards, then for each (sorted by cell): i32 posX, i32 posY, u32 def
+//   u32      numFlatDefs, then for each: string name, i32 texture, u8[4] color
+//   i32      floorDef, ceilingDef
+//   u32      numFlats, then for each: i32 row, i32 col, u32 def, u8 isCeiling
+//   u32      chunkSize, u8 hasDistance
+//   u32      numChunks, then for each: u32 chunkRow, u32 chunkCol, u32 solidCount, u64 offset
+//   chunks:  at their offsets, chunkSize*chunkSize u16 tile IDs (row-major), followed by as many u8 distances if hasDistance
+//
+// Chunks that are entirely GROUND are not stored. Their cells get the distance to the chunk's border plus one,
+// which is a lower bound of their true distance (every solid cell is outside the chunk).
+
+static void writeU8(FILE* file, unsigned int val) {
+    fputc((int) (val & 0xFF), file);
+}
+
+static void writeU32(FILE* file, unsigned int val) {
+    for (int i = 0; i < 4; i++) {
+        writeU8(file, val >> (8*i));
+    }
+}
+
+static void writeU64(FILE* file, unsigned long long val) {
+    for (int i = 0; i < 8; i++) {
+        writeU8(file, (unsigned int) (val >> (8*i)));
+    }
+}
+
+static void writeColor(FILE* file, Color color) {
+    writeU8(file, color.r);
+    writeU8(file, color.g);
+    writeU8(file, color.b);
+    writeU8(file, color.a);
+}
+
+static void writeFloat(FILE* file, float val) {
+    unsigned int bits;
+    memcpy(&bits, &val, sizeof(bits));
+    writeU32(file, bits);
+}
+
+static void writeString(FILE* file, const char* str) {
+    writeU32(file, (unsigned int) strlen(str));
+    fwrite(str, sizeof(char), strlen(str), file);
+}
+
+typedef struct fileReader {
+    FILE* file;
+    const char* filename;
+} fileReader;
+
+static unsigned int readU8(fileReader* reader) {
+    int c = fgetc(reader->file);
+    if (c == EOF) {
+        fprintf(stderr, COMPILED_ERROR_STR, reader->filename);
+        LoadErrorFail();
+    }
+
+    return (unsigned int) c;
+}
+
+static unsigned int readU32(fileReader* reader) {
+    unsigned int val = 0;
+    for (int i = 0; i < 4; i++) {
+        val |= readU8(reader) << (8*i);
+    }
+
+    return val;
+}
+
+static unsigned long long readU64(fileReader* reader) {
+    unsigned long long val = 0;
+    for (int i = 0; i < 8; i++) {
+        val |= (unsigned long long) readU8(reader) << (8*i);
+    }
+
+    return val;
+}
+
+static Color readColor(fileReader* reader) {
+    Color color;
+    color.r = (unsigned char) readU8(reader);
+    color.g = (unsigned char) readU8(reader);
+    color.b = (unsigned char) readU8(reader);
+    color.a = (unsigned char) readU8(reader);
+
+    return color;
+}
+
+static float readFloat(fileReader* reader) {
+    unsigned int bits = readU32(reader);
+    float val;
+    memcpy(&val, &bits, sizeof(val));
+
+    return val;
+}
+
+// Reads a count, checking it against a sane upper bound
+static int readCount(fileReader* reader, unsigned int max) {
+    unsigned int count = readU32(reader);
+    if (count > max) {
+        fprintf(stderr, COMPILED_ERROR_STR, reader->filename);
+        LoadErrorFail();
+    }
+
+    return (int) count;
+}
+
+static char* readString(fileReader* reader) {
+    int length = readCount(reader, 4096);
+    char* str = calloc(length+1, sizeof(char));
+    assert(str != NULL);
+    if (fread(str, sizeof(char), length, reader->file) != (size_t) length) {
+        fprintf(stderr, COMPILED_ERROR_STR, reader->filename);
+        LoadErrorFail();
+    }
+
+    return str;
+}
+
+bool MapDataIsCompiled(const char* filename) {
+    assert(filename != NULL);
+
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL) {
+        return false;
+    }
+
+    char magic[4];
+    bool compiled = fread(magic, sizeof(char), 4, file) == 4 && memcmp(magic, MAPDATA_MAGIC, 4) == 0;
+    fclose(file);
+
+    return compiled;
+}
+
+int MapDataGetCompiledVersion(const char* filename) {
+    assert(filename != NULL);
+
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL) {
+        return -1;
+    }
+
+    unsigned char header[8];
+    int version = -1;
+    if (fread(header, 1, 8, file) == 8 && memcmp(header, MAPDATA_MAGIC, 4) == 0) {
+        version = header[4] | (header[5] << 8) | (header[6] << 16) | (header[7] << 24);
+    }
+    fclose(file);
+
+    return version;
+}
+
+bool MapDataSaveCompiled(MapData data, const char* filename) {
+    assert(data != NULL);
+    assert(filename != NULL);
+
+    if (data->numTileDefs > 0xFFFF) {
+        fprintf(stderr, "Error saving \"%s\": Compiled maps can have at most %d tile types.\n", filename, 0xFFFF);
+        return false;
+    }
+
+    FILE* file = fopen(filename, "wb");
+    if (file == NULL) {
+        perror("Error opening file!");
+        return false;
+    }
+
+    fwrite(MAPDATA_MAGIC, sizeof(char), 4, file);
+    writeU32(file, MAPDATA_VERSION);
+    writeU32(file, (unsigned int) data->numRows);
+    writeU32(file, (unsigned int) data->numCols);
+    writeU32(file, (unsigned int) data->tileSize);
+    writeColor(file, data->ceilingColor);
+    writeColor(file, data->groundColor);
+    writeColor(file, data->fogColor);
+    writeFloat(file, data->fogDensity);
+
+    writeU32(file, (unsigned int) data->numTextures);
+    for (int i = 0; i < data->numTextures; i++) {
+        writeString(file, data->textures[i].path);
+        writeU32(file, (unsigned int) data->textures[i].packedSize);
+        if (data->textures[i].packed != NULL) {
+            fwrite(data->textures[i].packed, 1, data->textures[i].packedSize, file);
+        }
+    }
+
+    writeU32(file, (unsigned int) data->numTileDefs);
+    for (int i = 0; i < data->numTileDefs; i++) {
+        writeString(file, data->tileDefs[i].name);
+        writeU8(file, data->tileDefs[i].isTransparent);
+        writeU32(file, (unsigned int) data->tileDefs[i].texture);
+        writeColor(file, data->tileDefs[i].color);
+    }
+
+    writeU32(file, (unsigned int) data->numBillboardDefs);
+    for (int i = 0; i < data->numBillboardDefs; i++) {
+        writeString(file, data->billboardDefs[i].name);
+        writeU32(file, (unsigned int) data->billboardDefs[i].texture);
+    }
+
+    writeU32(file, (unsigned int) data->numBillboards);
+    for (int i = 0; i < data->numBillboards; i++) {
+        writeU32(file, (unsigned int) data->billboards[i].posX);
+        writeU32(file, (unsigned int) data->billboards[i].posY);
+        writeU32(file, (unsigned int) data->billboards[i].def);
+    }
+
+    writeU32(file, (unsigned int) data->numFlatDefs);
+    for (int i = 0; i < data->numFlatDefs; i++) {
+        writeString(file, data->flatDefs[i].name);
+        writeU32(file, (unsigned int) data->flatDefs[i].texture);
+        writeColor(file, data->flatDefs[i].color);
+    }
+    writeU32(file, (unsigned int) data->floorDef);
+    writeU32(file, (unsigned int) data->ceilingDef);
+
+    writeU32(file, (unsigned int) data->numFlats);
+    for (int i = 0; i < data->numFlats; i++) {
+        writeU32(file, (unsigned int) data->flats[i].row);
+        writeU32(file, (unsigned int) data->flats[i].col);
+        writeU32(file, (unsigned int) data->flats[i].def);
+        writeU8(file, data->flats[i].isCeiling);
+    }
+
+    // Chunk directory (only chunks with something other than GROUND)
+    const int cs = MAPDATA_CHUNK_SIZE;
+    int chunkRows = (data->numRows + cs - 1) / cs;
+    int chunkCols = (data->numCols + cs - 1) / cs;
+    int* solidCounts = calloc((size_t) chunkRows * chunkCols, sizeof(int));
+    assert(solidCounts != NULL);
+    int numChunks = 0;
+    for (int r = 0; r < data->numRows; r++) {
+        for (int c = 0; c < data->numCols; c++) {
+            if (data->grid[(size_t) r*data->numCols + c] != TILE_GROUND) {
+                int* count = &solidCounts[(size_t) (r/cs)*chunkCols + c/cs];
+                if ((*count)++ == 0) {
+                    numChunks++;
+                }
+            }
+        }
+    }
+
+    writeU32(file, cs);
+    writeU8(file, data->distance != NULL);
+    writeU32(file, (unsigned int) numChunks);
+
+    size_t chunkBytes = (size_t) cs*cs*2 + (data->distance != NULL ? (size_t) cs*cs : 0);
+    unsigned long long offset = fileTell(file) + (unsigned long long) numChunks * 20;
+    for (int cr = 0; cr < chunkRows; cr++) {
+        for (int cc = 0; cc < chunkCols; cc++) {
+            int count = solidCounts[(size_t) cr*chunkCols + cc];
+            if (count == 0) {
+                continue;
+            }
+            writeU32(file, cr);
+            writeU32(file, cc);
+            writeU32(file, count);
+            writeU64(file, offset);
+            offset += chunkBytes;
+        }
+    }
+
+    // Chunk contents, in the same order as the directory
+    for (int cr = 0; cr < chunkRows; cr++) {
+        for (int cc = 0; cc < chunkCols; cc++) {
+            if (solidCounts[(size_t) cr*chunkCols + cc] == 0) {
+                continue;
+            }
+            for (int r = cr*cs; r < (cr+1)*cs; r++) {
+                for (int c = cc*cs; c < (cc+1)*cs; c++) {
+                    unsigned int tile = MapDataGetTile(data, r, c);
+                    writeU8(file, tile);
+                    writeU8(file, tile >> 8);
+                }
+            }
+            if (data->distance == NULL) {
+                continue;
+            }
+            for (int r = cr*cs; r < (cr+1)*cs; r++) {
+                for (int c = cc*cs; c < (cc+1)*cs; c++) {
+                    bool inside = r < data->numRows && c < data->numCols;
+                    writeU8(file, inside ? data->distance[(size_t) r*data->numCols + c] : 255);
+                }
+            }
+        }
+    }
+
+    free(solidCounts);
+
+    bool ok = !ferror(file);
+    if (fclose(file) != 0) {
+        ok = false;
+    }
+
+    return ok;
+}
+
+MapData MapDataLoadCompiledHeader(const char* filename) {
+    assert(filename != NULL);
+
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL) {
+        perror("Error opening file!");
+        LoadErrorFail();
+    }
+    LoadErrorAddFile(file);
+    fileReader reader = {file, filename};
+
+    char magic[4];
+    if (fread(magic, sizeof(char), 4, file) != 4 || memcmp(magic, MAPDATA_MAGIC, 4) != 0) {
+        fprintf(stderr, "Error opening \"%s\": Not a compiled map file.\n", filename);
+        LoadErrorFail();
+    }
+    unsigned int version = readU32(&reader);
+    if (version != MAPDATA_VERSION) {
+        fprintf(stderr, "Error opening \"%s\": Compiled map version %u is not supported (expected %d). Compile it again with mapc.\n", filename, version, MAPDATA_VERSION);
+        LoadErrorFail();
+    }
+
+    MapData data = calloc(1, sizeof(struct mapdata));
+    assert(data != NULL);
+
+    data->numRows = (int) readU32(&reader);
+    data->numCols = (int) readU32(&reader);
+    data->tileSize = (int) readU32(&reader);
+    if (data->numRows <= 0 || data->numCols <= 0 || data->tileSize <= 0) {
+        fprintf(stderr, COMPILED_ERROR_STR, filename);
+        LoadErrorFail();
+    }
+    data->ceilingColor = readColor(&reader);
+    data->groundColor = readColor(&reader);
+    data->fogColor = readColor(&reader);
+    data->fogDensity = readFloat(&reader);
+    if (!(data->fogDensity >= 0)) {    // Also NaN
+        fprintf(stderr, COMPILED_ERROR_STR, filename);
+        LoadErrorFail();
+    }
+
+    data->numTextures = readCount(&reader, 0xFFFF);
+    data->textures = calloc(data->numTextures + 1, sizeof(mapTexture));
+    assert(data->textures != NULL);
+    for (int i = 0; i < data->numTextures; i++) {
+        data->textures[i].path = readString(&reader);
+        data->textures[i].packedSize = readCount(&reader, 0x7FFFFFFF);
+        if (data->textures[i].packedSize > 0) {
+            data->textures[i].packed = malloc(data->textures[i].packedSize);
+            assert(data->textures[i].packed != NULL);
+            if (fread(data->textures[i].packed, 1, data->textures[i].packedSize, file) != (size_t) data->textures[i].packedSize) {
+                fprintf(stderr, COMPILED_ERROR_STR, filename);
+                LoadErrorFail();
+            }
+        }
+    }
+
+    data->numTileDefs = readCount(&reader, 0xFFFF);
+    if (data->numTileDefs == 0) {
+        fprintf(stderr, COMPILED_ERROR_STR, filename);
+        LoadErrorFail();
+    }
+    data->tileDefs = malloc(sizeof(mapTileDef) * data->numTileDefs);
+    assert(data->tileDefs != NULL);
+    for (int i = 0; i < data->numTileDefs; i++) {
+        data->tileDefs[i].name = readString(&reader);
+        data->tileDefs[i].isTransparent = readU8(&reader) != 0;
+        data->tileDefs[i].texture = (int) readU32(&reader);
+        data->tileDefs[i].color = readColor(&reader);
+        if (data->tileDefs[i].texture < -1 || data->tileDefs[i].texture >= data->numTextures) {
+            fprintf(stderr, COMPILED_ERROR_STR, filename);
+            LoadErrorFail();
+        }
+    }
+
+    data->numBillboardDefs = readCount(&reader, 0xFFFF);
+    data->billboardDefs = malloc(sizeof(mapBillboardDef) * (data->numBillboardDefs + 1));
+    assert(data->billboardDefs != NULL);
+    for (int i = 0; i < data->numBillboardDefs; i++) {
+        data->billboardDefs[i].name = readString(&reader);
+        data->billboardDefs[i].texture = (int) readU32(&reader);
+        if (data->billboardDefs[i].texture < 0 || data->billboardDefs[i].texture >= data->numTextures) {
+            fprintf(stderr, COMPILED_ERROR_STR, filename);
+            LoadErrorFail();
+        }
+    }
+
+    data->numBillboards = readCount(&reader, 0x7FFFFFF);
+    data->billboards = malloc(sizeof(mapBillboard) * (data->numBillboards + 1));
+    assert(data->billboards != NULL);
+    for (int i = 0; i < data->numBillboards; i++) {
+        data->billboards[i].posX = (int) readU32(&reader);
+        data->billboards[i].posY = (int) readU32(&reader);
+        data->billboards[i].def = (int) readU32(&reader);
+        if (data->billboards[i].def < 0 || data->billboards[i].def >= data->numBillboardDefs) {
+            fprintf(stderr, COMPILED_ERROR_STR, filename);
+            LoadErrorFail();
+        }
+    }
+
+    data->numFlatDefs = readCount(&reader, 0xFFFF);
+    data->flatDefs = malloc(sizeof(mapFlatDef) * (data->numFlatDefs + 1));
+    assert(data->flatDefs != NULL);
+    for (int i = 0; i < data->numFlatDefs; i++) {
+        data->flatDefs[i].name = readString(&reader);
+        data->flatDefs[i].texture = (int) readU32(&reader);
+        data->flatDefs[i].color = readColor(&reader);
+        if (data->flatDefs[i].texture < -1 || data->flatDefs[i].texture >= data->numTextures) {
+            fprintf(stderr, COMPILED_ERROR_STR, filename);
+            LoadErrorFail();
+        }
+    }
+    data->floorDef = (int) readU32(&reader);
+    data->ceilingDef = (int) readU32(&reader);
+    if (data->floorDef < -1 || data->floorDef >= data->numFlatDefs || data->ceilingDef < -1 || data->ceilingDef >= data->numFlatDefs) {
+        fprintf(stderr, COMPILED_ERROR_STR, filename);
+        LoadErrorFail();
+    }
+
+    data->numFlats = readCount(&reader, 0x7FFFFFF);
+    data->flats = malloc(sizeof(mapFlat) * (data->numFlats + 1));
+    assert(data->flats != NULL);
+    for (int i = 0; i < data->numFlats; i++) {
+        data->flats[i].row = (int) readU32(&reader);
+        data->flats[i].col = (int) readU32(&reader);
+        data->flats[i].def = (int) readU32(&reader);
+        data->flats[i].isCeiling = readU8(&reader) != 0;
+        if (data->flats[i].row < 0 || data->flats[i].row >= data->numRows || data->flats[i].col < 0 || data->flats[i].col >= data->numCols
+            || data->flats[i].def < 0 || data->flats[i].def >= data->numFlatDefs) {
+            fprintf(stderr, COMPILED_ERROR_STR, filename);
+            LoadErrorFail();
+        }
+    }
+
+    data->chunkSize = (int) readU32(&reader);
+    data->hasDistance = readU8(&reader) != 0;
+    data->numChunks = readCount(&reader, 0x7FFFFFFF);
+    if (data->chunkSize <= 0 || data->chunkSize > 4096) {
+        fprintf(stderr, COMPILED_ERROR_STR, filename);
+        LoadErrorFail();
+    }
+
+    int chunkRows = (data->numRows + data->chunkSize - 1) / data->chunkSize;
+    int chunkCols = (data->numCols + data->chunkSize - 1) / data->chunkSize;
+    data->chunks = malloc(sizeof(mapChunk) * (data->numChunks + 1));
+    assert(data->chunks != NULL);
+    for (int i = 0; i < data->numChunks; i++) {
+        data->chunks[i].chunkRow = (int) readU32(&reader);
+        data->chunks[i].chunkCol = (int) readU32(&reader);
+        data->chunks[i].solidCount = (int) readU32(&reader);
+        data->chunks[i].offset = readU64(&reader);
+        if (data->chunks[i].chunkRow < 0 || data->chunks[i].chunkRow >= chunkRows || data->chunks[i].chunkCol < 0 || data->chunks[i].chunkCol >= chunkCols) {
+            fprintf(stderr, COMPILED_ERROR_STR, filename);
+            LoadErrorFail();
+        }
+    }
+
+    // The chunks are only read later (MapDataReadChunk), so a truncated file is caught here, while the load can still fail
+    unsigned long long size = fileSize(file);
+    unsigned long long chunkBytes = (unsigned long long) data->chunkSize*data->chunkSize*(data->hasDistance ? 3 : 2);
+    for (int i = 0; i < data->numChunks; i++) {
+        if (data->chunks[i].offset > size || size - data->chunks[i].offset < chunkBytes) {
+            fprintf(stderr, COMPILED_ERROR_STR, filename);
+            LoadErrorFail();
+        }
+    }
+
+    LoadErrorRemoveFile(file);
+    fclose(file);
+
+    return data;
+}
+
+void MapDataReadChunk(MapData data, FILE* file, const char* filename, int chunk, unsigned short* tiles, unsigned char* distance) {
+    assert(data != NULL);
+    assert(file != NULL);
+    assert(chunk >= 0 && chunk < data->numChunks);
+    assert(tiles != NULL);
+    assert(distance == NULL || data->hasDistance);
+
+    int cs = data->chunkSize;
+    size_t chunkBytes = (size_t) cs*cs*2 + (distance != NULL ? (size_t) cs*cs : 0);
+    unsigned char* buffer = malloc(chunkBytes);
+    assert(buffer != NULL);
+
+    if (fileSeek(file, data->chunks[chunk].offset) != 0 || fread(buffer, 1, chunkBytes, file) != chunkBytes) {
+        fprintf(stderr, COMPILED_ERROR_STR, filename);
+        LoadErrorFail();
+    }
+
+    for (int i = 0; i < cs*cs; i++) {
+        tiles[i] = (unsigned short) (buffer[2*i] | (buffer[2*i+1] << 8));
+        if (tiles[i] >= data->numTileDefs) {
+            fprintf(stderr, COMPILED_ERROR_STR, filename);
+            LoadErrorFail();
+        }
+    }
+    if (distance != NULL) {
+        memcpy(distance, buffer + (size_t) cs*cs*2, (size_t) cs*cs);
+    }
+
+    free(buffer);
+}
+
+MapData MapDataLoadCompiled(const char* filename) {
+    MapData data = MapDataLoadCompiledHeader(filename);
+
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL) {
+        perror("Error opening file!");
+        LoadErrorFail();
+    }
+    LoadErrorAddFile(file);
+
+    int cs = data->chunkSize;
+    size_t numCells = (size_t) data->numRows * data->numCols;
+    data->grid = calloc(numCells, sizeof(int));
+    assert(data->grid != NULL);
+    if (data->hasDistance) {
+        // Cells of chunks that are not stored: distance to the chunk's border, plus one
+        data->distance = malloc(numCells);
+        assert(data->distance != NULL);
+        for (int r = 0; r < data->numRows; r++) {
+            for (int c = 0; c < data->numCols; c++) {
+                int inR = r % cs;
+                int inC = c % cs;
+                int edge = inR < cs-1-inR ? inR : cs-1-inR;
+                if (inC < edge) edge = inC;
+                if (cs-1-inC < edge) edge = cs-1-inC;
+                data->distance[(size_t) r*data->numCols + c] = (unsigned char) (edge + 1 < 255 ? edge + 1 : 255);
+            }
+        }
+    }
+
+    unsigned short* tiles = malloc(sizeof(unsigned short) * cs*cs);
+    unsigned char* distance = malloc((size_t) cs*cs);
+    assert(tiles != NULL && distance != NULL);
+    for (int i = 0; i < data->numChunks; i++) {
+        MapDataReadChunk(data, file, filename, i, tiles, data->hasDistance ? distance : NULL);
+
+        for (int r = 0; r < cs; r++) {
+            for (int c = 0; c < cs; c++) {
+                int row = data->chunks[i].chunkRow*cs + r;
+                int col = data->chunks[i].chunkCol*cs + c;
+                if (row >= data->numRows || col >= data->numCols) {
+                    continue;
+                }
+
+                data->grid[(size_t) row*data->numCols + col] = tiles[r*cs + c];
+                if (data->hasDistance) {
+                    data->distance[(size_t) row*data->numCols + col] = distance[r*cs + c];
+                }
+            }
+        }
+    }
+
+    free(tiles);
+    free(distance);
+    LoadErrorRemoveFile(file);
+    fclose(file);
+
+    return data;
+}
@@ -1,6 +1,8 @@
 #include <stdlib.h>
 #include <assert.h>
 #include "mapparser.h"
+#include "strutil.h"
+#include "loaderror.h"
 #include "hashmap.h"
 #include "list.h"
 #include <stdio.h>
@@ -9,23 +11,6 @@
 
 #define ERROR_STR "Error parsing map file \"%s\" (Line %d): "
 
-// djb2 hash
-static unsigned int djb2hash(void* key) {
-    char* str = (char*) key;
-
-    int hash = 5381;
-    int c;
-
-    while (c = *str++)
-       hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
-
-    return hash;
-}
-
-static bool hashmapstrcmp(void* key1, void* key2) {
-    return strcmp((char*) key1, (char*) key2) == 0;
-}
-
 struct mapparser {
     const char* filename;
     ParserResult result;
@@ -154,7 +139,7 @@ static ParserTable ParserTableCreate(char* name) {
     assert(table != NULL);
 
     table->name = name;
-    table->elements = HashMapCreate(5, djb2hash, hashmapstrcmp);
+    table->elements = HashMapCreate(5, StringHash, StringEquals);
 
     return table;
 }
@@ -217,7 +202,7 @@ static ParserElement parseKVPair(char* kvpair, MapParser parser, int lineNumber)
                     
     if (splitIdx <= 0) { // Also works if the first char is :
         fprintf(stderr, ERROR_STR "Invalid table element formatting. Must be <key> : <value>\n", parser->filename, lineNumber);
-        exit(EXIT_FAILURE);
+        LoadErrorFail();
     }
     
     // New key value pair
@@ -282,7 +267,7 @@ static ParserElement parseValue(char* elem_name, char* val, MapParser parser, in
         type = STRING_TYPE;
         if (sscanf(val, " \"%[^\"]\" ", (char*)value) != 1) {    // Not single line
             fprintf(stderr, ERROR_STR "Strings must be single line only!\n", parser->filename, lineNumber);
-            exit(EXIT_FAILURE);
+            LoadErrorFail();
         }
     } else if (first_char == '[') {    // Is a list        
         char* line = trim(val+1);
@@ -339,7 +324,7 @@ static ParserElement parseValue(char* elem_name, char* val, MapParser parser, in
 
                 if (!oneLine) {
                     fprintf(stderr, ERROR_STR "Invalid value %s.\n", parser->filename, lineNumber, val);
-                    exit(EXIT_FAILURE);
+                    LoadErrorFail();
                 }
                 
                 if (oneLine) {   // List ends this line (valstr is only the part from here to next line)
@@ -412,7 +397,7 @@ static ParserElement parseValue(char* elem_name, char* val, MapParser parser, in
                 
                 if (!oneLine) {
                     fprintf(stderr, ERROR_STR "Invalid value %s.\n", parser->filename, lineNumber, val);
-                    exit(EXIT_FAILURE);
+                    LoadErrorFail();
                 }
 
                 if (oneLine) {   // Table ends this line (valstr is only the part from here to next line)
@@ -444,7 +429,7 @@ static ParserElement parseValue(char* elem_name, char* val, MapParser parser, in
 
         type = TABLE_TYPE;
 
-        value = HashMapCreate(5, djb2hash, hashmapstrcmp);
+        value = HashMapCreate(5, StringHash, StringEquals);
 
         int nesting = 1;
 
@@ -468,7 +453,7 @@ static ParserElement parseValue(char* elem_name, char* val, MapParser parser, in
                     ParserElement parserElem = parseKVPair(keyval_pair, parser, lineNumber);
                     if (HashMapContains((HashMap) value, parserElem->key)) {
                         fprintf(stderr, ERROR_STR "Element with key \"%s\" already exists in this table!\n", parser->filename, lineNumber, parserElem->key);
-                        exit(EXIT_FAILURE);
+                        LoadErrorFail();
                     }
 
                     HashMapPut((HashMap) value, parserElem->key, parserElem);
@@ -502,7 +487,7 @@ static ParserElement parseValue(char* elem_name, char* val, MapParser parser, in
                 
                 if (!oneLine) {
                     fprintf(stderr, ERROR_STR "Invalid value %s.\n", parser->filename, lineNumber, val);
-                    exit(EXIT_FAILURE);
+                    LoadErrorFail();
                 }
 
                 if (oneLine) {   // Table ends this line (valstr is only the part from here to next line)
@@ -517,7 +502,7 @@ static ParserElement parseValue(char* elem_name, char* val, MapParser parser, in
                 ParserElement parserElem = parseKVPair(keyval_pair, parser, lineNumber);
                 if (HashMapContains((HashMap) value, parserElem->key)) {
                     fprintf(stderr, ERROR_STR "Element with key \"%s\" already exists in this table!\n", parser->filename, lineNumber, parserElem->key);
-                    exit(EXIT_FAILURE);
+                    LoadErrorFail();
                 }
                 HashMapPut((HashMap) value, parserElem->key, parserElem);
 
@@ -545,7 +530,7 @@ static ParserElement parseValue(char* elem_name, char* val, MapParser parser, in
                     ParserElement parserElem = parseKVPair(keyval_pair, parser, lineNumber);
                     if (HashMapContains((HashMap) value, parserElem->key)) {
                         fprintf(stderr, ERROR_STR "Element with key \"%s\" already exists in this table!\n", parser->filename, lineNumber, parserElem->key);
-                        exit(EXIT_FAILURE);
+                        LoadErrorFail();
                     }
 
                     HashMapPut((HashMap) value, parserElem->key, parserElem);
@@ -586,7 +571,7 @@ static ParserElement parseValue(char* elem_name, char* val, MapParser parser, in
 
                 if (!oneLine) {
                     fprintf(stderr, ERROR_STR "Invalid value %s.\n", parser->filename, lineNumber, val);
-                    exit(EXIT_FAILURE);
+                    LoadErrorFail();
                 }
                 
                 if (oneLine) {   // List ends this line (valstr is only the part from here to next line)
@@ -601,7 +586,7 @@ static ParserElement parseValue(char* elem_name, char* val, MapParser parser, in
                 ParserElement parserElem = parseKVPair(keyval_pair, parser, lineNumber);
                 if (HashMapContains((HashMap) value, parserElem->key)) {
                     fprintf(stderr, ERROR_STR "Element with key \"%s\" already exists in this table!\n", parser->filename, lineNumber, parserElem->key);
-                    exit(EXIT_FAILURE);
+                    LoadErrorFail();
                 }
                 HashMapPut((HashMap) value, parserElem->key, parserElem);
 
@@ -621,7 +606,7 @@ static ParserElement parseValue(char* elem_name, char* val, MapParser parser, in
 
     } else {
         fprintf(stderr, ERROR_STR "The value \"%s\" is not recognized.\n", parser->filename, lineNumber, val);
-        exit(EXIT_FAILURE);
+        LoadErrorFail();
     }
 
     // TODO: change to not have hardcoded 50 max length
@@ -644,13 +629,14 @@ ParserResult MapParserParse(MapParser parser) {
     FILE* file = fopen(parser->filename, "r");
     if (file == NULL) {
         perror("Error opening file!");
-        exit(EXIT_FAILURE);
+        LoadErrorFail();
     }
+    LoadErrorAddFile(file);
 
     ParserResult res = malloc(sizeof(struct parserresult));
     assert(res != NULL);
     parser->result = res;
-    res->tables = HashMapCreate(5, djb2hash, hashmapstrcmp);
+    res->tables = HashMapCreate(5, StringHash, StringEquals);
     
     char* continuousVal = NULL; // This pointer stores a string that is continuously added on to for multiple line values (ex. lists)
     int continuousValSize = 0;
@@ -743,11 +729,11 @@ ParserResult MapParserParse(MapParser parser) {
             while (*c != '\0') {
                 if (isspace(*c)) {
                     fprintf(stderr, ERROR_STR "Invalid table name! (contains spaces)\n", parser->filename, lineNumber);
-                    exit(EXIT_FAILURE);
+                    LoadErrorFail();
                 }
                 if (*c == ']' && *(c+1) != '\0') {
                     fprintf(stderr, ERROR_STR "Invalid table name format. Must be [<name>]\n", parser->filename, lineNumber);
-                    exit(EXIT_FAILURE);
+                    LoadErrorFail();
                 }
 
                 if (*c == ']') {
@@ -776,7 +762,7 @@ ParserResult MapParserParse(MapParser parser) {
         if (splitIdx <= 0) { // Also works if the first char is :
             if (continuousVal == NULL) { // Line is just wrong
                 fprintf(stderr, ERROR_STR "Invalid line formatting. Must be <key> : <value>\n", parser->filename, lineNumber);
-                exit(EXIT_FAILURE);
+                LoadErrorFail();
             } else {
                 continue; // Line may not be wrong, so just skip next steps
             }
@@ -797,17 +783,17 @@ ParserResult MapParserParse(MapParser parser) {
 
         if (currentTable == NULL) {     // Defined outside of a table
             fprintf(stderr, ERROR_STR "Element defined outside of a table %s.\n", parser->filename, lineNumber, table_name);
-            exit(EXIT_FAILURE);
+            LoadErrorFail();
         }
         if (HashMapContains(currentTable->elements, trimmed_name)) {    // Element already defined here
             fprintf(stderr, ERROR_STR "Duplicate element name %s.\n", parser->filename, lineNumber, trimmed_name);
-            exit(EXIT_FAILURE);
+            LoadErrorFail();
         }
 
         if (*trimmed_val != '\0' && valueParsable(trimmed_val)) {
             if (continuousVal != NULL) {
                 fprintf(stderr, ERROR_STR "The value \"%s\" is not recognized.\n", parser->filename, lineNumber, trimmed_val);
-                exit(EXIT_FAILURE);
+                LoadErrorFail();
             }
 
             ParserElement elem = parseValue(trimmed_name, trimmed_val, parser, lineNumber);
@@ -853,6 +839,7 @@ ParserResult MapParserParse(MapParser parser) {
         free(continuousName);
     }
 
+    LoadErrorRemoveFile(file);
     fclose(file);
 
     return parser->result;
@@ -1,11 +1,13 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <float.h>
+#include <limits.h>
 #include "mapray.h"
 #include "raymath.h"
 #include "list.h"
-
-#define MAX_RAY_STEPS 50
+#include "workerpool.h"
+#include "texturecache.h"
 
 struct mapray {
     double angle;               // Not the true angle (usually the same as the player's angle);  Radians.
@@ -14,11 +16,35 @@ struct mapray {
     double length;              // Current length (in pixels)
     int posX;                   // Start position
     int posY;                   //
+    double endX;                // Where the last cast ended: the farthest collision, or where it left the map (pixels)
+    double endY;                //
     bool is_colliding;
     List collisions;
     Map map;                    // Map where this ray is currently in
 };
 
+// How rays go through empty space (shared by every ray)
+static MapRayTraversal traversal = TRAVERSAL_MIPGRID;
+
+// TRAVERSAL_FIXED: angles are quantized to FIXED_ANGLES per turn and lengths are 16.16 fixed-point (in 64 bits, so
+// that big maps do not overflow). The tables are built with integer math only, so every build gets the same ones.
+#define FIXED_SHIFT 16
+#define FIXED_ONE (1LL << FIXED_SHIFT)
+#define FIXED_ANGLES 65536
+#define FIXED_QUARTER (FIXED_ANGLES / 4)
+#define FIXED_TRIG_SHIFT 30     // Sines in the table are Q2.30
+
+// Q2.30 cosine and sine of one angle step, and of FIXED_TABLE_SPLIT steps (rounded from their exact values)
+#define FIXED_TABLE_SPLIT 128
+#define FIXED_STEP_COS 1073741819LL
+#define FIXED_STEP_SIN 102944LL
+#define FIXED_SPLIT_COS 1073660973LL
+#define FIXED_SPLIT_SIN 13176464LL
+
+static long long fixedSin[FIXED_QUARTER + 1];       // Sine of the angles of the first quadrant (Q2.30)
+static long long fixedRecip[FIXED_QUARTER + 1];     // Their reciprocals (16.16; 0 for sin 0, which never gets to a next cell)
+static bool fixedTablesBuilt = false;
+
 // Internal: check if position is colliding with map
 static bool isColliding(int posX, int posY, Map map) {
     // No collision if there's no map.
@@ -26,11 +52,46 @@ static bool isColliding(int posX, int posY, Map map) {
         return false;
     }
 
-    // Get grid position
-    int gridPosX = (int) (posX) / MapGetTileSize(map);
-    int gridPosY = (int) (posY) / MapGetTileSize(map);
+    return MapIsSolidAt(map, posX, posY);
+}
 
-    return MapGetTile(map, gridPosX, gridPosY) != TILE_GROUND;
+// INTERNAL: rotates (c, s) by (stepC, stepS), all Q2.30
+static void fixedRotate(long long* c, long long* s, long long stepC, long long stepS) {
+    long long half = 1LL << (FIXED_TRIG_SHIFT - 1);
+    long long newC = (*c * stepC - *s * stepS + half) >> FIXED_TRIG_SHIFT;
+    long long newS = (*s * stepC + *c * stepS + half) >> FIXED_TRIG_SHIFT;
+    *c = newC > 0 ? newC : 0;   // Only the first quadrant is built
+    *s = newS;
+}
+
+// INTERNAL: builds the fixed-point tables. Each sine comes from rotating by one coarse and one fine angle, so the
+// rounding errors of the rotations do not add up (they stay under 1e-7).
+static void buildFixedTables(void) {
+    long long fineCos[FIXED_TABLE_SPLIT];
+    long long fineSin[FIXED_TABLE_SPLIT];
+    long long c = 1LL << FIXED_TRIG_SHIFT, s = 0;
+    for (int i = 0; i < FIXED_TABLE_SPLIT; i++) {
+        fineCos[i] = c;
+        fineSin[i] = s;
+        fixedRotate(&c, &s, FIXED_STEP_COS, FIXED_STEP_SIN);
+    }
+
+    long long half = 1LL << (FIXED_TRIG_SHIFT - 1);
+    long long coarseCos = 1LL << FIXED_TRIG_SHIFT, coarseSin = 0;
+    for (int coarse = 0; coarse * FIXED_TABLE_SPLIT <= FIXED_QUARTER; coarse++) {
+        for (int fine = 0; fine < FIXED_TABLE_SPLIT && coarse * FIXED_TABLE_SPLIT + fine <= FIXED_QUARTER; fine++) {
+            fixedSin[coarse * FIXED_TABLE_SPLIT + fine] = (coarseSin * fineCos[fine] + coarseCos * fineSin[fine] + half) >> FIXED_TRIG_SHIFT;
+        }
+        fixedRotate(&coarseCos, &coarseSin, FIXED_SPLIT_COS, FIXED_SPLIT_SIN);
+    }
+    fixedSin[0] = 0;
+    fixedSin[FIXED_QUARTER] = 1LL << FIXED_TRIG_SHIFT;
+
+    for (int i = 0; i <= FIXED_QUARTER; i++) {
+        fixedRecip[i] = fixedSin[i] != 0 ? (1LL << (FIXED_SHIFT + FIXED_TRIG_SHIFT)) / fixedSin[i] : 0;
+    }
+
+    fixedTablesBuilt = true;
 }
 
 // Internal: returns a collision object from MapRay->collisions
@@ -38,6 +99,15 @@ static rayCollision getCollision(List collisions, int idx) {
     return (*((rayCollision*) ListGet(collisions, idx)));
 }
 
+// INTERNAL: frees every collision of a ray
+static void clearCollisions(MapRay ray) {
+    ListMoveToStart(ray->collisions);
+    while (ListCanOperate(ray->collisions)) {
+        free(ListGetCurrent(ray->collisions));
+        ListRemoveFirst(ray->collisions);
+    }
+}
+
 MapRay MapRayCreate(int posX, int posY, double angle, double angleOffset, Map map) {
     MapRay map_ray = malloc(sizeof(struct mapray));
     assert(map_ray != NULL);
@@ -48,6 +118,8 @@ MapRay MapRayCreate(int posX, int posY, double angle, double angleOffset, Map ma
     map_ray->length = 0;
     map_ray->posX = posX;
     map_ray->posY = posY;
+    map_ray->endX = posX;
+    map_ray->endY = posY;
     map_ray->is_colliding = false;
     map_ray->map = map;
     map_ray->collisions = ListCreate(NULL);
@@ -61,11 +133,7 @@ void MapRayDestroy(MapRay* mrp) {
 
     MapRay map_ray = *mrp;
 
-    ListMoveToStart(map_ray->collisions);
-    while (ListCanOperate(map_ray->collisions)) {
-        free(ListGetCurrent(map_ray->collisions));
-        ListRemoveFirst(map_ray->collisions);
-    }
+    clearCollisions(map_ray);
     ListDestroy(&map_ray->collisions);
 
     free(map_ray);
@@ -80,6 +148,12 @@ void MapRaySetAngle(MapRay ray, double angle) {
     ray->angle = angle;
 }
 
+void MapRaySetAngleOffset(MapRay ray, double angleOffset) {
+    assert(ray != NULL);
+
+    ray->angle_offset = angleOffset;
+}
+
 void MapRaySetPosition(MapRay ray, int posX, int posY) {
     assert(ray != NULL);
 
@@ -171,6 +245,12 @@ MapRayHitSide MapRayGetHitSide(MapRay ray, int idx) {
     return getCollision(ray->collisions, idx).hitSide;
 }
 
+Vector2 MapRayGetEndPoint(MapRay ray) {
+    assert(ray != NULL);
+
+    return (Vector2) {(float) ray->endX, (float) ray->endY};
+}
+
 typedef struct bbcollision {
     bool exists;
     double col_x;
@@ -220,19 +300,325 @@ static bbcollision rayCollidesWithBillboard(MapRay ray, Billboard bb) {
     };
 }
 
+typedef struct Vector2d {
+    double x;
+    double y;
+} Vector2d;
+
+// State of a ray going through the grid (DDA)
+typedef struct rayWalk {
+    Map map;
+    int tileSize;
+    int posX;                   // Start position (pixels)
+    int posY;                   //
+    double dirX;                // Direction
+    double dirY;                //
+    int mapX;                   // Current cell
+    int mapY;                   //
+    int sideX;                  // Direction of the steps in each axis (-1 or 1)
+    int sideY;                  //
+    double deltaDistX;          // Length that the ray must traverse to go from one X/Y to the next, respectively
+    double deltaDistY;          //
+    double sideDistX;           // Length from the start to where the ray leaves the current cell in each axis
+    double sideDistY;           //
+    double length;              // Length from the start to where the ray entered the current cell
+    double maxLength;           // The walk stops at cells entered this far from the start
+    MapRayHitSide hitSide;      // Side through which the ray entered the current cell
+    int tile;                   // Tile of the current cell
+    int chunkRow;               // Chunk of the current cell
+    int chunkCol;               //
+    const unsigned short* chunk;    // Its tiles (NULL if entirely GROUND)
+    const unsigned long long* solid;    // Its solidity bitmap (NULL if entirely GROUND)
+    unsigned long long blocks;      // Its block occupancy
+    const unsigned char* distance;  // Its distance field (only with TRAVERSAL_DISTANCE)
+    MapRayTraversal traversal;
+
+    // Only with TRAVERSAL_FIXED: the same as above, 16.16
+    long long fixedDeltaX;
+    long long fixedDeltaY;
+    long long fixedSideX;
+    long long fixedSideY;
+    long long fixedLength;
+    long long fixedDirX;        // Direction (Q2.30)
+    long long fixedDirY;        //
+} rayWalk;
+
+// INTERNAL: length from the start of a ray to where it leaves a cell, in one axis
+static double borderDist(int cell, int side, int pos, int tileSize, double deltaDist) {
+    double toBorder = side > 0 ? (double) ((cell + 1) * tileSize - pos) : (double) (pos - cell * tileSize);
+    return toBorder * deltaDist / tileSize;
+}
+
+// INTERNAL: makes the chunk of the current cell the walk's current chunk
+static void walkUpdateChunk(rayWalk* walk) {
+    if ((walk->mapX >> MAP_CHUNK_SHIFT) == walk->chunkRow && (walk->mapY >> MAP_CHUNK_SHIFT) == walk->chunkCol) {
+        return;
+    }
+    walk->chunkRow = walk->mapX >> MAP_CHUNK_SHIFT;
+    walk->chunkCol = walk->mapY >> MAP_CHUNK_SHIFT;
+    walk->blocks = MapGetChunkBlocks(walk->map, walk->chunkRow, walk->chunkCol);
+    walk->chunk = walk->blocks != 0 ? MapGetChunk(walk->map, walk->chunkRow, walk->chunkCol) : NULL;
+    walk->solid = walk->blocks != 0 ? MapGetChunkSolidity(walk->map, walk->chunkRow, walk->chunkCol) : NULL;
+    walk->distance = walk->chunk != NULL && walk->traversal == TRAVERSAL_DISTANCE ? MapGetChunkDistances(walk->map, walk->chunkRow, walk->chunkCol) : NULL;
+}
+
+// INTERNAL: sets up the 16.16 walk of TRAVERSAL_FIXED, from the angle quantized to FIXED_ANGLES per turn
+static void walkStartFixed(rayWalk* walk, double angle) {
+    int step = (int) (llround(angle * (FIXED_ANGLES / (2*PI))) & (FIXED_ANGLES - 1));
+    int quadrant = step / FIXED_QUARTER;
+    int inQuadrant = step % FIXED_QUARTER;
+    int sinIdx = quadrant % 2 == 0 ? inQuadrant : FIXED_QUARTER - inQuadrant;   // Of the magnitude of the sine
+    int cosIdx = FIXED_QUARTER - sinIdx;                                        // and of the cosine
+    walk->fixedDirX = (quadrant == 1 || quadrant == 2) ? -fixedSin[cosIdx] : fixedSin[cosIdx];
+    walk->fixedDirY = quadrant >= 2 ? -fixedSin[sinIdx] : fixedSin[sinIdx];
+    walk->dirX = (double) walk->fixedDirX / (double) (1LL << FIXED_TRIG_SHIFT);
+    walk->dirY = (double) walk->fixedDirY / (double) (1LL << FIXED_TRIG_SHIFT);
+    walk->sideX = walk->fixedDirX < 0 ? -1 : 1;
+    walk->sideY = walk->fixedDirY < 0 ? -1 : 1;
+
+    // A ray parallel to an axis never crosses to the next X/Y
+    long long recipX = fixedRecip[cosIdx];
+    long long recipY = fixedRecip[sinIdx];
+    int toBorderX = walk->sideX > 0 ? (walk->mapX + 1) * walk->tileSize - walk->posX : walk->posX - walk->mapX * walk->tileSize;
+    int toBorderY = walk->sideY > 0 ? (walk->mapY + 1) * walk->tileSize - walk->posY : walk->posY - walk->mapY * walk->tileSize;
+    walk->fixedDeltaX = recipX != 0 ? recipX * walk->tileSize : LLONG_MAX;
+    walk->fixedDeltaY = recipY != 0 ? recipY * walk->tileSize : LLONG_MAX;
+    walk->fixedSideX = recipX != 0 ? recipX * toBorderX : LLONG_MAX;
+    walk->fixedSideY = recipY != 0 ? recipY * toBorderY : LLONG_MAX;
+    walk->fixedLength = 0;
+}
+
+// INTERNAL: starts a walk at a position (pixels), to be given a direction with walkStartFixed or walkSetDirection
+static void walkBegin(rayWalk* walk, Map map, int posX, int posY, MapRayTraversal mode) {
+    walk->map = map;
+    walk->tileSize = MapGetTileSize(map);
+    walk->posX = posX;
+    walk->posY = posY;
+    walk->mapX = (int) floor((double) posX / walk->tileSize);
+    walk->mapY = (int) floor((double) posY / walk->tileSize);
+    walk->length = 0;
+    walk->maxLength = DBL_MAX;
+    walk->hitSide = X_AXIS;
+    walk->traversal = mode;
+
+    walk->chunkRow = INT_MIN;
+    walk->chunkCol = INT_MIN;
+    walkUpdateChunk(walk);
+}
+
+// INTERNAL: sets the direction (a unit vector) of a walk that is not TRAVERSAL_FIXED
+static void walkSetDirection(rayWalk* walk, double dirX, double dirY) {
+    walk->dirX = dirX;
+    walk->dirY = dirY;
+
+    // A ray parallel to an axis never crosses to the next X/Y
+    walk->deltaDistX = walk->dirX != 0 ? fabs(1 / walk->dirX) * walk->tileSize : DBL_MAX;
+    walk->deltaDistY = walk->dirY != 0 ? fabs(1 / walk->dirY) * walk->tileSize : DBL_MAX;
+    walk->sideX = walk->dirX < 0 ? -1 : 1;
+    walk->sideY = walk->dirY < 0 ? -1 : 1;
+    walk->sideDistX = walk->dirX != 0 ? borderDist(walk->mapX, walk->sideX, walk->posX, walk->tileSize, walk->deltaDistX) : DBL_MAX;
+    walk->sideDistY = walk->dirY != 0 ? borderDist(walk->mapY, walk->sideY, walk->posY, walk->tileSize, walk->deltaDistY) : DBL_MAX;
+}
+
+// INTERNAL: starts a walk at a position (pixels) with an angle (radians), in the current traversal mode
+static void walkStart(rayWalk* walk, Map map, int posX, int posY, double angle) {
+    walkBegin(walk, map, posX, posY, traversal);
+
+    if (walk->traversal == TRAVERSAL_FIXED) {
+        walkStartFixed(walk, angle);
+    } else {
+        walkSetDirection(walk, cos(angle), sin(angle));
+    }
+}
+
+// INTERNAL: moves to the first cell after the box of size x size cells starting at (firstX, firstY), which must
+// contain the current cell
+static void walkSkipBox(rayWalk* walk, int firstX, int firstY, int size) {
+    int lastX = walk->sideX > 0 ? firstX + size - 1 : firstX;
+    int lastY = walk->sideY > 0 ? firstY + size - 1 : firstY;
+
+    // Where the ray leaves the block in each axis
+    double exitX = walk->dirX != 0 ? walk->sideDistX + abs(lastX - walk->mapX) * walk->deltaDistX : DBL_MAX;
+    double exitY = walk->dirY != 0 ? walk->sideDistY + abs(lastY - walk->mapY) * walk->deltaDistY : DBL_MAX;
+
+    if (exitX < exitY) {
+        walk->length = exitX;
+        walk->hitSide = X_AXIS;
+        walk->mapX = lastX + walk->sideX;
+        walk->mapY = (int) floor((walk->posY + exitX * walk->dirY) / walk->tileSize);
+        walk->mapY = walk->mapY < firstY ? firstY : (walk->mapY > firstY + size - 1 ? firstY + size - 1 : walk->mapY);
+    } else {
+        walk->length = exitY;
+        walk->hitSide = Y_AXIS;
+        walk->mapY = lastY + walk->sideY;
+        walk->mapX = (int) floor((walk->posX + exitY * walk->dirX) / walk->tileSize);
+        walk->mapX = walk->mapX < firstX ? firstX : (walk->mapX > firstX + size - 1 ? firstX + size - 1 : walk->mapX);
+    }
+
+    if (walk->dirX != 0) walk->sideDistX = borderDist(walk->mapX, walk->sideX, walk->posX, walk->tileSize, walk->deltaDistX);
+    if (walk->dirY != 0) walk->sideDistY = borderDist(walk->mapY, walk->sideY, walk->posY, walk->tileSize, walk->deltaDistY);
+}
+
+// INTERNAL: whether the current cell is in the map (a ray that leaves the map never enters it again) and closer than
+// the walk's maxLength
+static bool walkInMap(rayWalk* walk) {
+    return walk->mapX >= 0 && walk->mapX < MapGetNumRows(walk->map) && walk->mapY >= 0 && walk->mapY < MapGetNumCols(walk->map)
+        && walk->length < walk->maxLength;
+}
+
+// INTERNAL: moves to the first cell after the (aligned) block of size x size cells that contains the current cell
+static void walkSkipBlock(rayWalk* walk, int size) {
+    walkSkipBox(walk, walk->mapX & ~(size - 1), walk->mapY & ~(size - 1), size);
+}
+
+// INTERNAL: walkNext for TRAVERSAL_FIXED, one cell at a time with integer math only
+static bool walkNextFixed(rayWalk* walk) {
+    while (true) {
+        if (walk->fixedSideX < walk->fixedSideY) {
+            walk->fixedLength = walk->fixedSideX;
+            walk->fixedSideX += walk->fixedDeltaX;
+            walk->mapX += walk->sideX;
+            walk->hitSide = X_AXIS;
+        } else {
+            walk->fixedLength = walk->fixedSideY;
+            walk->fixedSideY += walk->fixedDeltaY;
+            walk->mapY += walk->sideY;
+            walk->hitSide = Y_AXIS;
+        }
+        walk->length = (double) walk->fixedLength / (double) FIXED_ONE;
+
+        if (!walkInMap(walk)) {
+            return false;
+        }
+        walkUpdateChunk(walk);
+
+        int inX = walk->mapX & MAP_CHUNK_MASK;
+        int inY = walk->mapY & MAP_CHUNK_MASK;
+        if (walk->solid != NULL && ((walk->solid[inX] >> inY) & 1)) {
+            walk->tile = walk->chunk[(inX << MAP_CHUNK_SHIFT) | inY];
+            return true;
+        }
+    }
+}
+
+// INTERNAL: advances the walk to the next cell that is not GROUND, skipping empty space as the traversal allows.
+// Returns false if the ray left the map or got to maxLength.
+static bool walkNext(rayWalk* walk) {
+    if (walk->traversal == TRAVERSAL_FIXED) {
+        return walkNextFixed(walk);
+    }
+
+    while (true) {
+        if (walk->sideDistX < walk->sideDistY) {
+            walk->length = walk->sideDistX;
+            walk->sideDistX += walk->deltaDistX;
+            walk->mapX += walk->sideX;
+            walk->hitSide = X_AXIS;
+        } else {
+            walk->length = walk->sideDistY;
+            walk->sideDistY += walk->deltaDistY;
+            walk->mapY += walk->sideY;
+            walk->hitSide = Y_AXIS;
+        }
+
+        while (walkInMap(walk)) {
+            walkUpdateChunk(walk);
+            if (walk->traversal == TRAVERSAL_DDA) {
+                break;
+            }
+            if (walk->chunk == NULL) {
+                walkSkipBlock(walk, MAP_CHUNK_SIZE);
+                continue;
+            }
+
+            int inX = walk->mapX & MAP_CHUNK_MASK;
+            int inY = walk->mapY & MAP_CHUNK_MASK;
+            if (walk->traversal == TRAVERSAL_MIPGRID) {
+                if ((walk->blocks & (1ULL << ((inX >> MAP_BLOCK_SHIFT) * MAP_CHUNK_BLOCKS + (inY >> MAP_BLOCK_SHIFT)))) == 0) {
+                    walkSkipBlock(walk, MAP_BLOCK_SIZE);
+                    continue;
+                }
+            } else {
+                // Every cell closer than the distance is GROUND, so the square of them around this one is skipped
+                int dist = walk->distance[(inX << MAP_CHUNK_SHIFT) | inY];
+                if (dist > 1) {
+                    walkSkipBox(walk, walk->mapX - (dist - 1), walk->mapY - (dist - 1), 2*dist - 1);
+                    continue;
+                }
+            }
+            break;
+        }
+        if (!walkInMap(walk)) {
+            return false;
+        }
+
+        // The tile is only read for cells that are solid
+        int inX = walk->mapX & MAP_CHUNK_MASK;
+        int inY = walk->mapY & MAP_CHUNK_MASK;
+        if (walk->solid != NULL && ((walk->solid[inX] >> inY) & 1)) {
+            walk->tile = walk->chunk[(inX << MAP_CHUNK_SHIFT) | inY];
+            return true;
+        }
+    }
+}
+
+// INTERNAL: where the ray entered the current cell (pixels)
+static Vector2d walkPoint(rayWalk* walk) {
+    if (walk->traversal == TRAVERSAL_FIXED) {
+        // Q2.30 * 16.16, brought back to 16.16
+        long long offsetX = walk->fixedLength * (walk->fixedDirX / (1LL << (FIXED_TRIG_SHIFT - FIXED_SHIFT))) / FIXED_ONE;
+        long long offsetY = walk->fixedLength * (walk->fixedDirY / (1LL << (FIXED_TRIG_SHIFT - FIXED_SHIFT))) / FIXED_ONE;
+        return (Vector2d) {walk->posX + (double) offsetX / (double) FIXED_ONE, walk->posY + (double) offsetY / (double) FIXED_ONE};
+    }
+
+    return (Vector2d) {walk->posX + walk->length * walk->dirX, walk->posY + walk->length * walk->dirY};
+}
+
+// INTERNAL: least alpha of the texture column of a tile that PlayerDraw3D draws for a hit at a point (pixels)
+static unsigned char tileColumnAlpha(Map map, Tile tile, MapRayHitSide hitSide, Vector2d point) {
+    TextureHandle handle = TileGetTextureHandle(tile);
+    int width = TextureCacheGetTexture(handle).width;
+    int tileSize = MapGetTileSize(map);
+
+    int axis = hitSide == X_AXIS ? (int) (float) point.y : (int) (float) point.x;
+    float u1 = (float) (axis % tileSize + 1) / tileSize;
+    return TextureCacheGetColumnAlpha(handle, u1 - 1.0f / width, u1);
+}
+
+void MapRaySetTraversal(MapRayTraversal mode) {
+    assert(mode >= TRAVERSAL_DDA && mode <= TRAVERSAL_FIXED);
+
+    if (mode == TRAVERSAL_FIXED && !fixedTablesBuilt) {
+        buildFixedTables();
+    }
+    traversal = mode;
+}
+
+MapRayTraversal MapRayGetTraversal(void) {
+    return traversal;
+}
+
+const char* MapRayGetTraversalName(MapRayTraversal mode) {
+    switch (mode) {
+        case TRAVERSAL_DDA:         return "DDA";
+        case TRAVERSAL_MIPGRID:     return "mip-grid";
+        case TRAVERSAL_DISTANCE:    return "distance field";
+        case TRAVERSAL_FIXED:       return "fixed-point DDA";
+    }
+    return "unknown";
+}
+
 void MapRayCast(MapRay ray) {
     assert(ray != NULL);
 
     // Set start variables
     ray->length = 0;
     ray->is_colliding = false;
+    ray->endX = ray->posX;
+    ray->endY = ray->posY;
 
     // clear collisions
-    ListMoveToStart(ray->collisions);
-    while (ListCanOperate(ray->collisions)) {
-        free(ListGetCurrent(ray->collisions));
-        ListRemoveFirst(ray->collisions);
-    }
+    clearCollisions(ray);
 
     // No map behaviour
     if (ray->map == NULL) {
@@ -244,74 +630,22 @@ void MapRayCast(MapRay ray) {
         return;
     }
 
-    int tileSize = MapGetTileSize(ray->map);
-
-    // Position of ray in map
-    int mapX = (int) ray->posX / MapGetTileSize(ray->map);
-    int mapY = (int) ray->posY / MapGetTileSize(ray->map);
+    rayWalk walk;
+    walkStart(&walk, ray->map, ray->posX, ray->posY, MapRayGetTrueAngleRad(ray));
+    double transmittance = 1;       // Share of what is behind the tiles hit so far that is seen through them
 
-    // Angle of ray by axis
-    double rayDirX = cos(MapRayGetTrueAngleRad(ray));
-    double rayDirY = sin(MapRayGetTrueAngleRad(ray));
-    
-    // Length that ray must traverse to go from one X/Y to the next, respectively.
-    double deltaDistX = ray->max_length;
-    if (rayDirX != 0) {
-        deltaDistX = fabs(1 / rayDirX);
-        deltaDistX *= tileSize;
-    }
-    double deltaDistY = ray->max_length;
-    if (rayDirY != 0) {
-        deltaDistY = fabs(1 / rayDirY);
-        deltaDistY *= tileSize;
-    }
-
-    // Length that ray must traverse initially to go to the next X/Y, respectively. (fraction of deltaDist)
-    double sideDistX;
-    double sideDistY;
-    // Side where player is facing in each direction
-    int sideX;
-    int sideY;
-    if (rayDirX < 0) {
-        sideX = -1;
-        sideDistX = (ray->posX - mapX * tileSize) * deltaDistX / tileSize;
-    } else {
-        sideX = 1;
-        sideDistX = ((mapX + 1)*tileSize - ray->posX) * deltaDistX / tileSize;
-    }
-    if (rayDirY < 0) {
-        sideY = -1;
-        sideDistY = (ray->posY - mapY * tileSize) * deltaDistY / tileSize;
-    } else {
-        sideY = 1;
-        sideDistY = ((mapY + 1)*tileSize - ray->posY) * deltaDistY / tileSize;
+    // Nothing is seen past the depth (along the view direction) of full fog
+    double fogDepth = ColormapGetFogDepth(MapGetColormap(ray->map));
+    if (fogDepth >= 0 && cos(ray->angle_offset) > 0) {
+        walk.maxLength = fogDepth * MapGetTileSize(ray->map) / cos(ray->angle_offset);
     }
-    
-    int i = 0;
-    while (!ray->is_colliding) {
-        MapRayHitSide hitSide;
-        
-        if (sideDistX < sideDistY) {
-            sideDistX += deltaDistX;
-            mapX += sideX;
-            ray->length = sideDistX - deltaDistX;
-            hitSide = X_AXIS;
-        } else {
-            sideDistY += deltaDistY;
-            mapY += sideY;
-            ray->length = sideDistY - deltaDistY;
-            hitSide = Y_AXIS;
-        }
-        
-        ray->is_colliding = MapGetTile(ray->map, mapX, mapY) != TILE_GROUND;
-        
-        if (!ray->is_colliding) {
-            goto loop_continue;
-        }
+
+    while (walkNext(&walk)) {
+        ray->length = walk.length;
 
         // Calculate billboard collisions first because they are before the wall
         // Get possible Billboard collisions
-        List billboards = MapGetBillboardsAt(ray->map, mapX, mapY);
+        List billboards = MapGetBillboardsAt(ray->map, walk.mapX, walk.mapY);
 
         ListMoveToStart(billboards);
 
@@ -341,47 +675,222 @@ void MapRayCast(MapRay ray) {
 
         ListDestroy(&billboards);
 
-        Tile collidingTile = MapGetTileObject(ray->map, MapGetTile(ray->map, mapX, mapY));
+        Tile collidingTile = MapGetTileObject(ray->map, walk.tile);
+        Vector2d point = walkPoint(&walk);
         rayCollision* col = malloc(sizeof(rayCollision));
         *col = (rayCollision) {
-            .collisionX = ray->posX + ray->length * rayDirX,
-            .collisionY = ray->posY + ray->length * rayDirY,
-            .collisionGridX = mapX,
-            .collisionGridY = mapY,
+            .collisionX = point.x,
+            .collisionY = point.y,
+            .collisionGridX = walk.mapX,
+            .collisionGridY = walk.mapY,
             .collisionType = COLLISION_MAP_TILE,
             .tile = collidingTile,
-            .hitSide = hitSide
+            .hitSide = walk.hitSide
         };
         ListAppendFirst(ray->collisions, col);
-        // If the colliding tile is transparent, then just continue
-        ray->is_colliding = !TileIsTransparent(collidingTile);
 
-    loop_continue:
-        if (i == MAX_RAY_STEPS) {
+        // If the colliding tile is transparent, then just continue, until the tiles hit cover the column
+        if (!TileIsTransparent(collidingTile)) {
+            break;
+        }
+        transmittance *= 1 - tileColumnAlpha(ray->map, collidingTile, walk.hitSide, point) / 255.0;
+        if (transmittance < RENDER_MIN_TRANSMITTANCE) {
             break;
         }
-        i++;
     }
+    ray->length = walk.length;
+    Vector2d end = walkPoint(&walk);
+    ray->endX = end.x;
+    ray->endY = end.y;
     
     ray->is_colliding = ListGetSize(ray->collisions) > 0;
 }
 
-void MapRayDraw2D(MapRay ray) {
+bool MapRayHitsSameFace(MapRay ray1, MapRay ray2) {
+    assert(ray1 != NULL);
+    assert(ray2 != NULL);
+
+    // Only a single opaque tile (no billboards or transparent tiles in front). A transparent tile can also be the only
+    // collision, where its texture is opaque, but other rays on its face can see through it.
+    if (ListGetSize(ray1->collisions) != 1 || ListGetSize(ray2->collisions) != 1
+        || ray1->posX != ray2->posX || ray1->posY != ray2->posY || ray1->map != ray2->map) {
+        return false;
+    }
+
+    rayCollision col1 = getCollision(ray1->collisions, 0);
+    rayCollision col2 = getCollision(ray2->collisions, 0);
+
+    return col1.collisionType == COLLISION_MAP_TILE && col2.collisionType == COLLISION_MAP_TILE
+        && !TileIsTransparent(col1.tile) && col1.collisionGridX == col2.collisionGridX && col1.collisionGridY == col2.collisionGridY
+        && col1.hitSide == col2.hitSide && col1.tile == col2.tile;
+}
+
+bool MapRayCastOnFace(MapRay ray, MapRay hit) {
     assert(ray != NULL);
-    
-    Color color;
-    if (ray->is_colliding) {
-        color = (Color) {255, 0, 255, 255};
+    assert(hit != NULL);
+    assert(ListGetSize(hit->collisions) == 1);
+
+    rayCollision face = getCollision(hit->collisions, 0);
+    int tileSize = MapGetTileSize(hit->map);
+    double dirX = cos(MapRayGetTrueAngleRad(ray));
+    double dirY = sin(MapRayGetTrueAngleRad(ray));
+
+    // The face is the side of the cell that faces the ray's start
+    double length;
+    double along;       // Coordinate of the hit along the face
+    int cellStart;      // Where the face starts along that axis
+    if (face.hitSide == X_AXIS) {
+        int faceX = ray->posX < face.collisionGridX * tileSize ? face.collisionGridX * tileSize : (face.collisionGridX + 1) * tileSize;
+        length = dirX != 0 ? (faceX - ray->posX) / dirX : -1;
+        along = ray->posY + length * dirY;
+        cellStart = face.collisionGridY * tileSize;
     } else {
-        color = (Color) {0, 255, 255, 255};
+        int faceY = ray->posY < face.collisionGridY * tileSize ? face.collisionGridY * tileSize : (face.collisionGridY + 1) * tileSize;
+        length = dirY != 0 ? (faceY - ray->posY) / dirY : -1;
+        along = ray->posX + length * dirX;
+        cellStart = face.collisionGridX * tileSize;
     }
-        
-    if (ray->is_colliding) {
-        rayCollision lastCollision = getCollision(ray->collisions, 0);
-  
-        DrawLine(ray->posX, ray->posY, (int) lastCollision.collisionX, (int) lastCollision.collisionY, color);
-    } else {
-        DrawLine(ray->posX, ray->posY, (int) (ray->posX + MapRayGetLength(ray)*cos(ray->angle + ray->angle_offset)), (int) (ray->posY + MapRayGetLength(ray)*sin(ray->angle + ray->angle_offset)), color);
+    if (length <= 0 || along < cellStart || along > cellStart + tileSize) {
+        return false;
+    }
+
+    clearCollisions(ray);
+    rayCollision* col = malloc(sizeof(rayCollision));
+    assert(col != NULL);
+    *col = face;
+    col->collisionX = ray->posX + length * dirX;
+    col->collisionY = ray->posY + length * dirY;
+    ListAppendFirst(ray->collisions, col);
+    ray->length = length;
+    ray->endX = col->collisionX;
+    ray->endY = col->collisionY;
+    ray->is_colliding = true;
+
+    return true;
+}
+
+// Line of sight queries given to each worker at a time
+#define SIGHT_JOB_SIZE 256
+
+typedef struct sightJob {
+    Map map;
+    const bool* opaque;         // Whether each tile ID blocks sight
+    const mapSightQuery* queries;
+    mapSightResult* results;
+    int numQueries;
+} sightJob;
+
+// INTERNAL: narrows [*tEnter, *tExit] (fractions of a segment) to where start + t * delta is in [0, size] in one axis.
+// Returns false if nothing is left.
+static bool clipAxis(double start, double delta, double size, double* tEnter, double* tExit) {
+    if (delta == 0) {
+        return start >= 0 && start <= size;
+    }
+    double t0 = (0 - start) / delta;
+    double t1 = (size - start) / delta;
+    if (t0 > t1) {
+        double swap = t0;
+        t0 = t1;
+        t1 = swap;
+    }
+    *tEnter = t0 > *tEnter ? t0 : *tEnter;
+    *tExit = t1 < *tExit ? t1 : *tExit;
+
+    return *tEnter <= *tExit;
+}
+
+// INTERNAL: answers a line of sight query
+static mapSightResult checkSight(Map map, const bool* opaque, mapSightQuery query) {
+    double dx = query.toX - query.fromX;
+    double dy = query.toY - query.fromY;
+    double length = sqrt(dx*dx + dy*dy);
+    int tileSize = MapGetTileSize(map);
+    int numRows = MapGetNumRows(map);
+    int numCols = MapGetNumCols(map);
+
+    // The segment is clipped to the map, as the walk stops at the first cell outside of it
+    double tEnter = 0;
+    double tExit = 1;
+    if (!clipAxis(query.fromX, dx, (double) numRows * tileSize, &tEnter, &tExit)
+        || !clipAxis(query.fromY, dy, (double) numCols * tileSize, &tEnter, &tExit)) {
+        return (mapSightResult) {true, -1, -1, length};
+    }
+
+    // First cell of the segment in the map, entered enter from the start. A segment that only touches the far edges
+    // of the map starts in the cell past them, and walks out of the map.
+    double enter = tEnter * length;
+    int firstX = (int) floor((query.fromX + tEnter * dx) / tileSize);
+    int firstY = (int) floor((query.fromY + tEnter * dy) / tileSize);
+    if (length > 0 && enter >= length) {
+        return (mapSightResult) {true, -1, -1, length};
+    }
+    if (firstX >= 0 && firstX < numRows && firstY >= 0 && firstY < numCols && MapIsSolidAt(map, firstX * tileSize, firstY * tileSize)
+        && opaque[MapGetTile(map, firstX, firstY)]) {
+        return (mapSightResult) {false, firstX, firstY, enter};
+    }
+    if (length == 0) {
+        return (mapSightResult) {true, -1, -1, 0};
+    }
+
+    // Transparent tiles are walked through, from the first cell up to the end of the segment. Lengths stay measured
+    // from the start of the segment.
+    rayWalk walk;
+    walkBegin(&walk, map, query.fromX, query.fromY, TRAVERSAL_MIPGRID);
+    walk.mapX = firstX;
+    walk.mapY = firstY;
+    walk.length = enter;
+    walkUpdateChunk(&walk);
+    walkSetDirection(&walk, dx / length, dy / length);
+    walk.maxLength = length;
+    while (walkNext(&walk)) {
+        if (opaque[walk.tile]) {
+            return (mapSightResult) {false, walk.mapX, walk.mapY, walk.length};
+        }
+    }
+
+    return (mapSightResult) {true, -1, -1, length};
+}
+
+// INTERNAL: answers the queries of a sightJob (run by the workers)
+static void runSightJob(void* arg) {
+    sightJob* job = arg;
+
+    for (int i = 0; i < job->numQueries; i++) {
+        job->results[i] = checkSight(job->map, job->opaque, job->queries[i]);
+    }
+}
+
+void MapRayCheckSight(Map map, const mapSightQuery* queries, mapSightResult* results, int numQueries, WorkerPool pool) {
+    assert(map != NULL);
+    assert(numQueries >= 0);
+    assert(numQueries == 0 || (queries != NULL && results != NULL));
+
+    // Tiles are looked up once here, so the workers only read the grid
+    int numTiles = MapGetNumTiles(map);
+    bool* opaque = malloc(numTiles * sizeof(bool));
+    assert(opaque != NULL);
+    for (int tile = 0; tile < numTiles; tile++) {
+        opaque[tile] = tile != TILE_GROUND && !TileIsTransparent(MapGetTileObject(map, tile));
+    }
+
+    int numJobs = (numQueries + SIGHT_JOB_SIZE - 1) / SIGHT_JOB_SIZE;
+    if (pool == NULL || numJobs < 2 || MapIsStreamed(map)) {
+        runSightJob(&(sightJob) {map, opaque, queries, results, numQueries});
+        free(opaque);
+        return;
     }
+
+    sightJob* jobs = malloc(numJobs * sizeof(sightJob));
+    assert(jobs != NULL);
+    for (int i = 0; i < numJobs; i++) {
+        int first = i * SIGHT_JOB_SIZE;
+        int count = numQueries - first < SIGHT_JOB_SIZE ? numQueries - first : SIGHT_JOB_SIZE;
+        jobs[i] = (sightJob) {map, opaque, queries + first, results + first, count};
+        WorkerPoolSubmit(pool, runSightJob, &jobs[i]);
+    }
+    WorkerPoolWait(pool);
+
+    free(jobs);
+    free(opaque);
 }
 
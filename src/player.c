@@ -1,10 +1,15 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
+#include <math.h>
 #include "player.h"
 #include "mapray.h"
 #include "raylib.h"
 #include "raymath.h"
+#include "rlgl.h"
+
+// Rays drawn in the 2D view per rlgl batch
+#define RAY_BATCH_SIZE 1024
 
 struct player {
     double posX;
@@ -16,8 +21,24 @@ struct player {
     double sensitivity;             // For the mouse. In radians
     int FOV;                        // Degrees
     int numRays;
+    int rayCapacity;                // MapRays created in rays and lastRays (the first numRays are used)
     MapRay* rays;
+    int castStep;                   // See PlayerSetCastStep
+    int numCasts;                   // Rays that walked the grid in the last update
+    PlayerRayView rayView;          // See PlayerSetRayView
+    int rayDrawStep;                //
     Map map;                        // NULL if player is not in any map
+
+    // Results of the previous update, reused while the player only turns (see updateRays)
+    MapRay* lastRays;
+    bool lastValid;                 // False if there are none, or the map was changed
+    int lastX;                      // Where they were cast from
+    int lastY;                      //
+    double lastRotation;
+    unsigned int lastVersion;       // MapGetVersion when they were cast
+    unsigned int lastBillboardVersion;  // MapGetBillboardVersion when they were cast
+    MapRayTraversal lastTraversal;  // MapRayGetTraversal when they were cast
+    bool raysChanged;               // Whether the last update changed the rays
 };
 
 // Internal: check if position is colliding with map
@@ -27,11 +48,38 @@ static bool isColliding(int posX, int posY, Map map) {
         return false;
     }
 
-    // Get grid position
-    int gridPosX = (int) (posX) / MapGetTileSize(map);
-    int gridPosY = (int) (posY) / MapGetTileSize(map);
+    return MapIsSolidAt(map, posX, posY);
+}
 
-    return MapGetTile(map, gridPosX, gridPosY) != TILE_GROUND;
+// INTERNAL: spreads the player's rays over its FOV
+static void spreadRays(Player p, MapRay* rays) {
+    if (p->numRays == 1) {
+        MapRaySetAngleOffset(rays[0], 0);
+        return;
+    }
+
+    double angle_offset = -p->FOV/2;
+    for (int i = 0; i < p->numRays; i++) {
+        MapRaySetAngleOffset(rays[i], angle_offset*DEG2RAD);
+        angle_offset += (double) p->FOV / (double) (p->numRays - 1);
+    }
+}
+
+// INTERNAL: makes room for numRays rays, only creating the MapRays that are missing
+static void reserveRays(Player p, int numRays) {
+    if (numRays <= p->rayCapacity) {
+        return;
+    }
+
+    p->rays = realloc(p->rays, sizeof(MapRay)*numRays);
+    p->lastRays = realloc(p->lastRays, sizeof(MapRay)*numRays);
+    assert(p->rays != NULL && p->lastRays != NULL);
+
+    for (int i = p->rayCapacity; i < numRays; i++) {
+        p->rays[i] = MapRayCreate((int) p->posX, (int) p->posY, p->rotation, 0, p->map);
+        p->lastRays[i] = MapRayCreate((int) p->posX, (int) p->posY, p->rotation, 0, p->map);
+    }
+    p->rayCapacity = numRays;
 }
 
 Player PlayerCreate(int playerX, int playerY, int playerRotationDeg, int numRays, Map map) {
@@ -47,21 +95,20 @@ Player PlayerCreate(int playerX, int playerY, int playerRotationDeg, int numRays
     pl->sensitivity = 80*DEG2RAD;
     pl->FOV = 60;
     pl->numRays = numRays;
+    pl->castStep = 1;
+    pl->numCasts = 0;
+    pl->rayView = RAY_VIEW_LINES;
+    pl->rayDrawStep = 1;
     pl->map = map;
 
-    pl->rays = malloc(sizeof(MapRay)*numRays);
-    assert(pl->rays != NULL);
-
-    // Initialize rays.
-    if (pl->numRays == 1) {
-        pl->rays[0] = MapRayCreate((int) pl->posX, (int) pl->posY, pl->rotation, 0, pl->map);
-    } else {   
-        double angle_offset = -pl->FOV/2;
-        for (int i = 0; i < pl->numRays; i++) {
-            pl->rays[i] = MapRayCreate((int) pl->posX, (int) pl->posY, pl->rotation, angle_offset*DEG2RAD, pl->map);
-            angle_offset += (double) pl->FOV / (double) (pl->numRays - 1);
-        }
-    }
+    pl->rays = NULL;
+    pl->lastRays = NULL;
+    pl->rayCapacity = 0;
+    reserveRays(pl, numRays);
+    spreadRays(pl, pl->rays);
+    spreadRays(pl, pl->lastRays);
+    pl->lastValid = false;
+    pl->raysChanged = true;
 
     return pl;
 }
@@ -73,10 +120,12 @@ void PlayerDestroy(Player* pp) {
     Player p = *pp;
 
     // Destroy rays.
-    for (int i = 0; i < p->numRays; i++) {
+    for (int i = 0; i < p->rayCapacity; i++) {
         MapRayDestroy(&p->rays[i]);
+        MapRayDestroy(&p->lastRays[i]);
     }
     free(p->rays);
+    free(p->lastRays);
     free(p);
     *pp = NULL;
 }
@@ -85,22 +134,145 @@ void PlayerSetMap(Player p, Map map) {
     assert(p != NULL);
 
     p->map = map;
+    p->lastValid = false;
 
-    for (int i = 0; i < p->numRays; i++) {
+    for (int i = 0; i < p->rayCapacity; i++) {
         MapRaySetMap(p->rays[i], map);
+        MapRaySetMap(p->lastRays[i], map);
+    }
+}
+
+// INTERNAL: casts a ray, counting it
+static void castRay(Player p, int i) {
+    MapRayCast(p->rays[i]);
+    p->numCasts++;
+}
+
+// INTERNAL: fills the rays between first and last (both already cast). If both hit the same face, the rays
+// between hit it too and are put on it; otherwise the middle ray is cast and each half is filled the same way.
+static void castSpan(Player p, int first, int last) {
+    if (last - first < 2) {
+        return;
+    }
+
+    if (MapRayHitsSameFace(p->rays[first], p->rays[last])) {
+        for (int i = first + 1; i < last; i++) {
+            if (!MapRayCastOnFace(p->rays[i], p->rays[first])) {
+                castRay(p, i);
+            }
+        }
+        return;
+    }
+
+    int middle = (first + last) / 2;
+    castRay(p, middle);
+    castSpan(p, first, middle);
+    castSpan(p, middle, last);
+}
+
+// INTERNAL: after a rotation, puts each ray on the face that the two previous rays around it hit (so it hits that
+// face too), and casts the rest: the columns that came into view and those at the edges of faces
+static void reuseRays(Player p) {
+    double first = MapRayGetTrueAngleRad(p->lastRays[0]);
+    double step = (MapRayGetTrueAngleRad(p->lastRays[p->numRays - 1]) - first) / (p->numRays - 1);
+
+    for (int i = 0; i < p->numRays; i++) {
+        double angle = MapRayGetTrueAngleRad(p->rays[i]);
+        int j = (int) floor((angle - first) / step);
+
+        // The offsets were added up, so the estimate can be one ray off
+        if (j > 0 && j < p->numRays && angle < MapRayGetTrueAngleRad(p->lastRays[j])) {
+            j--;
+        } else if (j >= 0 && j < p->numRays - 1 && angle > MapRayGetTrueAngleRad(p->lastRays[j + 1])) {
+            j++;
+        }
+
+        if (j >= 0 && j < p->numRays - 1
+            && angle >= MapRayGetTrueAngleRad(p->lastRays[j]) && angle <= MapRayGetTrueAngleRad(p->lastRays[j + 1])
+            && MapRayHitsSameFace(p->lastRays[j], p->lastRays[j + 1])
+            && MapRayCastOnFace(p->rays[i], p->lastRays[j])) {
+            continue;
+        }
+        castRay(p, i);
     }
 }
 
 static void updateRays(Player p) {
     assert(p != NULL);
 
+    // Only turning keeps the previous results valid
+    bool turned = p->lastValid && p->map != NULL
+        && (int) p->posX == p->lastX && (int) p->posY == p->lastY
+        && MapGetVersion(p->map) == p->lastVersion && MapGetBillboardVersion(p->map) == p->lastBillboardVersion
+        && MapRayGetTraversal() == p->lastTraversal;
+    if (turned && p->rotation == p->lastRotation) {
+        p->numCasts = 0;
+        p->raysChanged = false;
+        return;
+    }
+    p->raysChanged = true;
+
+    // The current rays become the previous ones, and the others are filled
+    MapRay* swap = p->lastRays;
+    p->lastRays = p->rays;
+    p->rays = swap;
+
     for (int i = 0; i < p->numRays; i++) {
         MapRaySetAngle(p->rays[i], p->rotation);
         MapRaySetPosition(p->rays[i], (int) p->posX, (int) p->posY);
-        MapRayCast(p->rays[i]);
+    }
+
+    p->numCasts = 0;
+    p->lastValid = p->map != NULL;
+    p->lastX = (int) p->posX;
+    p->lastY = (int) p->posY;
+    p->lastRotation = p->rotation;
+    p->lastVersion = p->map != NULL ? MapGetVersion(p->map) : 0;
+    p->lastBillboardVersion = p->map != NULL ? MapGetBillboardVersion(p->map) : 0;
+    p->lastTraversal = MapRayGetTraversal();
+
+    // (reuseRays interpolates between two previous rays, so a single ray is always cast again)
+    if (turned && p->numRays > 1) {
+        reuseRays(p);
+        return;
+    }
+
+    // Every castStep-th ray (and the last one), then what is between them
+    int previous = -1;
+    for (int i = 0; i < p->numRays; i += p->castStep) {
+        castRay(p, i);
+        if (previous >= 0) {
+            castSpan(p, previous, i);
+        }
+        previous = i;
+    }
+    if (previous != p->numRays - 1) {
+        castRay(p, p->numRays - 1);
+        castSpan(p, previous, p->numRays - 1);
     }
 }
 
+void PlayerSetNumRays(Player p, int numRays) {
+    assert(p != NULL);
+    assert(numRays >= 1);
+
+    if (numRays == p->numRays) {
+        return;
+    }
+
+    reserveRays(p, numRays);
+    p->numRays = numRays;
+    spreadRays(p, p->rays);
+    spreadRays(p, p->lastRays);
+    p->lastValid = false;
+}
+
+int PlayerGetNumRays(Player p) {
+    assert(p != NULL);
+
+    return p->numRays;
+}
+
 void PlayerRotate(Player p, double rot) { // rot is in radians
     assert(p != NULL);
 
@@ -131,6 +303,60 @@ double PlayerGetRotationRad(Player p) {
     return p->rotation;
 }
 
+void PlayerSetCastStep(Player p, int step) {
+    assert(p != NULL);
+    assert(step >= 1);
+
+    if (step != p->castStep) {
+        p->castStep = step;
+        p->lastValid = false;
+    }
+}
+
+int PlayerGetCastStep(Player p) {
+    assert(p != NULL);
+
+    return p->castStep;
+}
+
+int PlayerGetNumCasts(Player p) {
+    assert(p != NULL);
+
+    return p->numCasts;
+}
+
+bool PlayerViewChanged(Player p) {
+    assert(p != NULL);
+
+    return p->raysChanged;
+}
+
+void PlayerSetRayView(Player p, PlayerRayView view) {
+    assert(p != NULL);
+    assert(view == RAY_VIEW_LINES || view == RAY_VIEW_FAN);
+
+    p->rayView = view;
+}
+
+PlayerRayView PlayerGetRayView(Player p) {
+    assert(p != NULL);
+
+    return p->rayView;
+}
+
+void PlayerSetRayDrawStep(Player p, int step) {
+    assert(p != NULL);
+    assert(step >= 1);
+
+    p->rayDrawStep = step;
+}
+
+int PlayerGetRayDrawStep(Player p) {
+    assert(p != NULL);
+
+    return p->rayDrawStep;
+}
+
 double PlayerGetCameraSensitivity(Player p) {
     assert(p != NULL);
     
@@ -156,22 +382,68 @@ bool PlayerIsColliding(Player p) {
 }
 
 
+// INTERNAL: index of the nth ray drawn in the 2D view
+static int drawnRay(Player p, int n) {
+    return n * p->rayDrawStep < p->numRays ? n * p->rayDrawStep : p->numRays - 1;
+}
+
 void PlayerDraw2D(Player p) {
     assert(p != NULL);
 
     DrawCircle((int) p->posX, (int) p->posY, (float) p->size, (Color) {255, 0, 0, 255});
     DrawLine((int) p->posX, (int) p->posY, (int) (p->posX + (20*cos(p->rotation))), (int) (p->posY + (20*sin(p->rotation))), (Color) {0, 0, 255, 255});
 
-    // Draw MapRays
-    for (int i = 0; i < p->numRays; i++) {
-        MapRayDraw2D(p->rays[i]);
+    // Every rayDrawStep-th ray and the last one, in batches of vertices (ray n of them is drawnRay(p, n))
+    if (p->numRays == 0) {
+        return;
+    }
+    int numDrawn = (p->numRays - 1) / p->rayDrawStep + 1 + ((p->numRays - 1) % p->rayDrawStep != 0);
+    Vector2 origin = {(float) (int) p->posX, (float) (int) p->posY};   // Rays start at the player's pixel
+    for (int first = 0; first < numDrawn; first += RAY_BATCH_SIZE) {
+        int last = first + RAY_BATCH_SIZE < numDrawn ? first + RAY_BATCH_SIZE : numDrawn;
+
+        rlCheckRenderBatchLimit(3*RAY_BATCH_SIZE);
+        if (p->rayView == RAY_VIEW_LINES) {
+            rlBegin(RL_LINES);
+            for (int n = first; n < last; n++) {
+                MapRay ray = p->rays[drawnRay(p, n)];
+                Vector2 end = MapRayGetEndPoint(ray);
+                if (MapRayIsColliding(ray)) {
+                    rlColor4ub(255, 0, 255, 255);
+                } else {
+                    rlColor4ub(0, 255, 255, 255);
+                }
+                rlVertex2f(origin.x, origin.y);
+                rlVertex2f(end.x, end.y);
+            }
+            rlEnd();
+        } else {
+            // A triangle between each ray and the next one (counter-clockwise, like raylib's shapes)
+            rlBegin(RL_TRIANGLES);
+            rlColor4ub(255, 0, 255, 96);
+            for (int n = first; n < last && n + 1 < numDrawn; n++) {
+                Vector2 end1 = MapRayGetEndPoint(p->rays[drawnRay(p, n)]);
+                Vector2 end2 = MapRayGetEndPoint(p->rays[drawnRay(p, n + 1)]);
+                if ((end1.x - origin.x)*(end2.y - origin.y) - (end1.y - origin.y)*(end2.x - origin.x) > 0) {
+                    Vector2 swap = end1;
+                    end1 = end2;
+                    end2 = swap;
+                }
+                rlVertex2f(origin.x, origin.y);
+                rlVertex2f(end1.x, end1.y);
+                rlVertex2f(end2.x, end2.y);
+            }
+            rlEnd();
+        }
     }
 }
 
-void PlayerDraw3D(Player p, int screenWidth, int screenHeight) {
+void PlayerDraw3D(Player p, RenderQueue queue, int screenWidth, int screenHeight) {
     assert(p != NULL);
 
-    int line_width = screenWidth / p->numRays;
+    // Columns can be narrower than a pixel, or not a whole number of them
+    float line_width = (float) screenWidth / (float) p->numRays;
+    Colormap colormap = p->map != NULL ? MapGetColormap(p->map) : NULL;
 
     for (int i = 0; i < p->numRays; i++) {
         MapRay ray = p->rays[i];
@@ -179,7 +451,8 @@ void PlayerDraw3D(Player p, int screenWidth, int screenHeight) {
             continue;
         }
         
-        int rayX = (line_width/2)+i*line_width;
+        float rayX = i*line_width;
+        int layer = 0;
 
         List collisions = MapRayGetCollisions(ray);
         ListMoveToStart(collisions);
@@ -193,11 +466,13 @@ void PlayerDraw3D(Player p, int screenWidth, int screenHeight) {
                 double distaux = sqrt(pow(p->posX-collisionPoint.x, 2) + pow(p->posY-collisionPoint.y, 2));
                 double distance = (1.5*MapGetTileSize(p->map)*screenHeight) / (distaux*cos(MapRayGetAngleOffsetRad(ray)));
 
-                Color drawColor = currentCollision.hitSide == X_AXIS ?
-                    (Color) {255, 255, 255, 255}
-                  : (Color) {210, 210, 210, 255};
+                // Shaded by its depth (cells) in the fog, Y sides in a darker light
+                const colormapShade* shade = ColormapGetShade(colormap,
+                    distaux*cos(MapRayGetAngleOffsetRad(ray)) / MapGetTileSize(p->map),
+                    currentCollision.hitSide == X_AXIS ? LIGHT_FULL : LIGHT_SIDE);
     
-                Texture tex = TileGetTexture(currentCollision.tile);
+                TextureHandle handle = TileGetTextureHandle(currentCollision.tile);
+                Texture tex = TextureCacheGetTexture(handle);
                 
                 int coll_point_axis = currentCollision.hitSide == X_AXIS ?
                     (int) (collisionPoint.y)
@@ -209,10 +484,9 @@ void PlayerDraw3D(Player p, int screenWidth, int screenHeight) {
                 double texture_offset = ((double) (ray_percentage) / (double) (MapGetTileSize(p->map)))*((double) tex.width);
                 int texture_width = 1;
     
-                DrawTexturePro(tex,
-                    (Rectangle) {(float) (texture_offset-1), 0, (float) texture_width, (float) tex.height},
-                    (Rectangle) {(float) rayX, (float) ((screenHeight/2)-(distance/2)), (float) line_width, (float) distance},
-                    (Vector2) {0, 0}, 0, drawColor);
+                RenderQueueColumn(queue, handle, layer,
+                    (Rectangle) {rayX, (float) ((screenHeight/2)-(distance/2)), line_width, (float) distance},
+                    (float) ((texture_offset-1)/tex.width), (float) ((texture_offset-1+texture_width)/tex.width), shade);
                 
                 ListMoveToNext(collisions);
             } else if (currentCollision.collisionType == COLLISION_BILLBOARD) {
@@ -221,9 +495,11 @@ void PlayerDraw3D(Player p, int screenWidth, int screenHeight) {
                 double distaux = sqrt(pow(p->posX-collisionPoint.x, 2) + pow(p->posY-collisionPoint.y, 2));
                 double distance = (1.5*BillboardGetSize(bb)*screenHeight) / (distaux*cos(MapRayGetAngleOffsetRad(ray)));
                 
-                Color drawColor = (Color) {255, 255, 255, 255};
+                const colormapShade* shade = ColormapGetShade(colormap,
+                    distaux*cos(MapRayGetAngleOffsetRad(ray)) / MapGetTileSize(p->map), LIGHT_FULL);
     
-                Texture tex = BillboardGetTexture(bb);
+                TextureHandle handle = BillboardGetTextureHandle(bb);
+                Texture tex = TextureCacheGetTexture(handle);
 
                 // Project collision point to plane
 
@@ -249,17 +525,24 @@ void PlayerDraw3D(Player p, int screenWidth, int screenHeight) {
                 
                 int texture_width = 1;    
 
-                DrawTexturePro(tex,
-                    (Rectangle) {(float) (texture_offset-1), 0, (float) texture_width, (float) tex.height},
-                    (Rectangle) {(float) rayX, (float) ((screenHeight/2)-(distance/2)), (float) line_width, (float) distance},
-                    (Vector2) {0, 0}, 0, drawColor);
+                RenderQueueSprite(queue, handle, layer,
+                    (Rectangle) {rayX, (float) ((screenHeight/2)-(distance/2)), line_width, (float) distance},
+                    (float) ((texture_offset-1)/tex.width), (float) ((texture_offset-1+texture_width)/tex.width), shade);
                 
                 ListMoveToNext(collisions);
             }
+            layer++;
         }
     }
 }
 
+void PlayerDrawFlats(Player p, FrameBuffer fb, WorkerPool pool) {
+    assert(p != NULL);
+    assert(p->map != NULL);
+
+    MapDrawFlats(p->map, fb, (int) p->posX, (int) p->posY, p->rotation, p->FOV*DEG2RAD, pool);
+}
+
 void PlayerInput(Player p) {
     assert(p != NULL);
 
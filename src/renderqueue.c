@@ -0,0 +1,617 @@
+#include <stdlib.h>
+#include <assert.h>
+#include <math.h>
+#include "renderqueue.h"
+#include "raylib.h"
+#include "rlgl.h"
+
+// Spans and lines submitted per rlgl batch
+#define SPAN_BATCH_SIZE 1024
+#define LINE_BATCH_SIZE 1024
+
+// Vertical bands the software backend splits a frame into per worker, so that workers that finish early take more
+#define RENDER_BANDS_PER_THREAD 4
+
+// A span to draw with the raylib backend, sorted by layer and texture
+typedef struct spanKey {
+    int layer;
+    unsigned int texture;           // OpenGL texture ID
+    const renderCommand* command;
+} spanKey;
+
+// A vertical band of a frame drawn by the software backend, as a job of a worker
+typedef struct softwareBand {
+    const renderCommand* commands;
+    int numCommands;
+    Color* pixels;
+    int stride;
+    int height;
+    int firstX;                     // Columns of the band (a multiple of FRAMEBUFFER_ALIGN / sizeof(Color), and exclusive)
+    int lastX;                      //
+    double time;                    // Taken to draw it (seconds)
+    long long spanFill;             // Span pixels it drew (see RenderQueueGetSpanFill)
+} softwareBand;
+
+// What the spans of a screen column drawn so far (front to back) put in a row: the premultiplied sum of their colors,
+// and the share of what is behind them that is still seen
+typedef struct spanRow {
+    float r;
+    float g;
+    float b;
+    float transmittance;
+} spanRow;
+
+struct renderqueue {
+    renderCommand* commands;
+    int numCommands;
+    int capacity;
+    spanKey* keys;                  // Sorting space for the raylib backend
+    int keyCapacity;
+    int numBatches;                 // Of the last RenderQueueDraw with the raylib backend
+    softwareBand* bands;            // Of the last RenderQueueDraw with the software backend
+    int numBands;
+    int bandCapacity;
+};
+
+RenderQueue RenderQueueCreate(void) {
+    RenderQueue queue = malloc(sizeof(struct renderqueue));
+    assert(queue != NULL);
+
+    queue->commands = NULL;
+    queue->numCommands = 0;
+    queue->capacity = 0;
+    queue->keys = NULL;
+    queue->keyCapacity = 0;
+    queue->numBatches = 0;
+    queue->bands = NULL;
+    queue->numBands = 0;
+    queue->bandCapacity = 0;
+
+    return queue;
+}
+
+void RenderQueueDestroy(RenderQueue* queuep) {
+    assert(queuep != NULL);
+    assert(*queuep != NULL);
+
+    RenderQueue queue = *queuep;
+
+    free(queue->commands);
+    free(queue->keys);
+    free(queue->bands);
+    free(queue);
+
+    *queuep = NULL;
+}
+
+void RenderQueueClear(RenderQueue queue) {
+    assert(queue != NULL);
+
+    queue->numCommands = 0;
+}
+
+// INTERNAL: adds a command of type to the end of the queue, returning it
+static renderCommand* addCommand(RenderQueue queue, RenderCommandType type, Color color) {
+    if (queue->numCommands == queue->capacity) {
+        queue->capacity = queue->capacity == 0 ? 1024 : queue->capacity * 2;
+        queue->commands = realloc(queue->commands, sizeof(renderCommand) * queue->capacity);
+        assert(queue->commands != NULL);
+    }
+
+    renderCommand* command = &queue->commands[queue->numCommands++];
+    command->type = type;
+    command->color = color;
+    return command;
+}
+
+void RenderQueueColumn(RenderQueue queue, TextureHandle texture, int layer, Rectangle dest, float u0, float u1, const colormapShade* shade) {
+    assert(queue != NULL);
+    assert(texture != NULL);
+
+    renderCommand* command = addCommand(queue, RENDER_COLUMN, ColormapGetTint(shade));
+    command->span.texture = texture;
+    command->span.shade = shade;
+    command->span.layer = layer;
+    command->span.dest = dest;
+    command->span.u0 = u0;
+    command->span.u1 = u1;
+}
+
+void RenderQueueSprite(RenderQueue queue, TextureHandle texture, int layer, Rectangle dest, float u0, float u1, const colormapShade* shade) {
+    assert(queue != NULL);
+    assert(texture != NULL);
+
+    renderCommand* command = addCommand(queue, RENDER_SPRITE, ColormapGetTint(shade));
+    command->span.texture = texture;
+    command->span.shade = shade;
+    command->span.layer = layer;
+    command->span.dest = dest;
+    command->span.u0 = u0;
+    command->span.u1 = u1;
+}
+
+void RenderQueueRect(RenderQueue queue, Rectangle rect, Color color) {
+    assert(queue != NULL);
+
+    addCommand(queue, RENDER_RECT, color)->rect = rect;
+}
+
+void RenderQueueLine(RenderQueue queue, Vector2 start, Vector2 end, Color color) {
+    assert(queue != NULL);
+
+    renderCommand* command = addCommand(queue, RENDER_LINE, color);
+    command->line.start = start;
+    command->line.end = end;
+}
+
+int RenderQueueGetNumCommands(RenderQueue queue) {
+    assert(queue != NULL);
+    return queue->numCommands;
+}
+
+const renderCommand* RenderQueueGetCommand(RenderQueue queue, int index) {
+    assert(queue != NULL);
+    assert(index >= 0 && index < queue->numCommands);
+    return &queue->commands[index];
+}
+
+// INTERNAL: whether two commands are drawn in the same run (spans of either type, or the same type otherwise)
+static bool sameRun(const renderCommand* a, const renderCommand* b) {
+    bool aSpan = a->type == RENDER_COLUMN || a->type == RENDER_SPRITE;
+    bool bSpan = b->type == RENDER_COLUMN || b->type == RENDER_SPRITE;
+    return aSpan || bSpan ? aSpan && bSpan : a->type == b->type;
+}
+
+// INTERNAL: orders spans by layer, then by texture
+static int compareSpans(const void* a, const void* b) {
+    const spanKey* ka = a;
+    const spanKey* kb = b;
+
+    if (ka->layer != kb->layer) {
+        return ka->layer < kb->layer ? -1 : 1;
+    }
+    if (ka->texture != kb->texture) {
+        return ka->texture < kb->texture ? -1 : 1;
+    }
+    return 0;
+}
+
+// INTERNAL: draws count spans through rlgl, a batch per layer and texture. Spans of different screen columns don't
+// overlap, so only the ones of the same column need to keep their order, which the layers do.
+static void drawSpansRaylib(RenderQueue queue, const renderCommand* spans, int count) {
+    if (count > queue->keyCapacity) {
+        queue->keyCapacity = count;
+        queue->keys = realloc(queue->keys, sizeof(spanKey) * queue->keyCapacity);
+        assert(queue->keys != NULL);
+    }
+
+    // Like DrawTexturePro, spans of textures that are not loaded are not drawn
+    int numKeys = 0;
+    for (int i = 0; i < count; i++) {
+        unsigned int texture = TextureCacheGetTexture(spans[i].span.texture).id;
+        if (texture != 0) {
+            queue->keys[numKeys++] = (spanKey) {spans[i].span.layer, texture, &spans[i]};
+        }
+    }
+    qsort(queue->keys, numKeys, sizeof(spanKey), compareSpans);
+
+    int first = 0;
+    while (first < numKeys) {
+        spanKey* bucket = &queue->keys[first];
+        int bucketSize = 1;
+        while (first + bucketSize < numKeys && bucket[bucketSize].layer == bucket->layer && bucket[bucketSize].texture == bucket->texture) {
+            bucketSize++;
+        }
+        queue->numBatches++;
+
+        // Like DrawTexturePro, but with a single texture switch for the whole bucket
+        for (int start = 0; start < bucketSize; start += SPAN_BATCH_SIZE) {
+            int end = start + SPAN_BATCH_SIZE < bucketSize ? start + SPAN_BATCH_SIZE : bucketSize;
+
+            rlCheckRenderBatchLimit(4*(end - start));
+            rlSetTexture(bucket->texture);
+            rlBegin(RL_QUADS);
+            rlNormal3f(0, 0, 1);
+            for (int i = start; i < end; i++) {
+                const renderCommand* span = bucket[i].command;
+                Rectangle dest = span->span.dest;
+                rlColor4ub(span->color.r, span->color.g, span->color.b, span->color.a);
+                rlTexCoord2f(span->span.u0, 0);
+                rlVertex2f(dest.x, dest.y);
+                rlTexCoord2f(span->span.u0, 1);
+                rlVertex2f(dest.x, dest.y + dest.height);
+                rlTexCoord2f(span->span.u1, 1);
+                rlVertex2f(dest.x + dest.width, dest.y + dest.height);
+                rlTexCoord2f(span->span.u1, 0);
+                rlVertex2f(dest.x + dest.width, dest.y);
+            }
+            rlEnd();
+        }
+
+        first += bucketSize;
+    }
+    rlSetTexture(0);
+}
+
+// INTERNAL: draws count lines through rlgl
+static void drawLinesRaylib(RenderQueue queue, const renderCommand* lines, int count) {
+    for (int start = 0; start < count; start += LINE_BATCH_SIZE) {
+        int end = start + LINE_BATCH_SIZE < count ? start + LINE_BATCH_SIZE : count;
+
+        rlCheckRenderBatchLimit(2*(end - start));
+        rlBegin(RL_LINES);
+        for (int i = start; i < end; i++) {
+            rlColor4ub(lines[i].color.r, lines[i].color.g, lines[i].color.b, lines[i].color.a);
+            rlVertex2f(lines[i].line.start.x, lines[i].line.start.y);
+            rlVertex2f(lines[i].line.end.x, lines[i].line.end.y);
+        }
+        rlEnd();
+    }
+    queue->numBatches++;
+}
+
+// INTERNAL: draws the commands with raylib, a run of commands of the same kind at a time
+static void drawRaylib(RenderQueue queue) {
+    queue->numBatches = 0;
+
+    int first = 0;
+    while (first < queue->numCommands) {
+        const renderCommand* run = &queue->commands[first];
+        int count = 1;
+        while (first + count < queue->numCommands && sameRun(run, &run[count])) {
+            count++;
+        }
+
+        switch (run->type) {
+            case RENDER_COLUMN:
+            case RENDER_SPRITE:
+                drawSpansRaylib(queue, run, count);
+                break;
+            case RENDER_RECT:
+                for (int i = 0; i < count; i++) {
+                    DrawRectangleRec(run[i].rect, run[i].color);
+                }
+                queue->numBatches++;
+                break;
+            case RENDER_LINE:
+                drawLinesRaylib(queue, run, count);
+                break;
+        }
+
+        first += count;
+    }
+}
+
+// INTERNAL: draws color over a pixel, blending it by its alpha
+static void blendPixel(Color* pixel, Color color) {
+    if (color.a == 255) {
+        *pixel = color;
+    } else if (color.a != 0) {
+        pixel->r = (color.r * color.a + pixel->r * (255 - color.a)) / 255;
+        pixel->g = (color.g * color.a + pixel->g * (255 - color.a)) / 255;
+        pixel->b = (color.b * color.a + pixel->b * (255 - color.a)) / 255;
+    }
+}
+
+// INTERNAL: first and last (exclusive) pixels whose centers are in [start, start + size), clamped to [min, max)
+static void pixelRange(float start, float size, int min, int max, int* first, int* last) {
+    *first = (int) ceilf(start - 0.5f);
+    *last = (int) ceilf(start + size - 0.5f);
+    *first = *first > min ? *first : min;
+    *last = *last < max ? *last : max;
+}
+
+// INTERNAL: the texel column a span draws: the one at its middle, from the mip level nearest to its scale (NULL if its
+// texture has no CPU copy, and then it is drawn in its tint). Its height is put in height.
+static const Color* spanColumn(const renderCommand* span, int* height) {
+    TextureHandle texture = span->span.texture;
+    if (TextureCacheGetNumLevels(texture) == 0) {
+        return NULL;
+    }
+
+    int texHeight;
+    TextureCacheGetLevelColumns(texture, 0, NULL, &texHeight);
+    int level = TextureCacheSelectLevel(texture, texHeight / span->span.dest.height);
+    int levelWidth;
+    const Color* columns = TextureCacheGetLevelColumns(texture, level, &levelWidth, height);
+
+    // Textures repeat, like on the GPU
+    int u = (int) floorf((span->span.u0 + span->span.u1) / 2 * levelWidth) % levelWidth;
+    return &columns[(u < 0 ? u + levelWidth : u) * *height];
+}
+
+// INTERNAL: draws the part of a span inside band, over what is already drawn
+static void drawSpanSoftware(softwareBand* band, const renderCommand* span) {
+    Rectangle dest = span->span.dest;
+    int firstX, lastX, firstY, lastY;
+    pixelRange(dest.x, dest.width, band->firstX, band->lastX, &firstX, &lastX);
+    pixelRange(dest.y, dest.height, 0, band->height, &firstY, &lastY);
+    if (firstX >= lastX || firstY >= lastY) {
+        return;
+    }
+    band->spanFill += (long long) (lastX - firstX) * (lastY - firstY);
+
+    int levelHeight;
+    const Color* column = spanColumn(span, &levelHeight);
+    if (column == NULL) {
+        for (int y = firstY; y < lastY; y++) {
+            for (int x = firstX; x < lastX; x++) {
+                blendPixel(&band->pixels[(size_t) y * band->stride + x], span->color);
+            }
+        }
+        return;
+    }
+
+    float step = levelHeight / dest.height;
+    const colormapShade* shade = span->span.shade;
+    for (int y = firstY; y < lastY; y++) {
+        int texel = (int) ((y + 0.5f - dest.y) * step);
+        Color color = ColormapApply(shade, column[texel < levelHeight ? texel : levelHeight - 1]);
+        for (int x = firstX; x < lastX; x++) {
+            blendPixel(&band->pixels[(size_t) y * band->stride + x], color);
+        }
+    }
+}
+
+// INTERNAL: number of spans from the first one that are layers of the same screen column: same rectangle columns,
+// and added from the farthest (see RenderQueueDraw)
+static int spanGroupSize(const renderCommand* spans, int count) {
+    int size = 1;
+    while (size < count && (spans[size].type == RENDER_COLUMN || spans[size].type == RENDER_SPRITE)
+        && spans[size].span.dest.x == spans->span.dest.x && spans[size].span.dest.width == spans->span.dest.width
+        && spans[size].span.layer > spans[size - 1].span.layer) {
+        size++;
+    }
+    return size;
+}
+
+// INTERNAL: draws the part inside band of the count spans of a screen column (from the farthest), compositing them from
+// the nearest one into rows (space for the band's height). Each row keeps how much of what is behind is still seen,
+// and the rows that the spans drawn so far cover are skipped, down to the whole column, where the rest are not drawn.
+static void drawSpanGroupSoftware(softwareBand* band, const renderCommand* spans, int count, spanRow* rows) {
+    int firstX, lastX;
+    pixelRange(spans->span.dest.x, spans->span.dest.width, band->firstX, band->lastX, &firstX, &lastX);
+    if (firstX >= lastX) {
+        return;
+    }
+
+    // Rows that any of the spans is in
+    int top = band->height;
+    int bottom = 0;
+    for (int i = 0; i < count; i++) {
+        int firstY, lastY;
+        pixelRange(spans[i].span.dest.y, spans[i].span.dest.height, 0, band->height, &firstY, &lastY);
+        if (firstY < lastY) {
+            top = firstY < top ? firstY : top;
+            bottom = lastY > bottom ? lastY : bottom;
+        }
+    }
+    if (top >= bottom) {
+        return;
+    }
+    for (int y = top; y < bottom; y++) {
+        rows[y] = (spanRow) {0, 0, 0, 1};
+    }
+
+    int coveredTop = 0;         // Rows that the spans drawn so far cover entirely (empty at first)
+    int coveredBottom = 0;      //
+    for (int i = count - 1; i >= 0 && !(coveredTop <= top && coveredBottom >= bottom); i--) {
+        const renderCommand* span = &spans[i];
+        Rectangle dest = span->span.dest;
+        int firstY, lastY;
+        pixelRange(dest.y, dest.height, 0, band->height, &firstY, &lastY);
+        if (firstY >= lastY) {
+            continue;
+        }
+
+        int levelHeight = 1;
+        const Color* column = spanColumn(span, &levelHeight);
+        float step = levelHeight / dest.height;
+        const colormapShade* shade = span->span.shade;
+
+        bool opaque = true;     // Whether the rows of the span are all covered after it
+        for (int y = firstY; y < lastY; y++) {
+            if (y >= coveredTop && y < coveredBottom) {
+                y = coveredBottom - 1;
+                continue;
+            }
+            spanRow* row = &rows[y];
+            if (row->transmittance == 0) {
+                continue;
+            }
+
+            Color color = span->color;
+            if (column != NULL) {
+                int texel = (int) ((y + 0.5f - dest.y) * step);
+                color = ColormapApply(shade, column[texel < levelHeight ? texel : levelHeight - 1]);
+            }
+            float alpha = color.a / 255.0f;
+            row->r += row->transmittance * alpha * color.r;
+            row->g += row->transmittance * alpha * color.g;
+            row->b += row->transmittance * alpha * color.b;
+            row->transmittance *= 1 - alpha;
+            if (row->transmittance < RENDER_MIN_TRANSMITTANCE) {
+                row->transmittance = 0;
+            } else {
+                opaque = false;
+            }
+            band->spanFill += lastX - firstX;
+        }
+
+        if (opaque && (coveredTop >= coveredBottom || (firstY <= coveredBottom && lastY >= coveredTop))) {
+            coveredTop = coveredTop < coveredBottom && coveredTop < firstY ? coveredTop : firstY;
+            coveredBottom = coveredBottom > lastY ? coveredBottom : lastY;
+        }
+    }
+
+    // Then over what is already drawn
+    for (int y = top; y < bottom; y++) {
+        const spanRow* row = &rows[y];
+        if (row->transmittance == 1) {
+            continue;
+        }
+        for (int x = firstX; x < lastX; x++) {
+            Color* pixel = &band->pixels[(size_t) y * band->stride + x];
+            pixel->r = (unsigned char) (row->r + row->transmittance * pixel->r + 0.5f);
+            pixel->g = (unsigned char) (row->g + row->transmittance * pixel->g + 0.5f);
+            pixel->b = (unsigned char) (row->b + row->transmittance * pixel->b + 0.5f);
+            pixel->a = row->transmittance == 0 ? 255 : pixel->a;
+        }
+    }
+}
+
+// INTERNAL: draws the pixels of a line inside band, a pixel per step along its longest axis
+static void drawLineSoftware(const softwareBand* band, const renderCommand* line) {
+    float dx = line->line.end.x - line->line.start.x;
+    float dy = line->line.end.y - line->line.start.y;
+    int steps = (int) ceilf(fabsf(dx) > fabsf(dy) ? fabsf(dx) : fabsf(dy));
+    if (steps == 0) {
+        steps = 1;
+    }
+
+    for (int i = 0; i <= steps; i++) {
+        int x = (int) floorf(line->line.start.x + dx * i / steps);
+        int y = (int) floorf(line->line.start.y + dy * i / steps);
+        if (x >= band->firstX && x < band->lastX && y >= 0 && y < band->height) {
+            blendPixel(&band->pixels[(size_t) y * band->stride + x], line->color);
+        }
+    }
+}
+
+// INTERNAL: draws the commands, in order, clipped to a band (a softwareBand)
+static void drawBand(void* arg) {
+    softwareBand* band = arg;
+    double start = GetTime();
+    spanRow* rows = NULL;       // For drawSpanGroupSoftware (allocated with the first group)
+
+    band->spanFill = 0;
+    for (int i = 0; i < band->numCommands; i++) {
+        const renderCommand* command = &band->commands[i];
+        switch (command->type) {
+            case RENDER_COLUMN:
+            case RENDER_SPRITE: {
+                int count = spanGroupSize(command, band->numCommands - i);
+                if (count == 1) {
+                    drawSpanSoftware(band, command);
+                    break;
+                }
+                if (rows == NULL) {
+                    rows = malloc(sizeof(spanRow) * band->height);
+                    assert(rows != NULL);
+                }
+                drawSpanGroupSoftware(band, command, count, rows);
+                i += count - 1;
+                break;
+            }
+            case RENDER_RECT: {
+                int firstX, lastX, firstY, lastY;
+                pixelRange(command->rect.x, command->rect.width, band->firstX, band->lastX, &firstX, &lastX);
+                pixelRange(command->rect.y, command->rect.height, 0, band->height, &firstY, &lastY);
+                for (int y = firstY; y < lastY; y++) {
+                    for (int x = firstX; x < lastX; x++) {
+                        blendPixel(&band->pixels[(size_t) y * band->stride + x], command->color);
+                    }
+                }
+                break;
+            }
+            case RENDER_LINE:
+                drawLineSoftware(band, command);
+                break;
+        }
+    }
+
+    free(rows);
+    band->time = GetTime() - start;
+}
+
+// INTERNAL: draws the commands into target, in vertical bands split between the workers of pool (one band if it is NULL).
+// Bands start at cache line boundaries, so no two of them write to the same line.
+static void drawSoftware(RenderQueue queue, FrameBuffer target, WorkerPool pool) {
+    int width = FrameBufferGetWidth(target);
+    int alignPixels = FRAMEBUFFER_ALIGN / sizeof(Color);
+    int numBands = pool != NULL ? WorkerPoolGetNumThreads(pool) * RENDER_BANDS_PER_THREAD : 1;
+    int bandWidth = (width + numBands - 1) / numBands;
+    bandWidth = (bandWidth + alignPixels - 1) / alignPixels * alignPixels;
+    numBands = (width + bandWidth - 1) / bandWidth;
+
+    if (numBands > queue->bandCapacity) {
+        queue->bandCapacity = numBands;
+        queue->bands = realloc(queue->bands, sizeof(softwareBand) * queue->bandCapacity);
+        assert(queue->bands != NULL);
+    }
+    queue->numBands = numBands;
+
+    for (int i = 0; i < numBands; i++) {
+        queue->bands[i] = (softwareBand) {
+            .commands = queue->commands,
+            .numCommands = queue->numCommands,
+            .pixels = FrameBufferGetPixels(target),
+            .stride = FrameBufferGetStride(target),
+            .height = FrameBufferGetHeight(target),
+            .firstX = i * bandWidth,
+            .lastX = (i + 1) * bandWidth < width ? (i + 1) * bandWidth : width,
+            .time = 0,
+            .spanFill = 0,
+        };
+
+        if (pool != NULL) {
+            WorkerPoolSubmit(pool, drawBand, &queue->bands[i]);
+        } else {
+            drawBand(&queue->bands[i]);
+        }
+    }
+    if (pool != NULL) {
+        WorkerPoolWait(pool);
+    }
+}
+
+void RenderQueueDraw(RenderQueue queue, RenderBackend backend, FrameBuffer target, WorkerPool pool) {
+    assert(queue != NULL);
+
+    switch (backend) {
+        case RENDER_BACKEND_RAYLIB:
+            drawRaylib(queue);
+            break;
+        case RENDER_BACKEND_SOFTWARE:
+            assert(target != NULL);
+            drawSoftware(queue, target, pool);
+            break;
+        case RENDER_BACKEND_NULL:
+            break;
+    }
+}
+
+int RenderQueueGetNumBatches(RenderQueue queue) {
+    assert(queue != NULL);
+    return queue->numBatches;
+}
+
+int RenderQueueGetNumBands(RenderQueue queue) {
+    assert(queue != NULL);
+    return queue->numBands;
+}
+
+double RenderQueueGetBandTime(RenderQueue queue, int band) {
+    assert(queue != NULL);
+    assert(band >= 0 && band < queue->numBands);
+    return queue->bands[band].time;
+}
+
+long long RenderQueueGetSpanFill(RenderQueue queue) {
+    assert(queue != NULL);
+
+    long long fill = 0;
+    for (int i = 0; i < queue->numBands; i++) {
+        fill += queue->bands[i].spanFill;
+    }
+    return fill;
+}
+
+const char* RenderQueueGetBackendName(RenderBackend backend) {
+    switch (backend) {
+        case RENDER_BACKEND_RAYLIB:     return "raylib";
+        case RENDER_BACKEND_SOFTWARE:   return "software";
+        case RENDER_BACKEND_NULL:       return "null";
+    }
+    return "unknown";
+}
@@ -0,0 +1,30 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "strutil.h"
+
+unsigned int StringHash(void* key) {
+    const char* str = key;
+
+    unsigned int hash = 5381;
+    int c;
+
+    while ((c = *str++)) {
+        hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
+    }
+
+    return hash;
+}
+
+bool StringEquals(void* key1, void* key2) {
+    return strcmp((char*) key1, (char*) key2) == 0;
+}
+
+char* StringCopy(const char* str) {
+    size_t length = strlen(str);
+    char* copy = malloc(length + 1);
+    assert(copy != NULL);
+    memcpy(copy, str, length + 1);
+
+    return copy;
+}
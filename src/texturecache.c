@@ -0,0 +1,578 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdatomic.h>
+#include <math.h>
+#include "texturecache.h"
+#include "strutil.h"
+#include "raylib.h"
+#include "hashmap.h"
+#include "list.h"
+#include "workerpool.h"
+
+struct cachedtexture {
+    char* key;              // Resolved path, or description of the contents for textures not loaded from files
+    Texture texture;        // The placeholder until the first decode finishes
+    Image image;            // CPU copy (image.data is NULL if not kept)
+    Color* columns;         // Mip chain of column-major copies of image, one level after the other (see
+                            // TextureCacheGetColumns; NULL if not kept)
+    int numLevels;          //
+    int levelOffset[TEXTURECACHE_MAX_LEVELS];   // Where each level starts in columns (texels)
+    unsigned char* columnAlpha; // Least alpha of each column of the texture (NULL until it is loaded)
+    long modTime;           // Modification time of the file when it was loaded (0 for textures not loaded from files)
+    int refs;               // Number of handles in use
+    bool loaded;            // Whether texture is the entry's own (not the placeholder)
+    int generation;         // Incremented on every decode request, so that only the latest one is uploaded
+    int pending;            // Decodes requested but not uploaded yet
+};
+
+// An image being decoded by a worker
+typedef struct decodeJob {
+    TextureHandle handle;
+    int generation;         // Generation of the handle when the decode was requested
+    char* path;             // File to decode (NULL when decoding data)
+    unsigned char* data;    // File contents to decode (owned by the job)
+    int size;
+    char fileType[16];
+    Image image;            // Result (image.data is NULL on failure)
+    atomic_bool done;
+} decodeJob;
+
+static HashMap textures = NULL;     // Key (char*) -> TextureHandle
+static bool keepImages = false;
+static bool async = true;
+
+static WorkerPool decoders = NULL;
+static List jobs = NULL;            // decodeJob* not uploaded yet
+static Texture placeholder = {0};
+static unsigned int version = 0;    // See TextureCacheGetVersion
+
+// INTERNAL: path as seen from the working directory, so that the same file reached from different directories is the same key
+static const char* resolvePath(const char* path) {
+    if (path[0] == '/' || (path[0] != '\0' && path[1] == ':')) {
+        return path;
+    }
+
+    const char* relative = path;
+    while (strncmp(relative, "./", 2) == 0) {
+        relative += 2;
+    }
+
+    return TextFormat("%s/%s", GetWorkingDirectory(), relative);
+}
+
+// Side of the square blocks that images are transposed in, so that both the rows read and the columns written stay in cache
+#define TRANSPOSE_BLOCK 16
+
+// INTERNAL: returns a column-major copy of an image's texels (texel (x, y) at x*height + y)
+static Color* transposeImage(Image img) {
+    Color* rows = LoadImageColors(img);
+    Color* columns = malloc(sizeof(Color) * img.width * img.height);
+    if (rows == NULL || columns == NULL) {
+        perror("Out of memory");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int blockY = 0; blockY < img.height; blockY += TRANSPOSE_BLOCK) {
+        for (int blockX = 0; blockX < img.width; blockX += TRANSPOSE_BLOCK) {
+            int lastY = blockY + TRANSPOSE_BLOCK < img.height ? blockY + TRANSPOSE_BLOCK : img.height;
+            int lastX = blockX + TRANSPOSE_BLOCK < img.width ? blockX + TRANSPOSE_BLOCK : img.width;
+            for (int y = blockY; y < lastY; y++) {
+                for (int x = blockX; x < lastX; x++) {
+                    columns[x * img.height + y] = rows[y * img.width + x];
+                }
+            }
+        }
+    }
+
+    UnloadImageColors(rows);
+    return columns;
+}
+
+// INTERNAL: makes the mip chain of an entry's column-major copy, from its image. Each level is a 2x2 box filter of the
+// previous one (texels past the edges of odd sizes repeat the last ones), down to 1x1.
+static void buildLevels(TextureHandle handle) {
+    int width = handle->image.width;
+    int height = handle->image.height;
+    size_t total = 0;
+    handle->numLevels = 0;
+    while (handle->numLevels < TEXTURECACHE_MAX_LEVELS) {
+        handle->levelOffset[handle->numLevels++] = (int) total;
+        total += (size_t) width * height;
+        if (width == 1 && height == 1) {
+            break;
+        }
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+
+    Color* level0 = transposeImage(handle->image);
+    handle->columns = realloc(level0, sizeof(Color) * total);
+    if (handle->columns == NULL) {
+        perror("Out of memory");
+        exit(EXIT_FAILURE);
+    }
+
+    width = handle->image.width;
+    height = handle->image.height;
+    for (int level = 1; level < handle->numLevels; level++) {
+        const Color* prev = handle->columns + handle->levelOffset[level - 1];
+        Color* next = handle->columns + handle->levelOffset[level];
+        int nextWidth = width > 1 ? width / 2 : 1;
+        int nextHeight = height > 1 ? height / 2 : 1;
+        for (int x = 0; x < nextWidth; x++) {
+            const Color* col0 = prev + (2*x) * height;
+            const Color* col1 = prev + (2*x + 1 < width ? 2*x + 1 : width - 1) * height;
+            for (int y = 0; y < nextHeight; y++) {
+                int y0 = 2*y;
+                int y1 = 2*y + 1 < height ? 2*y + 1 : height - 1;
+                next[x * nextHeight + y] = (Color) {
+                    (unsigned char) ((col0[y0].r + col0[y1].r + col1[y0].r + col1[y1].r + 2) / 4),
+                    (unsigned char) ((col0[y0].g + col0[y1].g + col1[y0].g + col1[y1].g + 2) / 4),
+                    (unsigned char) ((col0[y0].b + col0[y1].b + col1[y0].b + col1[y1].b + 2) / 4),
+                    (unsigned char) ((col0[y0].a + col0[y1].a + col1[y0].a + col1[y1].a + 2) / 4),
+                };
+            }
+        }
+        width = nextWidth;
+        height = nextHeight;
+    }
+}
+
+// INTERNAL: returns the least alpha of each column of an image, so that the columns that hide what is behind them can
+// be told without its texels
+static unsigned char* columnAlphaOf(Image img) {
+    Color* rows = LoadImageColors(img);
+    unsigned char* alpha = malloc(img.width);
+    if (rows == NULL || alpha == NULL) {
+        perror("Out of memory");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(alpha, 255, img.width);
+    for (int y = 0; y < img.height; y++) {
+        for (int x = 0; x < img.width; x++) {
+            alpha[x] = rows[y * img.width + x].a < alpha[x] ? rows[y * img.width + x].a : alpha[x];
+        }
+    }
+
+    UnloadImageColors(rows);
+    return alpha;
+}
+
+// INTERNAL: puts a decoded image in an entry (the entry takes the image), replacing its current texture
+static void setImage(TextureHandle handle, Image img) {
+    if (handle->loaded) {
+        UnloadTexture(handle->texture);
+    }
+    if (handle->image.data != NULL) {
+        UnloadImage(handle->image);
+    }
+    free(handle->columns);
+    handle->columns = NULL;
+    free(handle->columnAlpha);
+    handle->columnAlpha = columnAlphaOf(img);
+
+    handle->texture = LoadTextureFromImage(img);
+    version++;
+    if (handle->texture.id == 0) {
+        // Texture loading failed
+        fprintf(stderr, "Failed to load texture \"%s\"!\n", handle->key);
+        exit(EXIT_FAILURE);
+    }
+    handle->loaded = true;
+
+    // Distant walls and billboards are drawn as strips many times shorter than their textures: with mipmaps the GPU
+    // samples a level near their size (the nearest one, so that the texels stay sharp like with point filtering)
+    GenTextureMipmaps(&handle->texture);
+    SetTextureFilter(handle->texture, TEXTURE_FILTER_POINT);
+
+    handle->numLevels = 0;
+    if (keepImages) {
+        handle->image = img;
+        buildLevels(handle);
+    } else {
+        UnloadImage(img);
+        handle->image = (Image) {0};
+    }
+}
+
+// INTERNAL: unloads the texture (and image) of an entry
+static void unloadEntry(TextureHandle handle) {
+    if (handle->loaded) {
+        UnloadTexture(handle->texture);
+    }
+    if (handle->image.data != NULL) {
+        UnloadImage(handle->image);
+    }
+    free(handle->columns);
+    free(handle->columnAlpha);
+}
+
+// INTERNAL: returns the entry with that key, after adding a reference to it (NULL if there is none)
+static TextureHandle find(const char* key) {
+    if (textures == NULL) {
+        textures = HashMapCreate(64, StringHash, StringEquals);
+    }
+
+    TextureHandle handle = HashMapGet(textures, (void*) key);
+    if (handle != NULL) {
+        handle->refs++;
+    }
+
+    return handle;
+}
+
+// INTERNAL: adds an entry without a texture (it uses the placeholder)
+static TextureHandle add(const char* key, long modTime) {
+    if (placeholder.id == 0) {
+        Image img = GenImageChecked(8, 8, 4, 4, GRAY, DARKGRAY);
+        placeholder = LoadTextureFromImage(img);
+        UnloadImage(img);
+    }
+
+    TextureHandle handle = malloc(sizeof(struct cachedtexture));
+    assert(handle != NULL);
+
+    handle->key = StringCopy(key);
+    handle->texture = placeholder;
+    handle->image = (Image) {0};
+    handle->columns = NULL;
+    handle->numLevels = 0;
+    handle->columnAlpha = NULL;
+    handle->modTime = modTime;
+    handle->refs = 1;
+    handle->loaded = false;
+    handle->generation = 0;
+    handle->pending = 0;
+
+    HashMapPut(textures, handle->key, handle);
+
+    return handle;
+}
+
+// INTERNAL: run by the decoders
+static void decode(void* arg) {
+    decodeJob* job = arg;
+
+    // LoadFileData + LoadImageFromMemory instead of LoadImage, which can use raylib's (shared) text buffers
+    if (job->path != NULL) {
+        job->data = LoadFileData(job->path, &job->size);
+    }
+    if (job->data != NULL) {
+        job->image = LoadImageFromMemory(job->fileType, job->data, job->size);
+    }
+
+    atomic_store(&job->done, true);
+}
+
+// INTERNAL: uploads a decoded image and frees its job
+static void finishJob(decodeJob* job) {
+    TextureHandle handle = job->handle;
+
+    // An older decode of a file that changed again is dropped. A file that can not be decoded on a reload (caught
+    // half-written by an editor, or deleted) keeps its previous texture; only a failed first load is fatal.
+    if (job->generation != handle->generation) {
+        if (job->image.data != NULL) {
+            UnloadImage(job->image);
+        }
+    } else if (job->image.data != NULL) {
+        setImage(handle, job->image);
+    } else if (handle->loaded) {
+        fprintf(stderr, "Failed to reload texture \"%s\", keeping the previous one.\n", handle->key);
+    } else {
+        fprintf(stderr, "Failed to load texture \"%s\"!\n", handle->key);
+        exit(EXIT_FAILURE);
+    }
+    handle->pending--;
+
+    free(job->path);
+    if (job->path != NULL) {
+        UnloadFileData(job->data);
+    } else {
+        free(job->data);
+    }
+    free(job);
+}
+
+// INTERNAL: decodes the file at path or the data (which is copied) into an entry; on a worker if loading asynchronously
+static void requestDecode(TextureHandle handle, const char* path, const char* fileType, const unsigned char* data, int size) {
+    decodeJob* job = malloc(sizeof(decodeJob));
+    assert(job != NULL);
+
+    handle->generation++;
+    handle->pending++;
+
+    job->handle = handle;
+    job->generation = handle->generation;
+    job->path = path != NULL ? StringCopy(path) : NULL;
+    job->data = NULL;
+    job->size = size;
+    if (data != NULL) {
+        job->data = malloc(size);
+        assert(job->data != NULL);
+        memcpy(job->data, data, size);
+    }
+    snprintf(job->fileType, sizeof(job->fileType), "%s", fileType != NULL ? fileType : "");
+    job->image = (Image) {0};
+    atomic_init(&job->done, false);
+
+    if (!async) {
+        decode(job);
+        finishJob(job);
+        return;
+    }
+
+    if (decoders == NULL) {
+        decoders = WorkerPoolCreate(0);
+        jobs = ListCreate(NULL);
+    }
+    ListAppendLast(jobs, job);
+    WorkerPoolSubmit(decoders, decode, job);
+}
+
+TextureHandle TextureCacheLoad(const char* path) {
+    assert(path != NULL);
+
+    // The resolved path is also what the decoders read, since the working directory can change before they do
+    const char* key = resolvePath(path);
+    long modTime = GetFileModTime(path);
+
+    TextureHandle handle = find(key);
+    if (handle != NULL && handle->modTime == modTime) {
+        return handle;
+    }
+
+    if (handle == NULL) {
+        handle = add(key, modTime);
+    }
+
+    // If the file changed, every handle to it gets the new texture once it is decoded
+    handle->modTime = modTime;
+    requestDecode(handle, handle->key, GetFileExtension(path), NULL, 0);
+
+    return handle;
+}
+
+TextureHandle TextureCacheLoadFromMemory(const char* fileType, const unsigned char* data, int size) {
+    assert(fileType != NULL);
+    assert(data != NULL);
+
+    unsigned long long hash = 14695981039346656037ULL;  // FNV-1a
+    for (int i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+    const char* key = TextFormat("memory:%016llx:%d", hash, size);
+
+    TextureHandle handle = find(key);
+    if (handle != NULL) {
+        return handle;
+    }
+
+    handle = add(key, 0);
+    requestDecode(handle, NULL, fileType, data, size);
+
+    return handle;
+}
+
+TextureHandle TextureCacheLoadColor(Color color) {
+    const char* key = TextFormat("color:%02x%02x%02x%02x", color.r, color.g, color.b, color.a);
+
+    TextureHandle handle = find(key);
+    if (handle != NULL) {
+        return handle;
+    }
+
+    // Nothing to decode
+    handle = add(key, 0);
+    setImage(handle, GenImageColor(1, 1, color));
+
+    return handle;
+}
+
+TextureHandle TextureCacheAcquire(TextureHandle handle) {
+    assert(handle != NULL);
+
+    handle->refs++;
+
+    return handle;
+}
+
+void TextureCacheRelease(TextureHandle* handlep) {
+    assert(handlep != NULL);
+    assert(*handlep != NULL);
+    assert((*handlep)->refs > 0);
+
+    // Unused textures stay loaded until TextureCacheTrim
+    (*handlep)->refs--;
+
+    *handlep = NULL;
+}
+
+Texture TextureCacheGetTexture(TextureHandle handle) {
+    assert(handle != NULL);
+    return handle->texture;
+}
+
+const Image* TextureCacheGetImage(TextureHandle handle) {
+    assert(handle != NULL);
+    return handle->image.data != NULL ? &handle->image : NULL;
+}
+
+const Color* TextureCacheGetColumns(TextureHandle handle) {
+    assert(handle != NULL);
+    return handle->columns;
+}
+
+int TextureCacheGetNumLevels(TextureHandle handle) {
+    assert(handle != NULL);
+    return handle->numLevels;
+}
+
+const Color* TextureCacheGetLevelColumns(TextureHandle handle, int level, int* width, int* height) {
+    assert(handle != NULL);
+    assert(level >= 0 && level < handle->numLevels);
+
+    if (width != NULL) {
+        *width = handle->image.width >> level > 0 ? handle->image.width >> level : 1;
+    }
+    if (height != NULL) {
+        *height = handle->image.height >> level > 0 ? handle->image.height >> level : 1;
+    }
+    return handle->columns + handle->levelOffset[level];
+}
+
+unsigned char TextureCacheGetColumnAlpha(TextureHandle handle, float u0, float u1) {
+    assert(handle != NULL);
+
+    if (handle->columnAlpha == NULL) {
+        return 0;
+    }
+
+    // Columns repeat, like on the GPU
+    int width = handle->texture.width;
+    int first = (int) floorf(u0 * width);
+    int last = (int) ceilf(u1 * width);
+    last = last > first ? last : first + 1;
+    last = last - first < width ? last : first + width;
+
+    unsigned char alpha = 255;
+    for (int x = first; x < last; x++) {
+        int column = ((x % width) + width) % width;
+        alpha = handle->columnAlpha[column] < alpha ? handle->columnAlpha[column] : alpha;
+    }
+    return alpha;
+}
+
+int TextureCacheSelectLevel(TextureHandle handle, float texelsPerPixel) {
+    assert(handle != NULL);
+
+    int level = 0;
+    while (texelsPerPixel >= 2 && level + 1 < handle->numLevels) {
+        texelsPerPixel /= 2;
+        level++;
+    }
+    return level;
+}
+
+unsigned int TextureCacheGetVersion(void) {
+    return version;
+}
+
+void TextureCacheSetKeepImages(bool keep) {
+    keepImages = keep;
+}
+
+void TextureCacheSetAsync(bool enabled) {
+    async = enabled;
+}
+
+int TextureCacheUpdate(void) {
+    if (jobs == NULL) {
+        return 0;
+    }
+
+    // Every finished decode is uploaded in one go
+    int i = 0;
+    ListMoveToStart(jobs);
+    while (ListCanOperate(jobs)) {
+        decodeJob* job = ListGetCurrent(jobs);
+        if (atomic_load(&job->done)) {
+            ListRemove(jobs, i);
+            finishJob(job);
+            ListMoveToStart(jobs);
+            i = 0;
+            continue;
+        }
+        i++;
+        ListMoveToNext(jobs);
+    }
+
+    return ListGetSize(jobs);
+}
+
+void TextureCacheFinish(void) {
+    if (decoders != NULL) {
+        WorkerPoolWait(decoders);
+    }
+    TextureCacheUpdate();
+}
+
+// INTERNAL: unloads the entries that have no handles (or every entry)
+static void unload(bool all) {
+    if (all) {
+        TextureCacheFinish();
+    }
+    if (textures == NULL) {
+        return;
+    }
+
+    // Entries are collected first, since removing while iterating is not supported
+    List unused = ListCreate(NULL);
+
+    HashMapIterator iter = HashMapGetIterator(textures);
+    while (HashMapIterCanOperate(iter)) {
+        TextureHandle handle = HashMapIterGetCurrentValue(iter);
+        if (all || (handle->refs == 0 && handle->pending == 0)) {
+            ListAppendLast(unused, handle);
+        }
+
+        HashMapIterGoToNext(iter);
+    }
+    HashMapIterDestroy(&iter);
+
+    ListMoveToStart(unused);
+    while (ListCanOperate(unused)) {
+        TextureHandle handle = ListPopFirst(unused);
+        assert(handle->refs == 0);
+
+        HashMapRemove(textures, handle->key);
+        unloadEntry(handle);
+        free(handle->key);
+        free(handle);
+    }
+    ListDestroy(&unused);
+
+    if (all) {
+        HashMapDestroy(&textures);
+
+        if (decoders != NULL) {
+            WorkerPoolDestroy(&decoders);
+            ListDestroy(&jobs);
+        }
+        if (placeholder.id != 0) {
+            UnloadTexture(placeholder);
+            placeholder = (Texture) {0};
+        }
+    }
+}
+
+void TextureCacheTrim(void) {
+    unload(false);
+}
+
+void TextureCacheUnloadAll(void) {
+    unload(true);
+}
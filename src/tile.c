@@ -2,43 +2,35 @@
 #include "tile.h"
 #include <assert.h>
 #include <stdio.h>
+#include "texturecache.h"
 
 struct maptile {
     char* name;
     bool is_transparent;
     int mapTile;
-    Texture texture;
+    TextureHandle texture;
 };
 
 Tile TileCreateTextured(char* name, int maptile, const char* imgname, bool is_transparent) {
+    return TileCreateFromTexture(name, maptile, TextureCacheLoad(imgname), is_transparent);
+}
+
+Tile TileCreateFromTexture(char* name, int maptile, TextureHandle texture, bool is_transparent) {
+    assert(texture != NULL);
+
     Tile tile = malloc(sizeof(struct maptile));
     assert(tile != NULL);
 
     tile->name = name;
     tile->is_transparent = is_transparent;
     tile->mapTile = maptile;
-    tile->texture = LoadTexture(imgname);
-    if (tile->texture.id == 0) {
-        // Texture loading failed
-        perror("Failed to load texture!\n");
-        exit(EXIT_FAILURE);
-    }
+    tile->texture = texture;
 
     return tile;
 }
 
 Tile TileCreateColored(char* name, int maptile, Color color) {
-    Tile tile = malloc(sizeof(struct maptile));
-    assert(tile != NULL);
-
-    tile->name = name;
-    tile->is_transparent = false;
-    tile->mapTile = maptile;
-    Image img = GenImageColor(1, 1, color);
-    tile->texture = LoadTextureFromImage(img);
-    UnloadImage(img);
-
-    return tile;
+    return TileCreateFromTexture(name, maptile, TextureCacheLoadColor(color), false);
 }
 
 
@@ -48,7 +40,7 @@ void TileDestroy(Tile* tilep) {
 
     Tile tile = *tilep;
 
-    UnloadTexture(tile->texture);
+    TextureCacheRelease(&tile->texture);
     free(tile);
 
     *tilep = NULL;
@@ -64,7 +56,17 @@ int TileGetMapTiles(Tile tile) {
     return tile->mapTile;
 }
 
+void TileSetMapTiles(Tile tile, int maptile) {
+    assert(tile != NULL);
+    tile->mapTile = maptile;
+}
+
 Texture TileGetTexture(Tile tile) {
+    assert(tile != NULL);
+    return TextureCacheGetTexture(tile->texture);
+}
+
+TextureHandle TileGetTextureHandle(Tile tile) {
     assert(tile != NULL);
     return tile->texture;
 }
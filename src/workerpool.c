@@ -0,0 +1,176 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include "workerpool.h"
+#include "list.h"
+
+#if defined(_MSC_VER)
+#define WORKERPOOL_NO_THREADS
+#endif
+
+#ifndef WORKERPOOL_NO_THREADS
+#include <pthread.h>
+#include <unistd.h>
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+#endif
+
+typedef struct workerJob {
+    void (*func) (void* arg);
+    void* arg;
+} workerJob;
+
+struct workerpool {
+    int numThreads;
+#ifndef WORKERPOOL_NO_THREADS
+    pthread_t* threads;
+    pthread_mutex_t lock;
+    pthread_cond_t jobAvailable;    // Signaled when a job is queued (or the pool is being destroyed)
+    pthread_cond_t jobsDone;        // Signaled when the last running job finishes
+    List jobs;                      // Queued workerJob*
+    int running;                    // Jobs taken by a worker but not finished yet
+    bool stopping;
+#endif
+};
+
+// INTERNAL: number of processor cores
+static int numCores(void) {
+#if defined(WORKERPOOL_NO_THREADS)
+    return 1;
+#elif defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int) info.dwNumberOfProcessors;
+#else
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (int) cores : 1;
+#endif
+}
+
+#ifndef WORKERPOOL_NO_THREADS
+// INTERNAL: loop run by each worker thread
+static void* workerMain(void* arg) {
+    WorkerPool pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        while (ListGetSize(pool->jobs) == 0 && !pool->stopping) {
+            pthread_cond_wait(&pool->jobAvailable, &pool->lock);
+        }
+        if (ListGetSize(pool->jobs) == 0) {     // Stopping, and nothing left to do
+            break;
+        }
+
+        workerJob* job = ListPopFirst(pool->jobs);
+        pool->running++;
+        pthread_mutex_unlock(&pool->lock);
+
+        job->func(job->arg);
+        free(job);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->running--;
+        if (pool->running == 0 && ListGetSize(pool->jobs) == 0) {
+            pthread_cond_broadcast(&pool->jobsDone);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+#endif
+
+WorkerPool WorkerPoolCreate(int numThreads) {
+    assert(numThreads >= 0);
+
+    WorkerPool pool = malloc(sizeof(struct workerpool));
+    assert(pool != NULL);
+
+    pool->numThreads = numThreads > 0 ? numThreads : numCores();
+
+#ifndef WORKERPOOL_NO_THREADS
+    pool->jobs = ListCreate(NULL);
+    pool->running = 0;
+    pool->stopping = false;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->jobAvailable, NULL);
+    pthread_cond_init(&pool->jobsDone, NULL);
+
+    pool->threads = malloc(sizeof(pthread_t) * pool->numThreads);
+    assert(pool->threads != NULL);
+    for (int i = 0; i < pool->numThreads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, workerMain, pool) != 0) {
+            perror("Failed to create worker thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+#endif
+
+    return pool;
+}
+
+void WorkerPoolDestroy(WorkerPool* poolp) {
+    assert(poolp != NULL);
+    assert(*poolp != NULL);
+
+    WorkerPool pool = *poolp;
+
+#ifndef WORKERPOOL_NO_THREADS
+    // Workers finish the queued jobs before stopping
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->jobAvailable);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->numThreads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    free(pool->threads);
+
+    ListDestroy(&pool->jobs);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->jobAvailable);
+    pthread_cond_destroy(&pool->jobsDone);
+#endif
+
+    free(pool);
+
+    *poolp = NULL;
+}
+
+void WorkerPoolSubmit(WorkerPool pool, void (*func) (void* arg), void* arg) {
+    assert(pool != NULL);
+    assert(func != NULL);
+
+#ifdef WORKERPOOL_NO_THREADS
+    func(arg);
+#else
+    workerJob* job = malloc(sizeof(workerJob));
+    assert(job != NULL);
+    job->func = func;
+    job->arg = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    ListAppendLast(pool->jobs, job);
+    pthread_cond_signal(&pool->jobAvailable);
+    pthread_mutex_unlock(&pool->lock);
+#endif
+}
+
+void WorkerPoolWait(WorkerPool pool) {
+    assert(pool != NULL);
+
+#ifndef WORKERPOOL_NO_THREADS
+    pthread_mutex_lock(&pool->lock);
+    while (pool->running > 0 || ListGetSize(pool->jobs) > 0) {
+        pthread_cond_wait(&pool->jobsDone, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+#endif
+}
+
+int WorkerPoolGetNumThreads(WorkerPool pool) {
+    assert(pool != NULL);
+    return pool->numThreads;
+}
@@ -0,0 +1,219 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "raylib.h"
+#include "mapdata.h"
+#include "tile.h"
+
+#define USAGE_MESSAGE "Usage: mapc [-h] [-p] [-o output] mapfile\n"
+#define DESCRIPTION_MESSAGE "Compiles a map file into a compiled map, which the raycaster loads without parsing it.\n" \
+    "Tiles are deduplicated and their IDs remapped densely, the empty space distances are precomputed, billboards are sorted by cell, and the textures are validated.\n" \
+    "  -p          pack the textures into the compiled map\n" \
+    "  -o output   name of the compiled map (default: mapfile with the .cmap extension)\n"
+
+// Returns filename with its extension replaced by ext (must be freed)
+static char* replaceExtension(const char* filename, const char* ext) {
+    const char* dot = strrchr(filename, '.');
+    const char* slash = strrchr(filename, '/');
+    size_t baseLength = (dot != NULL && (slash == NULL || dot > slash)) ? (size_t) (dot - filename) : strlen(filename);
+
+    char* ret = calloc(baseLength + strlen(ext) + 1, sizeof(char));
+    if (ret == NULL) {
+        perror("Out of memory");
+        exit(EXIT_FAILURE);
+    }
+    strncpy(ret, filename, baseLength);
+    strcat(ret, ext);
+
+    return ret;
+}
+
+static bool isPowerOfTwo(int n) {
+    return n > 0 && (n & (n - 1)) == 0;
+}
+
+// Loads every texture to check it. Returns the number of textures that failed.
+static int validateTextures(MapData data, const char* mapDir) {
+    int failed = 0;
+
+    for (int i = 0; i < data->numTextures; i++) {
+        const char* path = mapDir[0] != '\0' ? TextFormat("%s/%s", mapDir, data->textures[i].path) : data->textures[i].path;
+        Image img = LoadImage(path);
+
+        if (img.data == NULL) {
+            fprintf(stderr, "Error: texture \"%s\" could not be loaded.\n", path);
+            failed++;
+            continue;
+        }
+        if (!isPowerOfTwo(img.width) || !isPowerOfTwo(img.height)) {
+            fprintf(stderr, "Warning: texture \"%s\" is %dx%d, which is not a power of two.\n", path, img.width, img.height);
+        }
+
+        UnloadImage(img);
+    }
+
+    return failed;
+}
+
+static double kib(double bytes) {
+    return bytes / 1024.0;
+}
+
+int main(int argc, char* argv[]) {
+    // Argument handling
+    const char* input = NULL;
+    const char* output = NULL;
+    bool pack = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-h") == 0) {
+            printf(USAGE_MESSAGE);
+            printf(DESCRIPTION_MESSAGE);
+            return EXIT_SUCCESS;
+        } else if (strcmp(argv[i], "-p") == 0) {
+            pack = true;
+        } else if (strcmp(argv[i], "-o") == 0) {
+            if (i+1 >= argc) {
+                fprintf(stderr, USAGE_MESSAGE);
+                fprintf(stderr, "Must specify the compiled map's name after -o!\n");
+                return EXIT_FAILURE;
+            }
+            output = argv[++i];
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, USAGE_MESSAGE);
+            fprintf(stderr, "Unknown option \"%s\"!\n", argv[i]);
+            return EXIT_FAILURE;
+        } else if (input != NULL) {
+            fprintf(stderr, USAGE_MESSAGE);
+            fprintf(stderr, "Only one map file can be compiled at a time!\n");
+            return EXIT_FAILURE;
+        } else {
+            input = argv[i];
+        }
+    }
+
+    if (input == NULL) {
+        fprintf(stderr, USAGE_MESSAGE);
+        fprintf(stderr, "Must specify a map file to compile!\n");
+        return EXIT_FAILURE;
+    }
+
+    char* outputName = output != NULL ? NULL : replaceExtension(input, ".cmap");
+    if (output == NULL) {
+        output = outputName;
+    }
+
+    // Only our own messages are wanted
+    SetTraceLogLevel(LOG_WARNING);
+
+    // The directory textures are relative to
+    char mapDir[4096];
+    strncpy(mapDir, GetDirectoryPath(input), sizeof(mapDir)-1);
+    mapDir[sizeof(mapDir)-1] = '\0';
+
+    char outputDir[4096];
+    strncpy(outputDir, GetDirectoryPath(output), sizeof(outputDir)-1);
+    outputDir[sizeof(outputDir)-1] = '\0';
+
+    if (!pack && strcmp(mapDir, outputDir) != 0) {
+        fprintf(stderr, "Warning: \"%s\" is not in the same directory as \"%s\", so its textures will not be found (use -p to pack them).\n", output, input);
+    }
+
+    // Parsing and validation
+    MapData data = MapDataCreateFromFile(input);
+    int definedTiles = data->numTileDefs - 1;
+    int definedTextures = data->numTextures;
+
+    int removedTiles = MapDataOptimize(data);
+    MapDataSortBillboards(data);
+    MapDataComputeDistances(data);
+
+    if (validateTextures(data, mapDir) > 0) {
+        MapDataDestroy(&data);
+        free(outputName);
+        return EXIT_FAILURE;
+    }
+
+    size_t packedBytes = 0;
+    if (pack) {
+        if (!MapDataPackTextures(data, mapDir)) {
+            MapDataDestroy(&data);
+            free(outputName);
+            return EXIT_FAILURE;
+        }
+        for (int i = 0; i < data->numTextures; i++) {
+            packedBytes += data->textures[i].packedSize;
+        }
+    }
+
+    if (!MapDataSaveCompiled(data, output)) {
+        fprintf(stderr, "Error: could not write \"%s\".\n", output);
+        MapDataDestroy(&data);
+        free(outputName);
+        return EXIT_FAILURE;
+    }
+
+    // Statistics
+    const int cs = MAPDATA_CHUNK_SIZE;
+    size_t numCells = (size_t) data->numRows * data->numCols;
+    int chunkRows = (data->numRows + cs - 1) / cs;
+    int chunkCols = (data->numCols + cs - 1) / cs;
+    bool* chunkUsed = calloc((size_t) chunkRows * chunkCols, sizeof(bool));
+    if (chunkUsed == NULL) {
+        perror("Out of memory");
+        return EXIT_FAILURE;
+    }
+
+    size_t solidCells = 0;
+    int storedChunks = 0;
+    double totalDistance = 0;
+    for (int r = 0; r < data->numRows; r++) {
+        for (int c = 0; c < data->numCols; c++) {
+            size_t idx = (size_t) r*data->numCols + c;
+            totalDistance += data->distance[idx];
+            if (data->grid[idx] == TILE_GROUND) {
+                continue;
+            }
+            solidCells++;
+            bool* used = &chunkUsed[(size_t) (r/cs)*chunkCols + c/cs];
+            if (!*used) {
+                *used = true;
+                storedChunks++;
+            }
+        }
+    }
+    free(chunkUsed);
+
+    int buckets = 0;
+    for (int i = 0; i < data->numBillboards; i++) {
+        mapBillboard bb = data->billboards[i];
+        if (i == 0
+            || bb.posX / data->tileSize != data->billboards[i-1].posX / data->tileSize
+            || bb.posY / data->tileSize != data->billboards[i-1].posY / data->tileSize) {
+            buckets++;
+        }
+    }
+
+    double denseBytes = (double) data->numRows * (sizeof(int*) + (double) data->numCols * sizeof(int));
+    double chunkBytes = (double) storedChunks * cs * cs * 2;
+    double distanceBytes = (double) storedChunks * cs * cs;
+
+    printf("mapc: compiled \"%s\" into \"%s\"\n", input, output);
+    printf("  grid:        %d x %d cells, tile size %d\n", data->numRows, data->numCols, data->tileSize);
+    printf("  occupancy:   %zu solid cells (%.1f%%), %d of %d chunks stored\n", solidCells, 100.0 * (double) solidCells / (double) numCells, storedChunks, chunkRows * chunkCols);
+    printf("  open space:  %.1f cells to the nearest wall on average\n", totalDistance / (double) numCells);
+    printf("  tiles:       %d defined, %d after deduplication and remapping\n", definedTiles, definedTiles - removedTiles);
+    printf("  textures:    %d referenced, %d kept", definedTextures, data->numTextures);
+    if (pack) {
+        printf(" (%.1f KiB packed)", kib((double) packedBytes));
+    }
+    printf("\n");
+    printf("  billboards:  %d in %d buckets, %d types\n", data->numBillboards, buckets, data->numBillboardDefs);
+    printf("  memory:      %.1f KiB as a dense grid, %.1f KiB as chunks + %.1f KiB of distance data\n", kib(denseBytes), kib(chunkBytes), kib(distanceBytes));
+    printf("  file size:   %.1f KiB\n", kib((double) GetFileLength(output)));
+
+    MapDataDestroy(&data);
+    free(outputName);
+
+    return EXIT_SUCCESS;
+}
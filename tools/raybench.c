@@ -0,0 +1,504 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <stdbool.h>
+#include "raylib.h"
+#include "map.h"
+#include "mapray.h"
+#include "texturecache.h"
+#include "workerpool.h"
+#include "framebuffer.h"
+#include "renderqueue.h"
+#include "player.h"
+
+#define USAGE_MESSAGE "Usage: raybench [-h] [-r rays] [mapfile...]\n"
+#define DESCRIPTION_MESSAGE "Times casting the same rays through each map with every traversal mode, and checks that they hit the same tiles\n" \
+    "as DDA, and at most a texel away from where DDA does. Then times as many line of sight queries (between the rays'\n" \
+    "starts), on this thread and on a worker per core, and the floor and ceiling of 1920x1080 frames seen from them.\n" \
+    "Last, times casting, recording and drawing (with the software backend, also in bands on a worker per core) the\n" \
+    "walls of those frames. Exits with failure if a mode hit a tile more than a texel away from DDA (or, except for\n" \
+    "the fixed-point one, another tile), or if line of sight queries from outside of the map do not block where DDA\n" \
+    "does. Fixed-point rays that pass a cell's corner closer than its rounding can hit anywhere.\n" \
+    "  -r rays   number of rays cast per map and mode (default: 200000)\n" \
+    "With no map files, the maps in resources/bench are used.\n"
+
+#define DEFAULT_RAYS 200000
+
+// Floor and ceiling (and walls) frames drawn per map (at most one per ray), and their size
+#define FLAT_FRAMES 50
+#define FLAT_WIDTH 1920
+#define FLAT_HEIGHT 1080
+
+// Pixels by which the fixed-point traversal can stray from the exact ray, per pixel of its length (its 16.16 steps
+// are rounded by up to half of 1 / 65536 per cell crossed in each axis)
+#define FIXED_TOLERANCE (1.0 / 32768)
+
+// A ray to cast, at a random GROUND position
+typedef struct benchRay {
+    int posX;
+    int posY;
+    double angle;
+} benchRay;
+
+// Where a ray first hit a tile (hitX is -1 if it hit none)
+typedef struct benchHit {
+    int hitX;                   // Cell
+    int hitY;                   //
+    double pointX;              // Point (pixels)
+    double pointY;              //
+    double texelSize;           // Size of a texel of the tile's texture (pixels)
+} benchHit;
+
+// Creates numRays random rays that start in GROUND cells of map
+static benchRay* createRays(Map map, int numRays) {
+    benchRay* rays = malloc(numRays * sizeof(benchRay));
+    if (rays == NULL) {
+        perror("Out of memory");
+        exit(EXIT_FAILURE);
+    }
+
+    int tileSize = MapGetTileSize(map);
+    int width = MapGetNumRows(map) * tileSize;
+    int height = MapGetNumCols(map) * tileSize;
+    srand(1);
+    for (int i = 0; i < numRays; i++) {
+        int attempts = 0;
+        do {
+            rays[i].posX = rand() % width;
+            rays[i].posY = rand() % height;
+            attempts++;
+        } while (MapGetTile(map, rays[i].posX / tileSize, rays[i].posY / tileSize) != TILE_GROUND && attempts < 1000);
+        // Quantized like the fixed-point traversal does, so that every mode casts the same rays
+        rays[i].angle = (double) (rand() % 65536) / 65536 * 2 * PI;
+    }
+
+    return rays;
+}
+
+// Casts every ray, storing their first tile hits. Returns the time taken (seconds).
+static double castRays(Map map, benchRay* rays, benchHit* hits, int numRays) {
+    MapRay ray = MapRayCreate(0, 0, 0, 0, map);
+
+    double start = GetTime();
+    for (int i = 0; i < numRays; i++) {
+        MapRaySetPosition(ray, rays[i].posX, rays[i].posY);
+        MapRaySetAngle(ray, rays[i].angle);
+        MapRayCast(ray);
+
+        // The nearest collision is the last one
+        hits[i] = (benchHit) {-1, -1, 0, 0, 0};
+        List collisions = MapRayGetCollisions(ray);
+        for (int j = MapRayGetCollisionNumber(ray) - 1; j >= 0; j--) {
+            rayCollision* col = ListGet(collisions, j);
+            if (col->collisionType == COLLISION_MAP_TILE) {
+                hits[i] = (benchHit) {col->collisionGridX, col->collisionGridY, col->collisionX, col->collisionY,
+                    (double) MapGetTileSize(map) / TileGetTexture(col->tile).width};
+                break;
+            }
+        }
+    }
+    double elapsed = GetTime() - start;
+
+    MapRayDestroy(&ray);
+
+    return elapsed;
+}
+
+// Times line of sight queries between the starts of the rays, on this thread and with pool
+static void benchSight(Map map, benchRay* rays, int numRays, WorkerPool pool) {
+    mapSightQuery* queries = malloc(numRays * sizeof(mapSightQuery));
+    mapSightResult* reference = malloc(numRays * sizeof(mapSightResult));
+    mapSightResult* results = malloc(numRays * sizeof(mapSightResult));
+    if (queries == NULL || reference == NULL || results == NULL) {
+        perror("Out of memory");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < numRays; i++) {
+        benchRay to = rays[(i + 1) % numRays];
+        queries[i] = (mapSightQuery) {rays[i].posX, rays[i].posY, to.posX, to.posY};
+    }
+
+    double start = GetTime();
+    MapRayCheckSight(map, queries, reference, numRays, NULL);
+    double serialTime = GetTime() - start;
+    start = GetTime();
+    MapRayCheckSight(map, queries, results, numRays, pool);
+    double parallelTime = GetTime() - start;
+
+    int visible = 0;
+    int mismatches = 0;
+    for (int i = 0; i < numRays; i++) {
+        visible += reference[i].visible;
+        if (results[i].visible != reference[i].visible || results[i].hitX != reference[i].hitX || results[i].hitY != reference[i].hitY) {
+            mismatches++;
+        }
+    }
+
+    printf("  %-16s %8.2f ms  %7.3f us/query  %d visible\n", "line of sight", serialTime * 1000, serialTime * 1e6 / numRays, visible);
+    printf("  %-16s %8.2f ms  %7.3f us/query  %5.2fx  %d mismatches (%d threads)\n", "  in parallel", parallelTime * 1000,
+        parallelTime * 1e6 / numRays, serialTime / parallelTime, mismatches, WorkerPoolGetNumThreads(pool));
+
+    free(results);
+    free(reference);
+    free(queries);
+}
+
+// Whether the cell at (mapX, mapY) blocks sight (cells outside of the map do not)
+static bool isOpaque(Map map, int mapX, int mapY) {
+    if (mapX < 0 || mapX >= MapGetNumRows(map) || mapY < 0 || mapY >= MapGetNumCols(map)) {
+        return false;
+    }
+    int tile = MapGetTile(map, mapX, mapY);
+
+    return tile != TILE_GROUND && !TileIsTransparent(MapGetTileObject(map, tile));
+}
+
+// Answers a line of sight query with a plain DDA walk, one cell at a time from the start (in the map or not). Sets tied
+// to whether, before the result, the segment goes through the exact corner of a cell or ends on its edge, where the
+// cells it meets depend on rounding.
+static mapSightResult checkSightDDA(Map map, mapSightQuery query, bool* tied) {
+    int tileSize = MapGetTileSize(map);
+    double dx = query.toX - query.fromX;
+    double dy = query.toY - query.fromY;
+    double length = sqrt(dx*dx + dy*dy);
+    int mapX = (int) floor((double) query.fromX / tileSize);
+    int mapY = (int) floor((double) query.fromY / tileSize);
+    int sideX = dx < 0 ? -1 : 1;
+    int sideY = dy < 0 ? -1 : 1;
+    double deltaDistX = dx != 0 ? fabs(length / dx) * tileSize : INFINITY;
+    double deltaDistY = dy != 0 ? fabs(length / dy) * tileSize : INFINITY;
+    double sideDistX = dx != 0 ? (sideX > 0 ? (mapX + 1) * tileSize - query.fromX : query.fromX - mapX * tileSize) * deltaDistX / tileSize : INFINITY;
+    double sideDistY = dy != 0 ? (sideY > 0 ? (mapY + 1) * tileSize - query.fromY : query.fromY - mapY * tileSize) * deltaDistY / tileSize : INFINITY;
+
+    double distance = 0;
+    *tied = false;
+    while (true) {
+        if (isOpaque(map, mapX, mapY)) {
+            return (mapSightResult) {false, mapX, mapY, distance};
+        }
+        double next = sideDistX < sideDistY ? sideDistX : sideDistY;
+        *tied = *tied || (fabs(sideDistX - sideDistY) < 1e-6 && next < length) || fabs(next - length) < 1e-6;
+        if (sideDistX < sideDistY) {
+            distance = sideDistX;
+            sideDistX += deltaDistX;
+            mapX += sideX;
+        } else {
+            distance = sideDistY;
+            sideDistY += deltaDistY;
+            mapY += sideY;
+        }
+        if (!(distance < length)) {
+            return (mapSightResult) {true, -1, -1, length};
+        }
+    }
+}
+
+// Checks line of sight queries that start outside of the map (at negative coordinates too) against a plain DDA walk:
+// half of them end at the starts of the rays, the others anywhere around the map. Those through the exact corner of a
+// cell (or ending on its edge) can be blocked by either side of it, so they are not compared. Returns whether the
+// others all agree.
+static bool checkSightOutside(Map map, benchRay* rays, int numRays) {
+    int tileSize = MapGetTileSize(map);
+    int width = MapGetNumRows(map) * tileSize;
+    int height = MapGetNumCols(map) * tileSize;
+    mapSightQuery* queries = malloc(numRays * sizeof(mapSightQuery));
+    mapSightResult* results = malloc(numRays * sizeof(mapSightResult));
+    if (queries == NULL || results == NULL) {
+        perror("Out of memory");
+        exit(EXIT_FAILURE);
+    }
+    srand(2);
+    for (int i = 0; i < numRays; i++) {
+        // Anywhere in a box twice the size of the map around it, outside of the map
+        int fromX;
+        int fromY;
+        do {
+            fromX = rand() % (2 * width) - width / 2;
+            fromY = rand() % (2 * height) - height / 2;
+        } while (fromX >= 0 && fromX < width && fromY >= 0 && fromY < height);
+        int toX = i % 2 == 0 ? rays[i].posX : rand() % (2 * width) - width / 2;
+        int toY = i % 2 == 0 ? rays[i].posY : rand() % (2 * height) - height / 2;
+        queries[i] = (mapSightQuery) {fromX, fromY, toX, toY};
+    }
+
+    MapRayCheckSight(map, queries, results, numRays, NULL);
+
+    int visible = 0;
+    int ties = 0;
+    int mismatches = 0;
+    for (int i = 0; i < numRays; i++) {
+        bool tied;
+        mapSightResult reference = checkSightDDA(map, queries[i], &tied);
+        visible += reference.visible;
+        if (tied) {
+            ties++;
+        } else if (results[i].visible != reference.visible || results[i].hitX != reference.hitX || results[i].hitY != reference.hitY) {
+            mismatches++;
+        }
+    }
+    bool passed = mismatches == 0;
+
+    printf("  %-16s %d visible, %d mismatches with DDA (%d ties not compared)%s\n", "  from outside", visible, mismatches, ties,
+        passed ? "" : "  FAILED");
+
+    free(results);
+    free(queries);
+
+    return passed;
+}
+
+// Times drawing the floor and ceiling seen from the starts of the rays, on this thread and with pool
+static void benchFlats(Map map, benchRay* rays, int numRays, WorkerPool pool) {
+    int numFrames = numRays < FLAT_FRAMES ? numRays : FLAT_FRAMES;
+    FrameBuffer fb = FrameBufferCreate(FLAT_WIDTH, FLAT_HEIGHT);
+
+    double start = GetTime();
+    for (int i = 0; i < numFrames; i++) {
+        MapDrawFlats(map, fb, rays[i].posX, rays[i].posY, rays[i].angle, 60*DEG2RAD, NULL);
+    }
+    double serialTime = GetTime() - start;
+    start = GetTime();
+    for (int i = 0; i < numFrames; i++) {
+        MapDrawFlats(map, fb, rays[i].posX, rays[i].posY, rays[i].angle, 60*DEG2RAD, pool);
+    }
+    double parallelTime = GetTime() - start;
+
+    printf("  %-16s %8.2f ms  %7.3f ms/frame  %dx%d, %d frames\n", "floor/ceiling", serialTime * 1000, serialTime * 1000 / numFrames,
+        FLAT_WIDTH, FLAT_HEIGHT, numFrames);
+    printf("  %-16s %8.2f ms  %7.3f ms/frame  %5.2fx  (%d threads)\n", "  in parallel", parallelTime * 1000, parallelTime * 1000 / numFrames,
+        serialTime / parallelTime, WorkerPoolGetNumThreads(pool));
+
+    FrameBufferDestroy(&fb);
+}
+
+// Times the 3D view seen from the starts of the rays: casting it, recording its commands and drawing them in software,
+// on this thread and with pool (with the spread of the bands' timings)
+static void benchRender(Map map, benchRay* rays, int numRays, WorkerPool pool) {
+    int numFrames = numRays < FLAT_FRAMES ? numRays : FLAT_FRAMES;
+    FrameBuffer fb = FrameBufferCreate(FLAT_WIDTH, FLAT_HEIGHT);
+    RenderQueue queue = RenderQueueCreate();
+
+    double castTime = 0;
+    double recordTime = 0;
+    double drawTime = 0;
+    double parallelTime = 0;
+    double bandTime = 0;            // Sum of the bands' times
+    double slowestBand = 0;         // Sum over the frames of their slowest band's time
+    int numBands = 0;
+    int numCommands = 0;
+    long long spanFill = 0;
+    for (int i = 0; i < numFrames; i++) {
+        Player player = PlayerCreate(rays[i].posX, rays[i].posY, (int) (rays[i].angle*RAD2DEG), FLAT_WIDTH, map);
+
+        double start = GetTime();
+        PlayerInput(player);
+        double recordStart = GetTime();
+        RenderQueueClear(queue);
+        MapDraw3D(map, queue, FLAT_WIDTH, FLAT_HEIGHT);
+        PlayerDraw3D(player, queue, FLAT_WIDTH, FLAT_HEIGHT);
+        double drawStart = GetTime();
+        RenderQueueDraw(queue, RENDER_BACKEND_SOFTWARE, fb, NULL);
+        double parallelStart = GetTime();
+        RenderQueueDraw(queue, RENDER_BACKEND_SOFTWARE, fb, pool);
+        double end = GetTime();
+        spanFill += RenderQueueGetSpanFill(queue);
+
+        castTime += recordStart - start;
+        recordTime += drawStart - recordStart;
+        drawTime += parallelStart - drawStart;
+        parallelTime += end - parallelStart;
+        numCommands += RenderQueueGetNumCommands(queue);
+
+        numBands = RenderQueueGetNumBands(queue);
+        double slowest = 0;
+        for (int band = 0; band < numBands; band++) {
+            double time = RenderQueueGetBandTime(queue, band);
+            bandTime += time;
+            slowest = time > slowest ? time : slowest;
+        }
+        slowestBand += slowest;
+
+        PlayerDestroy(&player);
+    }
+
+    printf("  %-16s %8.2f ms  %7.3f ms/frame\n", "walls: cast", castTime * 1000, castTime * 1000 / numFrames);
+    printf("  %-16s %8.2f ms  %7.3f ms/frame  %d commands/frame\n", "  record", recordTime * 1000, recordTime * 1000 / numFrames,
+        numCommands / numFrames);
+    printf("  %-16s %8.2f ms  %7.3f ms/frame  %lld span pixels/frame\n", "  draw (software)", drawTime * 1000, drawTime * 1000 / numFrames,
+        spanFill / numFrames);
+    printf("  %-16s %8.2f ms  %7.3f ms/frame  %5.2fx  (%d threads, %d bands: %.3f ms mean, %.3f ms slowest)\n", "    in parallel",
+        parallelTime * 1000, parallelTime * 1000 / numFrames, drawTime / parallelTime, WorkerPoolGetNumThreads(pool), numBands,
+        bandTime * 1000 / numFrames / numBands, slowestBand * 1000 / numFrames);
+
+    RenderQueueDestroy(&queue);
+    FrameBufferDestroy(&fb);
+}
+
+// Whether ray passes closer than tolerance (pixels) to the corner of a cell in its first length pixels, where which
+// side of it the ray goes depends on rounding
+static bool passesNearCorner(benchRay ray, double length, int tileSize, double tolerance) {
+    double dirX = cos(ray.angle);
+    double dirY = sin(ray.angle);
+    int mapX = (int) floor((double) ray.posX / tileSize);
+    int mapY = (int) floor((double) ray.posY / tileSize);
+    int sideX = dirX < 0 ? -1 : 1;
+    int sideY = dirY < 0 ? -1 : 1;
+    double deltaDistX = dirX != 0 ? fabs(tileSize / dirX) : INFINITY;
+    double deltaDistY = dirY != 0 ? fabs(tileSize / dirY) : INFINITY;
+    double sideDistX = dirX != 0 ? (sideX > 0 ? (mapX + 1) * tileSize - ray.posX : ray.posX - mapX * tileSize) / fabs(dirX) : INFINITY;
+    double sideDistY = dirY != 0 ? (sideY > 0 ? (mapY + 1) * tileSize - ray.posY : ray.posY - mapY * tileSize) / fabs(dirY) : INFINITY;
+
+    // The corners of every cell the ray crosses, from the one it starts in
+    double distance = 0;
+    while (distance <= length) {
+        for (int corner = 0; corner < 4; corner++) {
+            double toX = (mapX + (corner & 1)) * tileSize - ray.posX;
+            double toY = (mapY + (corner >> 1)) * tileSize - ray.posY;
+            double along = toX * dirX + toY * dirY;
+            if (along >= 0 && along <= length && fabs(toX * dirY - toY * dirX) < tolerance) {
+                return true;
+            }
+        }
+        if (sideDistX < sideDistY) {
+            distance = sideDistX;
+            sideDistX += deltaDistX;
+            mapX += sideX;
+        } else {
+            distance = sideDistY;
+            sideDistY += deltaDistY;
+            mapY += sideY;
+        }
+    }
+
+    return false;
+}
+
+// Returns whether every traversal mode, and line of sight from outside of the map, hit what DDA hit
+static bool benchMap(const char* filename, int numRays, WorkerPool pool) {
+    Map map = MapCreateFromFile(filename);
+    benchRay* rays = createRays(map, numRays);
+    benchHit* reference = malloc(numRays * sizeof(benchHit));
+    benchHit* hits = malloc(numRays * sizeof(benchHit));
+    if (reference == NULL || hits == NULL) {
+        perror("Out of memory");
+        exit(EXIT_FAILURE);
+    }
+
+    printf("%s (%d x %d cells, %d rays)\n", filename, MapGetNumRows(map), MapGetNumCols(map), numRays);
+
+    double referenceTime = 0;
+    bool passed = true;
+    for (MapRayTraversal mode = TRAVERSAL_DDA; mode <= TRAVERSAL_FIXED; mode++) {
+        MapRaySetTraversal(mode);
+        castRays(map, rays, hits, numRays / 10 > 0 ? numRays / 10 : 1);     // Warm up (distance fields are computed on first use)
+        double elapsed = castRays(map, rays, mode == TRAVERSAL_DDA ? reference : hits, numRays);
+
+        int mismatches = 0;     // Hit another cell
+        int offTexel = 0;       // Hit more than a texel away
+        int nearCorner = 0;     // The same, but only by passing a corner on the other side (fixed-point only)
+        if (mode == TRAVERSAL_DDA) {
+            referenceTime = elapsed;
+        } else {
+            for (int i = 0; i < numRays; i++) {
+                if (hits[i].hitX != reference[i].hitX || hits[i].hitY != reference[i].hitY) {
+                    mismatches++;
+                }
+                if (hits[i].hitX != -1 && reference[i].hitX != -1
+                    && hypot(hits[i].pointX - reference[i].pointX, hits[i].pointY - reference[i].pointY) > reference[i].texelSize) {
+                    // Up to the farther of the hits, where the rays can have parted
+                    double length = fmax(hypot(reference[i].pointX - rays[i].posX, reference[i].pointY - rays[i].posY),
+                        hypot(hits[i].pointX - rays[i].posX, hits[i].pointY - rays[i].posY));
+                    if (mode == TRAVERSAL_FIXED && passesNearCorner(rays[i], length, MapGetTileSize(map), length * FIXED_TOLERANCE)) {
+                        nearCorner++;
+                    } else {
+                        offTexel++;
+                    }
+                }
+            }
+        }
+
+        // Only the fixed-point mode can hit another (neighbouring) tile, and none can be further than a texel away
+        bool failed = offTexel > 0 || (mode != TRAVERSAL_FIXED && mismatches > 0);
+        passed = passed && !failed;
+
+        printf("  %-16s %8.2f ms  %7.3f us/ray  %5.2fx  %d mismatches, %d more than a texel away", MapRayGetTraversalName(mode),
+            elapsed * 1000, elapsed * 1e6 / numRays, referenceTime / elapsed, mismatches, offTexel);
+        if (mode == TRAVERSAL_FIXED) {
+            printf(" (and %d past a corner)", nearCorner);
+        }
+        printf("%s\n", failed ? "  FAILED" : "");
+    }
+    MapRaySetTraversal(TRAVERSAL_MIPGRID);
+
+    benchSight(map, rays, numRays, pool);
+    passed = checkSightOutside(map, rays, numRays) && passed;
+    benchFlats(map, rays, numRays, pool);
+    benchRender(map, rays, numRays, pool);
+
+    free(hits);
+    free(reference);
+    free(rays);
+    MapDestroy(&map);
+
+    return passed;
+}
+
+int main(int argc, char* argv[]) {
+    // Argument handling
+    int numRays = DEFAULT_RAYS;
+    int numMaps = 0;
+    const char** maps = calloc(argc, sizeof(char*));
+    if (maps == NULL) {
+        perror("Out of memory");
+        return EXIT_FAILURE;
+    }
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-h") == 0) {
+            printf(USAGE_MESSAGE);
+            printf(DESCRIPTION_MESSAGE);
+            free(maps);
+            return EXIT_SUCCESS;
+        } else if (strcmp(argv[i], "-r") == 0 && i+1 < argc) {
+            numRays = atoi(argv[++i]);
+        } else {
+            maps[numMaps++] = argv[i];
+        }
+    }
+    if (numRays <= 0) {
+        fprintf(stderr, USAGE_MESSAGE);
+        fprintf(stderr, "The number of rays must be positive!\n");
+        free(maps);
+        return EXIT_FAILURE;
+    }
+
+    // Maps need a GPU context for their textures
+    SetTraceLogLevel(LOG_WARNING);
+    SetConfigFlags(FLAG_WINDOW_HIDDEN);
+    InitWindow(1, 1, "raybench");
+    TextureCacheSetAsync(false);
+    TextureCacheSetKeepImages(true);
+    WorkerPool pool = WorkerPoolCreate(0);
+
+    bool passed = true;
+    if (numMaps == 0) {
+        passed = benchMap("resources/bench/maze.map", numRays, pool) && passed;
+        passed = benchMap("resources/bench/arena.map", numRays, pool) && passed;
+        passed = benchMap("resources/bench/glass.map", numRays, pool) && passed;
+    }
+    for (int i = 0; i < numMaps; i++) {
+        passed = benchMap(maps[i], numRays, pool) && passed;
+    }
+
+    WorkerPoolDestroy(&pool);
+
+    TextureCacheUnloadAll();
+    CloseWindow();
+    free(maps);
+
+    if (!passed) {
+        fprintf(stderr, "Some traversal modes did not hit what DDA hit!\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}